@@ -1 +1,5 @@
 C:/VulkanSDK/1.4.313.2/Bin/slangc.exe shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain -entry fragMain -o slang.spv
+C:/VulkanSDK/1.4.313.2/Bin/slangc.exe cull.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry cullMain -o cull.spv
+C:/VulkanSDK/1.4.313.2/Bin/slangc.exe particles.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry initMain -entry simulateMain -entry particleVertMain -entry particleFragMain -o particles.spv
+C:/VulkanSDK/1.4.313.2/Bin/slangc.exe meshlets.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry meshletTaskMain -entry meshletMeshMain -entry meshletFragMain -o meshlets.spv
+C:/VulkanSDK/1.4.313.2/Bin/slangc.exe quantized.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry quantizedVertMain -o quantized.spv
@@ -1 +1,5 @@
 ~/VulkanSDK/1.4.321.0/macOS/bin/slangc shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain -entry fragMain -o slang.spv
+~/VulkanSDK/1.4.321.0/macOS/bin/slangc cull.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry cullMain -o cull.spv
+~/VulkanSDK/1.4.321.0/macOS/bin/slangc particles.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry initMain -entry simulateMain -entry particleVertMain -entry particleFragMain -o particles.spv
+~/VulkanSDK/1.4.321.0/macOS/bin/slangc meshlets.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry meshletTaskMain -entry meshletMeshMain -entry meshletFragMain -o meshlets.spv
+~/VulkanSDK/1.4.321.0/macOS/bin/slangc quantized.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry quantizedVertMain -o quantized.spv
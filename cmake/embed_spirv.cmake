@@ -0,0 +1,52 @@
+# Write SPIR-V binaries into a C++ header as aligned uint32_t arrays.
+#
+# usage: cmake -DOUTPUT=<header> -DSHADERS=<NAME>=<file>[,<NAME>=<file>...]
+#              -P embed_spirv.cmake
+#
+# Each NAME becomes an `inline constexpr std::array<uint32_t, N>`. Every file
+# is a slangc output the embedding step depends on, so a missing or empty one
+# is an error.
+
+string(REPLACE "," ";" shaders "${SHADERS}")
+
+set(content "// Generated by cmake/embed_spirv.cmake, do not edit.\n")
+string(APPEND content "#pragma once\n\n#include <array>\n#include <cstdint>\n")
+
+foreach(shader IN LISTS shaders)
+    string(FIND "${shader}" "=" separator)
+    string(SUBSTRING "${shader}" 0 ${separator} name)
+    math(EXPR pathStart "${separator} + 1")
+    string(SUBSTRING "${shader}" ${pathStart} -1 path)
+
+    if(NOT EXISTS "${path}")
+        message(FATAL_ERROR "${path} does not exist")
+    endif()
+    file(READ "${path}" hex HEX)
+    string(LENGTH "${hex}" hexLength)
+    if(hexLength EQUAL 0)
+        message(FATAL_ERROR "${path} is empty")
+    endif()
+    math(EXPR remainder "${hexLength} % 8")
+    if(NOT remainder EQUAL 0)
+        message(FATAL_ERROR "${path} is not a whole number of SPIR-V words")
+    endif()
+    math(EXPR wordCount "${hexLength} / 8")
+
+    # SPIR-V files are little-endian words
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u,"
+           words "${hex}")
+    # eight words per line
+    string(REGEX REPLACE "([^,]+,[^,]+,[^,]+,[^,]+,[^,]+,[^,]+,[^,]+,[^,]+,)"
+           "\\1\n    " words "${words}")
+    string(REGEX REPLACE "\n    $" "" words "${words}")
+
+    string(APPEND content
+           "\n// ${path}\n"
+           "alignas(16) inline constexpr std::array<uint32_t, ${wordCount}> "
+           "${name} = {\n    ${words}\n};\n")
+endforeach()
+
+# only touch the header when it changes, so dependents do not rebuild
+file(WRITE "${OUTPUT}.tmp" "${content}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,14 @@
+#!/usr/bin/env sh
+# Render the same headless workload at frames-in-flight depths 1, 2 and 3 and
+# print the throughput of each run.
+#
+# usage: bench_frames_in_flight.sh [path/to/learn_vulkan] [frames]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-5000}
+
+for depth in 1 2 3; do
+    "$BIN" --headless --frames "$FRAMES" --frames-in-flight "$depth" |
+        grep '^rendered'
+done
@@ -0,0 +1,16 @@
+#!/usr/bin/env sh
+# Render headless frames at instance counts from 1 to 10 million and print
+# the throughput and CPU instance update time of each run.
+#
+# usage: bench_instances.sh [path/to/learn_vulkan] [frames] [threads]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-500}
+THREADS=${3:-0}
+
+for count in 1 1000 10000 100000 1000000 10000000; do
+    echo "instances: $count"
+    "$BIN" --headless --frames "$FRAMES" --instances "$count" \
+        --threads "$THREADS" | grep -E '^(rendered|updated)'
+done
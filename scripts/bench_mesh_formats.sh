@@ -0,0 +1,22 @@
+#!/usr/bin/env sh
+# Load time, vertex size and frame throughput of one mesh in each vertex
+# format. Instancing the mesh many times makes the run vertex-bound, where the
+# smaller formats pay off.
+#
+# usage: bench_mesh_formats.sh path/to/mesh [path/to/learn_vulkan] [frames] [extra options...]
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 path/to/mesh [path/to/learn_vulkan] [frames] [extra options...]" >&2
+    exit 1
+fi
+MESH=$1
+BIN=${2:-./build/learn_vulkan}
+FRAMES=${3:-1000}
+shift 3 2>/dev/null || shift $#
+
+for format in float half snorm16; do
+    echo "== $format"
+    "$BIN" --headless --frames "$FRAMES" --mesh "$MESH" \
+        --vertex-format "$format" "$@" | grep -E '^(rendered|mesh:)'
+done
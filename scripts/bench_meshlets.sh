@@ -0,0 +1,21 @@
+#!/usr/bin/env sh
+# Frame throughput of meshes from 16 thousand to 16 million triangles, drawn
+# by the vertex pipeline and by task and mesh shaders. The meshlets are
+# cached next to the binary, so only the first run of each detail builds
+# them.
+#
+# usage: bench_meshlets.sh [path/to/learn_vulkan] [frames] [extra options...]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-1000}
+shift 2 2>/dev/null || shift $#
+
+for detail in 128 512 1024 4096; do
+    for mode in "" --mesh-shaders; do
+        echo "== detail $detail ${mode:-(vertex pipeline)}"
+        "$BIN" --headless --frames "$FRAMES" --mesh-detail "$detail" $mode \
+            --meshlet-cache "$(dirname "$BIN")/meshlets_$detail.bin" "$@" |
+            grep -E '^(rendered|meshlets:|mesh shaders)'
+    done
+done
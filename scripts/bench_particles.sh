@@ -0,0 +1,19 @@
+#!/usr/bin/env sh
+# Particle throughput from 1 to 8 million particles, simulated on the async
+# compute queue and on the graphics queue. 8 million keeps the particle
+# buffer within the guaranteed 128 MiB maxStorageBufferRange.
+#
+# usage: bench_particles.sh [path/to/learn_vulkan] [frames] [extra options...]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-1000}
+shift 2 2>/dev/null || shift $#
+
+for count in 1000000 2000000 4000000 8000000; do
+    for mode in "" --no-async-compute; do
+        echo "== $count particles ${mode:-(async compute)}"
+        "$BIN" --headless --frames "$FRAMES" --particles "$count" $mode "$@" |
+            grep -E '^(rendered|particles:)'
+    done
+done
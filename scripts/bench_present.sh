@@ -0,0 +1,17 @@
+#!/usr/bin/env sh
+# Run each present policy and print throughput, frame times and the time
+# from acquire to presentation. Pass --headless-surface as the third argument
+# to run without a display.
+#
+# usage: bench_present.sh [path/to/learn_vulkan] [frames] [extra options...]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-1000}
+shift 2 2>/dev/null || shift $#
+
+for policy in latency power capped; do
+    echo "== $policy"
+    "$BIN" --present "$policy" --frames "$FRAMES" "$@" |
+        grep -E '^(presenting|rendered|frame time|acquire to)'
+done
@@ -0,0 +1,15 @@
+#!/usr/bin/env sh
+# Record a fixed number of draws with 1, 2, 4 and 8 threads and print the
+# recording time of each run.
+#
+# usage: bench_recording.sh [path/to/learn_vulkan] [draws] [frames]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+DRAWS=${2:-10000}
+FRAMES=${3:-500}
+
+for threads in 1 2 4 8; do
+    "$BIN" --headless --frames "$FRAMES" --instances "$DRAWS" \
+        --draws "$DRAWS" --threads "$threads" | grep '^recorded'
+done
@@ -0,0 +1,11 @@
+#!/usr/bin/env sh
+# Resize the window every frame and print the frame time distribution,
+# including the worst frame. Needs a display.
+#
+# usage: bench_resize.sh [path/to/learn_vulkan] [frames]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+FRAMES=${2:-2000}
+
+"$BIN" --resize-test --frames "$FRAMES" | grep -E '^(rendered|frame time)'
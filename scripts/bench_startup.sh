@@ -0,0 +1,20 @@
+#!/usr/bin/env sh
+# Compare the time to first frame of the serial and parallel startup. Each
+# mode runs several times; the pipeline cache is left in place, so only the
+# first run of each compiles from scratch.
+#
+# usage: bench_startup.sh [path/to/learn_vulkan] [runs] [extra options...]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+RUNS=${2:-5}
+shift 2 2>/dev/null || shift $#
+
+for mode in --serial-startup ""; do
+    echo "== ${mode:-parallel}"
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        "$BIN" --headless --frames 1 $mode "$@" | grep -E '^startup:'
+        i=$((i + 1))
+    done
+done
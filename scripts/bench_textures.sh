@@ -0,0 +1,19 @@
+#!/usr/bin/env sh
+# Stream a library of large textures larger than the budget and print the
+# frame time distribution next to the streaming totals. Frame times should
+# stay flat while the textures page in.
+#
+# usage: bench_textures.sh [path/to/learn_vulkan] [texture dir] [budget MiB]
+set -e
+
+BIN=${1:-./build/learn_vulkan}
+DIR=${2:-./textures}
+BUDGET=${3:-512}
+
+if [ ! -d "$DIR" ]; then
+    # 128 BC7 textures of 4096x4096, about 2.7 GB with their mips
+    python3 "$(dirname "$0")/make_textures.py" "$DIR" 128 4096
+fi
+
+"$BIN" --headless --frames 3000 --instances 64 --textures "$DIR" \
+    --texture-budget "$BUDGET" | grep -E '^(rendered|frame time|textures)'
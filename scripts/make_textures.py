@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Write synthetic BC7 KTX2 textures with full mip chains, for streaming tests.
+
+usage: make_textures.py DIR [count] [size]
+"""
+import os
+import struct
+import sys
+
+VK_FORMAT_BC7_UNORM_BLOCK = 145
+BLOCK_BYTES = 16
+
+
+def level_sizes(size):
+    sizes = []
+    while True:
+        blocks = max(1, (size + 3) // 4)
+        sizes.append(blocks * blocks * BLOCK_BYTES)
+        if size == 1:
+            return sizes
+        size //= 2
+
+
+def write_ktx2(path, size):
+    sizes = level_sizes(size)
+    header_size = 80 + 24 * len(sizes)
+    # Levels are stored smallest first, as KTX2 recommends.
+    offsets = [0] * len(sizes)
+    offset = header_size
+    for level in reversed(range(len(sizes))):
+        offset = (offset + 15) // 16 * 16
+        offsets[level] = offset
+        offset += sizes[level]
+
+    header = bytearray(b"\xabKTX 20\xbb\r\n\x1a\n")
+    header += struct.pack("<9I", VK_FORMAT_BC7_UNORM_BLOCK, 1, size, size,
+                          0, 0, 1, len(sizes), 0)
+    header += struct.pack("<4I2Q", 0, 0, 0, 0, 0, 0)
+    for level, level_size in enumerate(sizes):
+        header += struct.pack("<3Q", offsets[level], level_size, level_size)
+
+    with open(path, "wb") as out:
+        out.write(header)
+        for level in reversed(range(len(sizes))):
+            out.write(b"\0" * (offsets[level] - out.tell()))
+            # Random blocks decode to noise, which is enough to stream.
+            out.write(os.urandom(sizes[level]))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__.strip())
+    directory = sys.argv[1]
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 64
+    size = int(sys.argv[3]) if len(sys.argv) > 3 else 4096
+    os.makedirs(directory, exist_ok=True)
+    for i in range(count):
+        write_ktx2(os.path.join(directory, f"texture{i:04}.ktx2"), size)
+
+
+if __name__ == "__main__":
+    main()
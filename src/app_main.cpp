@@ -0,0 +1,3 @@
+#include "entry_points.hpp"
+
+int main(int argc, char* argv[]) { return runApp(argc, argv); }
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json_value.hpp"
+
+// Summary of a series of frame times in milliseconds.
+struct FrameTimeStats
+{
+    size_t samples = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+
+    // Nearest-rank percentiles of the samples after the first skip.
+    template <typename T>
+    static FrameTimeStats of(const std::vector<T>& all, size_t skip)
+    {
+        FrameTimeStats stats;
+        if (all.size() <= skip)
+        {
+            return stats;
+        }
+        std::vector<double> sorted(all.begin() + static_cast<ptrdiff_t>(skip),
+                                   all.end());
+        std::ranges::sort(sorted);
+        double sum = 0.0;
+        for (double ms : sorted)
+        {
+            sum += ms;
+        }
+        auto rank = [&sorted](size_t percent)
+        { return sorted[(sorted.size() - 1) * percent / 100]; };
+        stats.samples = sorted.size();
+        stats.mean = sum / static_cast<double>(sorted.size());
+        stats.p50 = rank(50);
+        stats.p95 = rank(95);
+        stats.p99 = rank(99);
+        stats.max = sorted.back();
+        return stats;
+    }
+};
+
+struct SceneResult
+{
+    std::string name;
+    uint64_t frames = 0;
+    // Over the measured frames.
+    double fps = 0.0;
+    // Time from creating the application to its first frame.
+    double startupMs = 0.0;
+    FrameTimeStats cpu;
+    // No samples when the queue has no timestamps.
+    FrameTimeStats gpu;
+    uint64_t reservedBytes = 0;
+    uint64_t allocatedBytes = 0;
+    uint32_t deviceMemoryCount = 0;
+};
+
+// Scene results as JSON, and the check of a run against a stored one. Every
+// compared metric is lower-is-better; a metric regresses when it exceeds the
+// baseline by more than the tolerance.
+class BenchReport
+{
+public:
+    struct Metric
+    {
+        const char* name;
+        double (*read)(const SceneResult&);
+        // Path of the value in a scene object of the JSON.
+        const char* group;
+        const char* key;
+    };
+
+    static constexpr std::array<Metric, 8> COMPARED_METRICS = { {
+        { "cpu p50", [](const SceneResult& r) { return r.cpu.p50; },
+          "cpu_ms", "p50" },
+        { "cpu p95", [](const SceneResult& r) { return r.cpu.p95; },
+          "cpu_ms", "p95" },
+        { "cpu p99", [](const SceneResult& r) { return r.cpu.p99; },
+          "cpu_ms", "p99" },
+        { "gpu p50", [](const SceneResult& r) { return r.gpu.p50; },
+          "gpu_ms", "p50" },
+        { "gpu p95", [](const SceneResult& r) { return r.gpu.p95; },
+          "gpu_ms", "p95" },
+        { "gpu p99", [](const SceneResult& r) { return r.gpu.p99; },
+          "gpu_ms", "p99" },
+        { "startup", [](const SceneResult& r) { return r.startupMs; },
+          "", "startup_ms" },
+        { "device memory",
+          [](const SceneResult& r)
+          { return static_cast<double>(r.reservedBytes); },
+          "memory", "reserved_bytes" },
+    } };
+
+    std::string device;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t warmupFrames = 0;
+    std::vector<SceneResult> scenes;
+
+    void write(std::ostream& out) const
+    {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(4);
+        out << "{\n  \"device\": " << quoted(device)
+            << ",\n  \"size\": [" << width << ", " << height
+            << "],\n  \"warmup_frames\": " << warmupFrames
+            << ",\n  \"scenes\": [";
+        for (size_t i = 0; i < scenes.size(); i++)
+        {
+            const SceneResult& scene = scenes[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\n"
+                << "      \"name\": " << quoted(scene.name) << ",\n"
+                << "      \"frames\": " << scene.frames << ",\n"
+                << "      \"fps\": " << scene.fps << ",\n"
+                << "      \"startup_ms\": " << scene.startupMs << ",\n"
+                << "      \"cpu_ms\": " << stats(scene.cpu) << ",\n"
+                << "      \"gpu_ms\": " << stats(scene.gpu) << ",\n"
+                << "      \"memory\": { \"reserved_bytes\": "
+                << scene.reservedBytes
+                << ", \"allocated_bytes\": " << scene.allocatedBytes
+                << ", \"device_memory_count\": " << scene.deviceMemoryCount
+                << " }\n    }";
+        }
+        out << "\n  ]\n}\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    // One line per regressed metric. Scenes or metrics missing from the
+    // baseline, or zero in either run, are not compared.
+    std::vector<std::string> compare(const JsonValue& baseline,
+                                     double tolerance) const
+    {
+        std::vector<std::string> regressions;
+        for (const SceneResult& scene : scenes)
+        {
+            const auto& elements = baseline["scenes"].elements();
+            const auto old = std::ranges::find_if(
+                elements,
+                [&scene](const JsonValue& value)
+                { return value["name"].string() == scene.name; });
+            if (old == elements.end())
+            {
+                continue;
+            }
+            for (const Metric& metric : COMPARED_METRICS)
+            {
+                const JsonValue& group =
+                    *metric.group == '\0' ? *old : (*old)[metric.group];
+                const double before = group[metric.key].number();
+                const double now = metric.read(scene);
+                if (before <= 0.0 || now <= 0.0 ||
+                    now <= before * (1.0 + tolerance))
+                {
+                    continue;
+                }
+                std::ostringstream line;
+                line << std::fixed << std::setprecision(3) << scene.name
+                     << ": " << metric.name << " " << now << " vs " << before
+                     << " (+" << std::setprecision(1)
+                     << 100.0 * (now / before - 1.0) << "%)";
+                regressions.push_back(line.str());
+            }
+        }
+        return regressions;
+    }
+
+private:
+    static std::string quoted(const std::string& text)
+    {
+        std::string result = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                result += c;
+            }
+        }
+        return result + "\"";
+    }
+
+    static std::string stats(const FrameTimeStats& s)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(4) << "{ \"samples\": "
+            << s.samples << ", \"mean\": " << s.mean << ", \"p50\": " << s.p50
+            << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99
+            << ", \"max\": " << s.max << " }";
+        return out.str();
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped CPU zones recorded into a fixed-size ring buffer per thread. A thread
+// allocates its buffer the first time it records a zone; after that, recording
+// is two clock reads and a store, and the oldest zones are overwritten. The
+// buffers can be dumped as Chrome Trace Event JSON for chrome://tracing or
+// Perfetto.
+//
+// Zone names must outlive the profiler, string literals are expected.
+class CpuProfiler
+{
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 1 << 16;
+
+    static void setEnabled(bool enabled)
+    {
+        instance().enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool isEnabled()
+    {
+        return instance().enabled.load(std::memory_order_relaxed);
+    }
+
+    // Name shown for the calling thread in the trace viewer.
+    static void setThreadName(std::string name)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        std::scoped_lock lock(instance().mutex);
+        buffer.name = std::move(name);
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    static void record(const char* name, int64_t startNs, int64_t endNs)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        buffer.events[head % EVENTS_PER_THREAD] = { name, startNs, endNs };
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Zones still being written by other threads while dumping may be torn or
+    // missing, dump from a quiet point (e.g. between frames) for exact output.
+    static bool dumpChromeTrace(const std::filesystem::path& path)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open())
+        {
+            return false;
+        }
+
+        Profiler& profiler = instance();
+        std::scoped_lock lock(profiler.mutex);
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer : profiler.threads)
+        {
+            if (!first)
+            {
+                out << ',';
+            }
+            first = false;
+            out << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                << "\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+            writeString(out, buffer->name);
+            out << "}}";
+
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t count = std::min<uint64_t>(head, EVENTS_PER_THREAD);
+            for (uint64_t i = head - count; i < head; i++)
+            {
+                const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+                out << ",\n{\"name\":";
+                writeString(out, event.name);
+                out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                    << ",\"ts\":"
+                    << static_cast<double>(event.startNs - profiler.epoch) /
+                           1000.0
+                    << ",\"dur\":"
+                    << static_cast<double>(event.endNs - event.startNs) /
+                           1000.0
+                    << '}';
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct Event
+    {
+        const char* name = nullptr;
+        int64_t startNs = 0;
+        int64_t endNs = 0;
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t id = 0;
+        std::string name;
+        std::vector<Event> events;
+        std::atomic<uint64_t> head = 0;
+    };
+
+    struct Profiler
+    {
+        std::mutex mutex;
+        // Buffers are never freed, so zones of exited threads still dump.
+        std::vector<std::unique_ptr<ThreadBuffer>> threads;
+        std::atomic<bool> enabled = true;
+        int64_t epoch = now();
+    };
+
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = registerThread();
+        return *buffer;
+    }
+
+    static ThreadBuffer* registerThread()
+    {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->events.resize(EVENTS_PER_THREAD);
+
+        Profiler& profiler = instance();
+        std::scoped_lock lock(profiler.mutex);
+        buffer->id = static_cast<uint32_t>(profiler.threads.size());
+        buffer->name = "thread " + std::to_string(buffer->id);
+        return profiler.threads.emplace_back(std::move(buffer)).get();
+    }
+
+    static void writeString(std::ofstream& out, const std::string& value)
+    {
+        out << '"';
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+};
+
+// Records the time between its construction and destruction.
+class CpuZone
+{
+public:
+    explicit CpuZone(const char* name)
+        : name(name), startNs(CpuProfiler::isEnabled() ? CpuProfiler::now() : 0)
+    {
+    }
+
+    ~CpuZone()
+    {
+        if (startNs != 0)
+        {
+            CpuProfiler::record(name, startNs, CpuProfiler::now());
+        }
+    }
+
+    CpuZone(const CpuZone&) = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+
+private:
+    const char* name;
+    int64_t startNs;
+};
+
+#define CPU_ZONE_CONCAT_INNER(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_INNER(a, b)
+#define CPU_ZONE(name) CpuZone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Holds objects the GPU may still be using until a monotonic counter says it
+// is done with them. The counter is whatever the owner uses to track
+// completion: a frame number whose fence has signaled, or a timeline
+// semaphore value. Objects are destroyed in retirement order, and collect()
+// destroys at most a fixed number per call so one frame never pays for a
+// burst of releases.
+//
+// Retirement values must not decrease. Not thread safe.
+class DeletionQueue
+{
+public:
+    static constexpr size_t DEFAULT_BUDGET = 16;
+
+    // Keep object alive until collect() is called with a value >= value.
+    template <typename T>
+    void retire(uint64_t value, T&& object)
+    {
+        using Object = std::remove_cvref_t<T>;
+        entries.push_back(
+            { .value = value,
+              .object = { new Object(std::forward<T>(object)),
+                          [](void* p) { delete static_cast<Object*>(p); } } });
+    }
+
+    // Destroy up to budget objects retired at or before completed. Returns
+    // how many were destroyed.
+    size_t collect(uint64_t completed, size_t budget = DEFAULT_BUDGET)
+    {
+        size_t destroyed = 0;
+        while (destroyed < budget && !entries.empty() &&
+               entries.front().value <= completed)
+        {
+            entries.pop_front();
+            destroyed++;
+        }
+        return destroyed;
+    }
+
+    // Destroy everything, once the GPU is known to be idle.
+    void flush() { entries.clear(); }
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Entry
+    {
+        uint64_t value = 0;
+        std::unique_ptr<void, void (*)(void*)> object;
+    };
+
+    std::deque<Entry> entries;
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+// Hands out indices below a fixed capacity, reusing freed ones first.
+class IndexAllocator
+{
+public:
+    explicit IndexAllocator(uint32_t capacity = 0) : capacity(capacity) {}
+
+    uint32_t allocate()
+    {
+        if (!freeList.empty())
+        {
+            const uint32_t index = freeList.back();
+            freeList.pop_back();
+            return index;
+        }
+        if (next == capacity)
+        {
+            throw std::runtime_error("descriptor heap is full!");
+        }
+        return next++;
+    }
+
+    void free(uint32_t index) { freeList.push_back(index); }
+
+    uint32_t size() const
+    {
+        return next - static_cast<uint32_t>(freeList.size());
+    }
+
+private:
+    uint32_t capacity = 0;
+    uint32_t next = 0;
+    std::vector<uint32_t> freeList;
+};
+
+// One global descriptor set with an unbounded-style array per resource kind:
+// sampled images, storage buffers and samplers. Bindings are partially bound
+// and update-after-bind, so resources are added and removed while the set is
+// bound in command buffers still in flight, and shaders pick a resource by
+// the index they get in push constants. The set is bound once per command
+// buffer instead of once per draw.
+//
+// An index must not be reused while a submitted frame may still read it, so
+// indices are owned by Handle, which is retired through the deletion queue.
+class DescriptorHeap
+{
+public:
+    enum class Kind : uint32_t
+    {
+        SampledImage = 0,
+        StorageBuffer = 1,
+        Sampler = 2,
+    };
+
+    static constexpr uint32_t MAX_SAMPLED_IMAGES = 4096;
+    static constexpr uint32_t MAX_STORAGE_BUFFERS = 1024;
+    static constexpr uint32_t MAX_SAMPLERS = 64;
+
+    // Frees its index when destroyed. Move-only.
+    class Handle
+    {
+    public:
+        Handle() = default;
+        Handle(DescriptorHeap* heap, Kind kind, uint32_t index)
+            : heap(heap), kind(kind), index(index)
+        {
+        }
+        ~Handle() { reset(); }
+
+        Handle(Handle&& other) noexcept
+            : heap(std::exchange(other.heap, nullptr)), kind(other.kind),
+              index(other.index)
+        {
+        }
+        Handle& operator=(Handle&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                heap = std::exchange(other.heap, nullptr);
+                kind = other.kind;
+                index = other.index;
+            }
+            return *this;
+        }
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        // Index into the shader array of this handle's kind.
+        uint32_t get() const { return index; }
+        explicit operator bool() const { return heap != nullptr; }
+
+        void reset()
+        {
+            if (heap != nullptr)
+            {
+                heap->allocators[static_cast<uint32_t>(kind)].free(index);
+                heap = nullptr;
+            }
+        }
+
+    private:
+        friend class DescriptorHeap;
+
+        DescriptorHeap* heap = nullptr;
+        Kind kind = Kind::SampledImage;
+        uint32_t index = 0;
+    };
+
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device)
+    {
+        this->device = &device;
+
+        // Clamp to what the device allows for update-after-bind sets.
+        const auto properties = physicalDevice.getProperties2<
+            vk::PhysicalDeviceProperties2,
+            vk::PhysicalDeviceVulkan12Properties>();
+        const auto& limits =
+            properties.get<vk::PhysicalDeviceVulkan12Properties>();
+        capacities = {
+            std::min({ MAX_SAMPLED_IMAGES,
+                       limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                       limits.maxPerStageDescriptorUpdateAfterBindSampledImages }),
+            std::min({ MAX_STORAGE_BUFFERS,
+                       limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                       limits
+                           .maxPerStageDescriptorUpdateAfterBindStorageBuffers }),
+            std::min({ MAX_SAMPLERS,
+                       limits.maxDescriptorSetUpdateAfterBindSamplers,
+                       limits.maxPerStageDescriptorUpdateAfterBindSamplers })
+        };
+        for (uint32_t i = 0; i < KIND_COUNT; i++)
+        {
+            allocators[i] = IndexAllocator(capacities[i]);
+        }
+
+        std::array<vk::DescriptorSetLayoutBinding, KIND_COUNT> bindings;
+        std::array<vk::DescriptorBindingFlags, KIND_COUNT> bindingFlags;
+        std::array<vk::DescriptorPoolSize, KIND_COUNT> poolSizes;
+        for (uint32_t i = 0; i < KIND_COUNT; i++)
+        {
+            bindings[i] = { .binding = i,
+                            .descriptorType = DESCRIPTOR_TYPES[i],
+                            .descriptorCount = capacities[i],
+                            .stageFlags = vk::ShaderStageFlagBits::eAll };
+            bindingFlags[i] =
+                vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+                vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending |
+                vk::DescriptorBindingFlagBits::ePartiallyBound;
+            poolSizes[i] = { .type = DESCRIPTOR_TYPES[i],
+                             .descriptorCount = capacities[i] };
+        }
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {
+            .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+            .pBindingFlags = bindingFlags.data()
+        };
+        setLayout = vk::raii::DescriptorSetLayout(
+            device,
+            vk::DescriptorSetLayoutCreateInfo {
+                .pNext = &bindingFlagsInfo,
+                .flags = vk::DescriptorSetLayoutCreateFlagBits::
+                    eUpdateAfterBindPool,
+                .bindingCount = static_cast<uint32_t>(bindings.size()),
+                .pBindings = bindings.data() });
+
+        pool = vk::raii::DescriptorPool(
+            device,
+            vk::DescriptorPoolCreateInfo {
+                .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind |
+                         vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+                .maxSets = 1,
+                .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+                .pPoolSizes = poolSizes.data() });
+        set = std::move(vk::raii::DescriptorSets(
+                            device,
+                            vk::DescriptorSetAllocateInfo {
+                                .descriptorPool = pool,
+                                .descriptorSetCount = 1,
+                                .pSetLayouts = &*setLayout })
+                            .front());
+    }
+
+    const vk::raii::DescriptorSetLayout& layout() const { return setLayout; }
+
+    Handle addSampledImage(vk::ImageView view, vk::ImageLayout imageLayout)
+    {
+        Handle handle = allocate(Kind::SampledImage);
+        vk::DescriptorImageInfo imageInfo { .imageView = view,
+                                            .imageLayout = imageLayout };
+        write(handle, { .pImageInfo = &imageInfo });
+        return handle;
+    }
+
+    Handle addStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset = 0,
+                            vk::DeviceSize range = vk::WholeSize)
+    {
+        Handle handle = allocate(Kind::StorageBuffer);
+        vk::DescriptorBufferInfo bufferInfo { .buffer = buffer,
+                                              .offset = offset,
+                                              .range = range };
+        write(handle, { .pBufferInfo = &bufferInfo });
+        return handle;
+    }
+
+    Handle addSampler(vk::Sampler sampler)
+    {
+        Handle handle = allocate(Kind::Sampler);
+        vk::DescriptorImageInfo imageInfo { .sampler = sampler };
+        write(handle, { .pImageInfo = &imageInfo });
+        return handle;
+    }
+
+    // Bind the heap as set 0 of layout.
+    void bind(const vk::raii::CommandBuffer& commandBuffer,
+              vk::PipelineBindPoint bindPoint,
+              vk::PipelineLayout pipelineLayout) const
+    {
+        commandBuffer.bindDescriptorSets(
+            bindPoint, pipelineLayout, 0, *set, {});
+    }
+
+    uint32_t size(Kind kind) const
+    {
+        return allocators[static_cast<uint32_t>(kind)].size();
+    }
+
+    uint32_t capacity(Kind kind) const
+    {
+        return capacities[static_cast<uint32_t>(kind)];
+    }
+
+private:
+    static constexpr uint32_t KIND_COUNT = 3;
+    static constexpr std::array<vk::DescriptorType, KIND_COUNT>
+        DESCRIPTOR_TYPES = { vk::DescriptorType::eSampledImage,
+                             vk::DescriptorType::eStorageBuffer,
+                             vk::DescriptorType::eSampler };
+
+    const vk::raii::Device* device = nullptr;
+    std::array<uint32_t, KIND_COUNT> capacities {};
+    std::array<IndexAllocator, KIND_COUNT> allocators;
+
+    vk::raii::DescriptorSetLayout setLayout = nullptr;
+    vk::raii::DescriptorPool pool = nullptr;
+    vk::raii::DescriptorSet set = nullptr;
+
+    Handle allocate(Kind kind)
+    {
+        return { this, kind, allocators[static_cast<uint32_t>(kind)].allocate() };
+    }
+
+    // Fill in the destination of write from handle and submit it.
+    void write(const Handle& handle, vk::WriteDescriptorSet write) const
+    {
+        write.dstSet = *set;
+        write.dstBinding = static_cast<uint32_t>(handle.kind);
+        write.dstArrayElement = handle.get();
+        write.descriptorCount = 1;
+        write.descriptorType = DESCRIPTOR_TYPES[write.dstBinding];
+        device->updateDescriptorSets(write, {});
+    }
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// Both programs live in main.cpp, which is compiled once and linked into
+// learn_vulkan and learn_vulkan_bench; each executable's main() calls one.
+
+// The interactive renderer, or a headless run with --headless.
+int runApp(int argc, char* argv[]);
+
+// The benchmark scenes, with a JSON report and an optional baseline check.
+int runBench(int argc, char* argv[]);
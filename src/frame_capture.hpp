@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "cpu_profiler.hpp"
+#include "gpu_allocator.hpp"
+#include "image_encoder.hpp"
+#include "thread_pool.hpp"
+
+enum class CaptureContainer
+{
+    // One numbered PNG per frame.
+    Png,
+    // All frames in one YUV4MPEG2 stream.
+    Y4m,
+};
+
+struct CaptureContainerInfo
+{
+    const char* extension;
+    CaptureContainer container;
+};
+
+constexpr std::array<CaptureContainerInfo, 2> CAPTURE_CONTAINERS = { {
+    { ".png", CaptureContainer::Png },
+    { ".y4m", CaptureContainer::Y4m },
+} };
+
+struct CapturePixelFormat
+{
+    vk::Format format;
+    bool bgra;
+};
+
+constexpr std::array<CapturePixelFormat, 4> CAPTURE_PIXEL_FORMATS = { {
+    { vk::Format::eB8G8R8A8Srgb, true },
+    { vk::Format::eB8G8R8A8Unorm, true },
+    { vk::Format::eR8G8B8A8Srgb, false },
+    { vk::Format::eR8G8B8A8Unorm, false },
+} };
+
+// Copies rendered frames into a ring of host-visible buffers and encodes them
+// on the thread pool. A buffer is read once its frame's fence has signaled,
+// so nothing waits for the device. The ring holds SPARE_BUFFERS more buffers
+// than frames in flight, so encoding can fall behind by that many frames
+// before the render thread waits for a buffer; frames are never dropped.
+class FrameCapture
+{
+public:
+    static constexpr uint32_t SPARE_BUFFERS = 4;
+
+    // Throws for paths whose extension names no container.
+    static CaptureContainer containerFor(const std::string& path)
+    {
+        const std::string extension =
+            std::filesystem::path(path).extension().string();
+        const auto it = std::ranges::find_if(
+            CAPTURE_CONTAINERS,
+            [&extension](const CaptureContainerInfo& info)
+            { return extension == info.extension; });
+        if (it == CAPTURE_CONTAINERS.end())
+        {
+            throw std::runtime_error("capture path must end in .png or .y4m: " +
+                                     path);
+        }
+        return it->container;
+    }
+
+    ~FrameCapture() { waitForEncodes(); }
+
+    void init(GpuAllocator& allocator, ThreadPool& threadPool,
+              const std::string& path, vk::Format format,
+              uint32_t framesPerSecond, uint32_t framesInFlight)
+    {
+        const auto pixelFormat = std::ranges::find(
+            CAPTURE_PIXEL_FORMATS, format, &CapturePixelFormat::format);
+        if (pixelFormat == CAPTURE_PIXEL_FORMATS.end())
+        {
+            throw std::runtime_error(
+                "capture needs an 8-bit RGBA or BGRA render format");
+        }
+        this->allocator = &allocator;
+        this->threadPool = &threadPool;
+        this->path = path;
+        this->framesPerSecond = framesPerSecond;
+        bgra = pixelFormat->bgra;
+        container = containerFor(path);
+        if (container == CaptureContainer::Y4m)
+        {
+            stream.open(path, std::ios::binary | std::ios::trunc);
+            if (!stream)
+            {
+                throw std::runtime_error("failed to open " + path);
+            }
+        }
+        slots = std::vector<Slot>(framesInFlight + SPARE_BUFFERS);
+        pending.assign(framesInFlight, NONE);
+    }
+
+    bool enabled() const { return allocator != nullptr; }
+
+    // Copy image, in TransferSrcOptimal, into the next buffer of the ring.
+    // Must be outside of rendering.
+    void recordCopy(const vk::raii::CommandBuffer& commandBuffer,
+                    uint32_t frameIndex, vk::Image image, vk::Extent2D extent)
+    {
+        const uint32_t index = nextSlot;
+        nextSlot = (nextSlot + 1) % static_cast<uint32_t>(slots.size());
+        Slot& slot = slots[index];
+        {
+            std::unique_lock lock(mutex);
+            if (slot.busy)
+            {
+                CPU_ZONE("captureWait");
+                const auto start = std::chrono::steady_clock::now();
+                encoded.wait(lock, [&slot] { return !slot.busy; });
+                waitCount++;
+                waitSeconds += std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+            }
+            slot.busy = true;
+        }
+
+        // The slot is idle, so its buffer may be replaced.
+        const vk::DeviceSize size =
+            static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+        if (slot.capacity < size)
+        {
+            slot.buffer = allocator->createBuffer(
+                vk::BufferCreateInfo {
+                    .size = size,
+                    .usage = vk::BufferUsageFlagBits::eTransferDst,
+                    .sharingMode = vk::SharingMode::eExclusive },
+                vk::MemoryPropertyFlagBits::eHostVisible,
+                vk::MemoryPropertyFlagBits::eHostCached);
+            slot.capacity = size;
+        }
+        slot.extent = extent;
+        slot.sequence = recorded++;
+        pending[frameIndex] = index;
+
+        commandBuffer.copyImageToBuffer(
+            image,
+            vk::ImageLayout::eTransferSrcOptimal,
+            *slot.buffer.buffer,
+            vk::BufferImageCopy {
+                .bufferOffset = 0,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = { .aspectMask =
+                                          vk::ImageAspectFlagBits::eColor,
+                                      .mipLevel = 0,
+                                      .baseArrayLayer = 0,
+                                      .layerCount = 1 },
+                .imageOffset = { 0, 0, 0 },
+                .imageExtent = { extent.width, extent.height, 1 } });
+        const vk::MemoryBarrier2 barrier {
+            .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+            .dstAccessMask = vk::AccessFlagBits2::eHostRead
+        };
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+            .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+    }
+
+    // Hand the frame's copy to an encoder. Call once its fence has signaled.
+    // Throws if an earlier frame failed to be written.
+    void collect(uint32_t frameIndex)
+    {
+        {
+            std::scoped_lock lock(mutex);
+            if (!error.empty())
+            {
+                throw std::runtime_error(error);
+            }
+        }
+        const uint32_t index = pending[frameIndex];
+        if (index == NONE)
+        {
+            return;
+        }
+        pending[frameIndex] = NONE;
+        allocator->invalidate(slots[index].buffer.allocation);
+        {
+            std::scoped_lock lock(mutex);
+            encoding++;
+        }
+        // Without workers the encoder runs here.
+        if (threadPool->threadCount() == 1)
+        {
+            encode(index);
+        }
+        else
+        {
+            threadPool->submit([this, index] { encode(index); });
+        }
+    }
+
+    // Encode the frames still in flight and wait for every encoder. Call
+    // once the device is idle.
+    void finish()
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        for (uint32_t frameIndex = 0; frameIndex < pending.size();
+             frameIndex++)
+        {
+            collect(frameIndex);
+        }
+        waitForEncodes();
+        stream.close();
+        if (!error.empty())
+        {
+            throw std::runtime_error(error);
+        }
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        out << "capture: " << written << " frames to " << path;
+        if (skipped > 0)
+        {
+            out << " (" << skipped << " of a different size skipped)";
+        }
+        out << ", encoding "
+            << 1000.0 * encodeSeconds /
+                   static_cast<double>(std::max<uint64_t>(written, 1))
+            << " ms/frame on workers, render thread waited for a buffer "
+            << waitCount << " times (" << 1000.0 * waitSeconds << " ms)"
+            << std::endl;
+    }
+
+private:
+    static constexpr uint32_t NONE = ~0u;
+
+    struct Slot
+    {
+        AllocatedBuffer buffer;
+        vk::DeviceSize capacity = 0;
+        vk::Extent2D extent;
+        // Position of the frame among the captured ones.
+        uint64_t sequence = 0;
+        // Recorded and not yet encoded.
+        bool busy = false;
+    };
+
+    GpuAllocator* allocator = nullptr;
+    ThreadPool* threadPool = nullptr;
+    std::string path;
+    CaptureContainer container = CaptureContainer::Png;
+    uint32_t framesPerSecond = 60;
+    bool bgra = true;
+
+    std::vector<Slot> slots;
+    uint32_t nextSlot = 0;
+    // Slot each frame in flight copied into, NONE when it captured nothing.
+    std::vector<uint32_t> pending;
+    uint64_t recorded = 0;
+
+    // Guards busy, the statistics, error and the stream state below.
+    std::mutex mutex;
+    std::condition_variable encoded;
+    // Frames handed to an encoder and not finished.
+    uint32_t encoding = 0;
+    std::string error;
+    uint64_t waitCount = 0;
+    double waitSeconds = 0.0;
+    double encodeSeconds = 0.0;
+    uint64_t written = 0;
+    uint64_t skipped = 0;
+
+    // Y4M frames finish encoding in any order and are appended in sequence.
+    // Their slots are free again by then, so the extent is kept with them.
+    struct EncodedFrame
+    {
+        vk::Extent2D extent;
+        std::vector<std::byte> bytes;
+    };
+    std::ofstream stream;
+    vk::Extent2D streamExtent;
+    uint64_t nextWrite = 0;
+    std::map<uint64_t, EncodedFrame> ready;
+
+    void waitForEncodes()
+    {
+        std::unique_lock lock(mutex);
+        encoded.wait(lock, [this] { return encoding == 0; });
+    }
+
+    void encode(uint32_t index)
+    {
+        CPU_ZONE("encodeFrame");
+        const auto start = std::chrono::steady_clock::now();
+        Slot& slot = slots[index];
+        const auto* pixels =
+            static_cast<const std::byte*>(slot.buffer.allocation.mapped());
+        const uint32_t width = slot.extent.width;
+        const uint32_t height = slot.extent.height;
+        std::string failure;
+        if (container == CaptureContainer::Png)
+        {
+            const std::vector<std::byte> file =
+                ImageEncoder::png(pixels, width, height, bgra);
+            const std::string framePath = numberedPath(slot.sequence);
+            std::ofstream out(framePath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(file.data()),
+                      static_cast<std::streamsize>(file.size()));
+            if (!out)
+            {
+                failure = "failed to write " + framePath;
+            }
+        }
+        std::vector<std::byte> frame;
+        if (container == CaptureContainer::Y4m)
+        {
+            frame = ImageEncoder::y4mFrame(pixels, width, height, bgra);
+        }
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+
+        std::scoped_lock lock(mutex);
+        if (container == CaptureContainer::Y4m)
+        {
+            ready.emplace(slot.sequence,
+                          EncodedFrame { .extent = slot.extent,
+                                         .bytes = std::move(frame) });
+            failure = writeReady();
+        }
+        else
+        {
+            written++;
+        }
+        if (!failure.empty() && error.empty())
+        {
+            error = failure;
+        }
+        encodeSeconds += seconds;
+        slot.busy = false;
+        encoding--;
+        encoded.notify_all();
+    }
+
+    // Append the frames that are next in sequence. The stream takes the size
+    // of its first frame. Called with mutex held.
+    std::string writeReady()
+    {
+        for (auto it = ready.find(nextWrite); it != ready.end();
+             it = ready.find(++nextWrite))
+        {
+            const vk::Extent2D extent = it->second.extent;
+            if (nextWrite == 0)
+            {
+                streamExtent = extent;
+                stream << ImageEncoder::y4mHeader(
+                    extent.width, extent.height, framesPerSecond);
+            }
+            if (extent.width != streamExtent.width ||
+                extent.height != streamExtent.height)
+            {
+                skipped++;
+            }
+            else
+            {
+                const std::vector<std::byte>& bytes = it->second.bytes;
+                stream.write(reinterpret_cast<const char*>(bytes.data()),
+                             static_cast<std::streamsize>(bytes.size()));
+                written++;
+            }
+            ready.erase(it);
+            if (!stream)
+            {
+                return "failed to write " + path;
+            }
+        }
+        return {};
+    }
+
+    // frame.png becomes frame_000042.png.
+    std::string numberedPath(uint64_t sequence) const
+    {
+        std::filesystem::path numbered(path);
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%06llu",
+                      static_cast<unsigned long long>(sequence));
+        numbered.replace_filename(numbered.stem().string() + suffix +
+                                  numbered.extension().string());
+        return numbered.string();
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "cpu_profiler.hpp"
+
+// Holds the render loop to a fixed frame rate from the CPU side. Sleeps for
+// most of the remaining time and spins the last stretch, since sleeps wake up
+// late by up to a scheduler tick. A late frame restarts the schedule rather
+// than letting the following frames run early to catch up.
+class FrameLimiter
+{
+public:
+    static constexpr std::chrono::microseconds SPIN_TIME { 1000 };
+
+    // 0 disables the limiter.
+    void setRate(uint32_t framesPerSecond)
+    {
+        period = framesPerSecond == 0
+                     ? Clock::duration::zero()
+                     : std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double>(1.0 / framesPerSecond));
+        next = Clock::now();
+    }
+
+    bool enabled() const { return period > Clock::duration::zero(); }
+
+    // Block until the next frame may start.
+    void wait()
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        CPU_ZONE("frameLimiter");
+        const Clock::time_point now = Clock::now();
+        if (next - now > SPIN_TIME)
+        {
+            std::this_thread::sleep_until(next - SPIN_TIME);
+        }
+        while (Clock::now() < next)
+        {
+        }
+        next = std::max(next, now) + period;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration period = Clock::duration::zero();
+    Clock::time_point next;
+};
@@ -0,0 +1,654 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+// How a block of device memory is carved up.
+enum class AllocationStrategy
+{
+    // Power-of-two buddy allocator, for long-lived resources of mixed size.
+    Buddy,
+    // Bump allocator that rewinds once every allocation in the block has been
+    // freed, for transient resources released together.
+    Linear
+};
+
+// Whether a resource is laid out linearly (buffers, linear images) or with an
+// implementation-defined tiling. Unless bufferImageGranularity is 1 the two
+// never share a block, so the granularity can not be violated between
+// neighbours.
+enum class ResourceTiling
+{
+    Linear,
+    Optimal
+};
+
+struct GpuMemoryStats
+{
+    uint32_t deviceMemoryCount = 0;
+    uint32_t maxMemoryAllocationCount = 0;
+    uint32_t allocationCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    // Bytes of vk::DeviceMemory owned by the allocator.
+    vk::DeviceSize reservedBytes = 0;
+    // Bytes handed out, after rounding to the strategy's granularity.
+    vk::DeviceSize allocatedBytes = 0;
+    // Bytes asked for by the callers.
+    vk::DeviceSize requestedBytes = 0;
+    vk::DeviceSize largestFreeRange = 0;
+    // 1 - largest free range / total free bytes: 0 when the free space is
+    // one contiguous range, approaching 1 as it splinters.
+    double fragmentation = 0.0;
+};
+
+class GpuAllocator;
+struct GpuMemoryBlock;
+
+// A sub-range of a vk::DeviceMemory block. Returns the range to its allocator
+// when destroyed, so it must be destroyed before the allocator.
+class GpuAllocation
+{
+public:
+    GpuAllocation() = default;
+    GpuAllocation(GpuAllocation&& other) noexcept { *this = std::move(other); }
+    GpuAllocation& operator=(GpuAllocation&& other) noexcept;
+    ~GpuAllocation() { release(); }
+
+    GpuAllocation(const GpuAllocation&) = delete;
+    GpuAllocation& operator=(const GpuAllocation&) = delete;
+
+    explicit operator bool() const { return block != nullptr; }
+
+    vk::DeviceMemory memory() const;
+    vk::DeviceSize offset() const { return rangeOffset; }
+    vk::DeviceSize size() const { return requestedSize; }
+    uint32_t memoryTypeIndex() const;
+    bool isCoherent() const;
+    // Persistent host pointer to the start of the allocation, nullptr when the
+    // memory is not host visible.
+    void* mapped() const;
+
+    void release();
+
+private:
+    friend class GpuAllocator;
+
+    GpuAllocator* allocator = nullptr;
+    GpuMemoryBlock* block = nullptr;
+    vk::DeviceSize rangeOffset = 0;
+    vk::DeviceSize rangeSize = 0;
+    vk::DeviceSize requestedSize = 0;
+    uint32_t order = 0;
+};
+
+struct GpuMemoryBlock
+{
+    vk::raii::DeviceMemory memory = nullptr;
+    vk::DeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    bool coherent = true;
+    bool dedicated = false;
+    std::byte* mapped = nullptr;
+    AllocationStrategy strategy = AllocationStrategy::Buddy;
+
+    uint32_t liveAllocations = 0;
+    vk::DeviceSize allocatedBytes = 0;
+    vk::DeviceSize requestedBytes = 0;
+
+    // Linear: next free offset.
+    vk::DeviceSize head = 0;
+    // Buddy: free offsets per order, order k holding ranges of
+    // MIN_BUDDY_SIZE << k bytes.
+    std::vector<std::set<vk::DeviceSize>> freeLists;
+};
+
+struct AllocatedBuffer
+{
+    GpuAllocation allocation;
+    vk::raii::Buffer buffer = nullptr;
+};
+
+struct AllocatedImage
+{
+    GpuAllocation allocation;
+    vk::raii::Image image = nullptr;
+};
+
+// Sub-allocates buffers and images from large vk::DeviceMemory blocks, one set
+// of blocks per memory type, tiling and strategy. Requests larger than half a
+// block get a dedicated allocation. Host-visible blocks are mapped once for
+// their whole lifetime.
+class GpuAllocator
+{
+public:
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+    static constexpr vk::DeviceSize MIN_BUDDY_SIZE = 256;
+
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device,
+              vk::DeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE)
+    {
+        this->device = &device;
+        memoryProperties = physicalDevice.getMemoryProperties();
+        const vk::PhysicalDeviceLimits limits =
+            physicalDevice.getProperties().limits;
+        nonCoherentAtomSize = limits.nonCoherentAtomSize;
+        bufferImageGranularity = limits.bufferImageGranularity;
+        maxMemoryAllocationCount = limits.maxMemoryAllocationCount;
+        blockSize = std::bit_floor(preferredBlockSize);
+    }
+
+    AllocatedBuffer createBuffer(const vk::BufferCreateInfo& createInfo,
+                                 vk::MemoryPropertyFlags required,
+                                 vk::MemoryPropertyFlags preferred = {},
+                                 AllocationStrategy strategy =
+                                     AllocationStrategy::Buddy)
+    {
+        AllocatedBuffer result;
+        result.buffer = vk::raii::Buffer(*device, createInfo);
+        result.allocation =
+            allocate(result.buffer.getMemoryRequirements(), required,
+                     preferred, ResourceTiling::Linear, strategy);
+        result.buffer.bindMemory(result.allocation.memory(),
+                                 result.allocation.offset());
+        return result;
+    }
+
+    AllocatedImage createImage(const vk::ImageCreateInfo& createInfo,
+                               vk::MemoryPropertyFlags required,
+                               vk::MemoryPropertyFlags preferred = {},
+                               AllocationStrategy strategy =
+                                   AllocationStrategy::Buddy)
+    {
+        AllocatedImage result;
+        result.image = vk::raii::Image(*device, createInfo);
+        result.allocation = allocate(
+            result.image.getMemoryRequirements(), required, preferred,
+            createInfo.tiling == vk::ImageTiling::eLinear
+                ? ResourceTiling::Linear
+                : ResourceTiling::Optimal,
+            strategy);
+        result.image.bindMemory(result.allocation.memory(),
+                                result.allocation.offset());
+        return result;
+    }
+
+    GpuAllocation allocate(const vk::MemoryRequirements& requirements,
+                           vk::MemoryPropertyFlags required,
+                           vk::MemoryPropertyFlags preferred,
+                           ResourceTiling tiling, AllocationStrategy strategy)
+    {
+        std::scoped_lock lock(mutex);
+
+        // Without a granularity constraint linear and optimal resources may
+        // be neighbours, so they share blocks.
+        if (bufferImageGranularity <= 1)
+        {
+            tiling = ResourceTiling::Linear;
+        }
+
+        // Try the types that have every preferred property first, then any
+        // type that merely satisfies the requirement.
+        for (bool withPreferred : { true, false })
+        {
+            if (!withPreferred && !preferred)
+            {
+                break;
+            }
+            const vk::MemoryPropertyFlags flags =
+                withPreferred ? required | preferred : required;
+            for (uint32_t type = 0; type < memoryProperties.memoryTypeCount;
+                 type++)
+            {
+                if (!(requirements.memoryTypeBits & (1u << type)) ||
+                    (memoryProperties.memoryTypes[type].propertyFlags &
+                     flags) != flags)
+                {
+                    continue;
+                }
+                GpuAllocation allocation =
+                    allocateFromType(type, requirements, tiling, strategy);
+                if (allocation)
+                {
+                    return allocation;
+                }
+            }
+        }
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    // Flush host writes to non-coherent memory. Offsets are relative to the
+    // allocation and widened to nonCoherentAtomSize, which the allocation's
+    // placement guarantees stays inside memory it owns.
+    void flush(const GpuAllocation& allocation, vk::DeviceSize offset = 0,
+               vk::DeviceSize size = vk::WholeSize) const
+    {
+        if (allocation.isCoherent())
+        {
+            return;
+        }
+        device->flushMappedMemoryRanges(
+            mappedRange(allocation, offset, size));
+    }
+
+    // Make device writes to non-coherent memory visible to the host.
+    void invalidate(const GpuAllocation& allocation,
+                    vk::DeviceSize offset = 0,
+                    vk::DeviceSize size = vk::WholeSize) const
+    {
+        if (allocation.isCoherent())
+        {
+            return;
+        }
+        device->invalidateMappedMemoryRanges(
+            mappedRange(allocation, offset, size));
+    }
+
+    GpuMemoryStats stats() const
+    {
+        std::scoped_lock lock(mutex);
+
+        GpuMemoryStats result { .maxMemoryAllocationCount =
+                                    maxMemoryAllocationCount };
+        vk::DeviceSize freeBytes = 0;
+        for (const auto& [key, blocks] : pools)
+        {
+            for (const auto& block : blocks)
+            {
+                result.deviceMemoryCount++;
+                result.dedicatedAllocationCount += block->dedicated ? 1 : 0;
+                result.allocationCount += block->liveAllocations;
+                result.reservedBytes += block->size;
+                result.allocatedBytes += block->allocatedBytes;
+                result.requestedBytes += block->requestedBytes;
+                freeBytes += block->size - block->allocatedBytes;
+                result.largestFreeRange = std::max(result.largestFreeRange,
+                                                   largestFreeRange(*block));
+            }
+        }
+        if (freeBytes > 0)
+        {
+            result.fragmentation =
+                1.0 - static_cast<double>(result.largestFreeRange) /
+                          static_cast<double>(freeBytes);
+        }
+        return result;
+    }
+
+    void report(std::ostream& out) const
+    {
+        const GpuMemoryStats s = stats();
+        constexpr double MiB = 1024.0 * 1024.0;
+        out << "gpu memory: " << s.allocationCount << " allocations in "
+            << s.deviceMemoryCount << " device allocations ("
+            << s.dedicatedAllocationCount << " dedicated, limit "
+            << s.maxMemoryAllocationCount << "), "
+            << static_cast<double>(s.requestedBytes) / MiB << " MiB used of "
+            << static_cast<double>(s.reservedBytes) / MiB
+            << " MiB reserved, fragmentation " << s.fragmentation
+            << std::endl;
+    }
+
+private:
+    friend class GpuAllocation;
+
+    using PoolKey = std::tuple<uint32_t, ResourceTiling, AllocationStrategy>;
+
+    const vk::raii::Device* device = nullptr;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    vk::DeviceSize nonCoherentAtomSize = 1;
+    vk::DeviceSize bufferImageGranularity = 1;
+    uint32_t maxMemoryAllocationCount = 0;
+    vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+
+    mutable std::mutex mutex;
+    std::map<PoolKey, std::vector<std::unique_ptr<GpuMemoryBlock>>> pools;
+
+    static vk::DeviceSize alignUp(vk::DeviceSize value,
+                                  vk::DeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool isHostVisible(uint32_t type) const
+    {
+        return !!(memoryProperties.memoryTypes[type].propertyFlags &
+                  vk::MemoryPropertyFlagBits::eHostVisible);
+    }
+
+    bool isCoherent(uint32_t type) const
+    {
+        return !isHostVisible(type) ||
+               !!(memoryProperties.memoryTypes[type].propertyFlags &
+                  vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    vk::DeviceSize blockSizeFor(uint32_t type) const
+    {
+        // Keep blocks small relative to their heap, so a small heap (e.g. a
+        // 256 MiB BAR) is not exhausted by a handful of blocks.
+        const vk::DeviceSize heapSize =
+            memoryProperties
+                .memoryHeaps[memoryProperties.memoryTypes[type].heapIndex]
+                .size;
+        return std::max(MIN_BUDDY_SIZE,
+                        std::min(blockSize, std::bit_floor(heapSize / 8)));
+    }
+
+    GpuAllocation allocateFromType(uint32_t type,
+                                   vk::MemoryRequirements requirements,
+                                   ResourceTiling tiling,
+                                   AllocationStrategy strategy)
+    {
+        // Non-coherent ranges are flushed in whole atoms, so an allocation
+        // must not share an atom with its neighbour.
+        if (!isCoherent(type))
+        {
+            requirements.alignment =
+                std::max(requirements.alignment, nonCoherentAtomSize);
+            requirements.size =
+                alignUp(requirements.size, nonCoherentAtomSize);
+        }
+
+        const vk::DeviceSize typeBlockSize = blockSizeFor(type);
+        auto& blocks = pools[PoolKey { type, tiling, strategy }];
+
+        if (requirements.size > typeBlockSize / 2)
+        {
+            GpuMemoryBlock* block =
+                createBlock(blocks, type, requirements.size, strategy, true);
+            if (block == nullptr)
+            {
+                return {};
+            }
+            return takeRange(*block, 0, requirements.size, requirements.size,
+                             0);
+        }
+
+        for (auto& block : blocks)
+        {
+            if (GpuAllocation allocation = allocateFromBlock(*block,
+                                                             requirements))
+            {
+                return allocation;
+            }
+        }
+
+        GpuMemoryBlock* block =
+            createBlock(blocks, type, typeBlockSize, strategy, false);
+        if (block == nullptr)
+        {
+            return {};
+        }
+        return allocateFromBlock(*block, requirements);
+    }
+
+    GpuMemoryBlock*
+    createBlock(std::vector<std::unique_ptr<GpuMemoryBlock>>& blocks,
+                uint32_t type, vk::DeviceSize size,
+                AllocationStrategy strategy, bool dedicated)
+    {
+        auto block = std::make_unique<GpuMemoryBlock>();
+        try
+        {
+            block->memory = vk::raii::DeviceMemory(
+                *device,
+                vk::MemoryAllocateInfo { .allocationSize = size,
+                                         .memoryTypeIndex = type });
+        }
+        catch (const vk::OutOfDeviceMemoryError&)
+        {
+            return nullptr;
+        }
+        catch (const vk::OutOfHostMemoryError&)
+        {
+            return nullptr;
+        }
+
+        block->size = size;
+        block->memoryTypeIndex = type;
+        block->coherent = isCoherent(type);
+        block->strategy = strategy;
+        block->dedicated = dedicated;
+        if (isHostVisible(type))
+        {
+            block->mapped = static_cast<std::byte*>(
+                block->memory.mapMemory(0, vk::WholeSize));
+        }
+        if (strategy == AllocationStrategy::Buddy && !dedicated)
+        {
+            const auto orders = static_cast<uint32_t>(
+                std::countr_zero(size / MIN_BUDDY_SIZE) + 1);
+            block->freeLists.resize(orders);
+            block->freeLists.back().insert(0);
+        }
+        return blocks.emplace_back(std::move(block)).get();
+    }
+
+    GpuAllocation allocateFromBlock(GpuMemoryBlock& block,
+                                    const vk::MemoryRequirements& requirements)
+    {
+        if (block.dedicated)
+        {
+            return {};
+        }
+
+        if (block.strategy == AllocationStrategy::Linear)
+        {
+            const vk::DeviceSize offset =
+                alignUp(block.head, requirements.alignment);
+            if (offset + requirements.size > block.size)
+            {
+                return {};
+            }
+            block.head = offset + requirements.size;
+            return takeRange(block, offset, requirements.size,
+                             requirements.size, 0);
+        }
+
+        // Buddy ranges are aligned to their own size, so the smallest order
+        // covering both size and alignment satisfies the request.
+        const vk::DeviceSize needed = std::bit_ceil(std::max(
+            { requirements.size, requirements.alignment, MIN_BUDDY_SIZE }));
+        const auto wantedOrder =
+            static_cast<uint32_t>(std::countr_zero(needed / MIN_BUDDY_SIZE));
+        uint32_t order = wantedOrder;
+        while (order < block.freeLists.size() && block.freeLists[order].empty())
+        {
+            order++;
+        }
+        if (order >= block.freeLists.size())
+        {
+            return {};
+        }
+
+        const vk::DeviceSize offset = *block.freeLists[order].begin();
+        block.freeLists[order].erase(block.freeLists[order].begin());
+        // Split down to the wanted order, keeping the lower half each time.
+        while (order > wantedOrder)
+        {
+            order--;
+            block.freeLists[order].insert(offset + (MIN_BUDDY_SIZE << order));
+        }
+        return takeRange(block, offset, needed, requirements.size,
+                         wantedOrder);
+    }
+
+    GpuAllocation takeRange(GpuMemoryBlock& block, vk::DeviceSize offset,
+                            vk::DeviceSize rangeSize,
+                            vk::DeviceSize requestedSize, uint32_t order)
+    {
+        block.liveAllocations++;
+        block.allocatedBytes += rangeSize;
+        block.requestedBytes += requestedSize;
+
+        GpuAllocation allocation;
+        allocation.allocator = this;
+        allocation.block = &block;
+        allocation.rangeOffset = offset;
+        allocation.rangeSize = rangeSize;
+        allocation.requestedSize = requestedSize;
+        allocation.order = order;
+        return allocation;
+    }
+
+    void free(GpuAllocation& allocation)
+    {
+        std::scoped_lock lock(mutex);
+
+        GpuMemoryBlock& block = *allocation.block;
+        block.liveAllocations--;
+        block.allocatedBytes -= allocation.rangeSize;
+        block.requestedBytes -= allocation.requestedSize;
+
+        if (block.strategy == AllocationStrategy::Linear)
+        {
+            if (block.liveAllocations == 0)
+            {
+                block.head = 0;
+            }
+        }
+        else if (!block.dedicated)
+        {
+            // Merge with the buddy for as long as it is free too.
+            vk::DeviceSize offset = allocation.rangeOffset;
+            uint32_t order = allocation.order;
+            while (order + 1 < block.freeLists.size())
+            {
+                const vk::DeviceSize buddy =
+                    offset ^ (MIN_BUDDY_SIZE << order);
+                auto it = block.freeLists[order].find(buddy);
+                if (it == block.freeLists[order].end())
+                {
+                    break;
+                }
+                block.freeLists[order].erase(it);
+                offset = std::min(offset, buddy);
+                order++;
+            }
+            block.freeLists[order].insert(offset);
+        }
+
+        if (block.liveAllocations == 0)
+        {
+            releaseEmptyBlock(block);
+        }
+    }
+
+    // Dedicated blocks are returned right away. Of the shared blocks, one
+    // empty block per pool is kept to avoid reallocating on churn.
+    void releaseEmptyBlock(GpuMemoryBlock& block)
+    {
+        for (auto& [key, blocks] : pools)
+        {
+            auto it = std::ranges::find_if(
+                blocks, [&](const auto& b) { return b.get() == &block; });
+            if (it == blocks.end())
+            {
+                continue;
+            }
+            const bool anotherEmpty = std::ranges::any_of(
+                blocks,
+                [&](const auto& b)
+                { return b.get() != &block && b->liveAllocations == 0; });
+            if (block.dedicated || anotherEmpty)
+            {
+                blocks.erase(it);
+            }
+            return;
+        }
+    }
+
+    static vk::DeviceSize largestFreeRange(const GpuMemoryBlock& block)
+    {
+        if (block.dedicated)
+        {
+            return 0;
+        }
+        if (block.strategy == AllocationStrategy::Linear)
+        {
+            return block.size - block.head;
+        }
+        for (size_t order = block.freeLists.size(); order-- > 0;)
+        {
+            if (!block.freeLists[order].empty())
+            {
+                return MIN_BUDDY_SIZE << order;
+            }
+        }
+        return 0;
+    }
+
+    vk::MappedMemoryRange mappedRange(const GpuAllocation& allocation,
+                                      vk::DeviceSize offset,
+                                      vk::DeviceSize size) const
+    {
+        if (size == vk::WholeSize)
+        {
+            size = allocation.requestedSize - offset;
+        }
+        const vk::DeviceSize begin = allocation.rangeOffset + offset;
+        const vk::DeviceSize alignedBegin =
+            begin / nonCoherentAtomSize * nonCoherentAtomSize;
+        const vk::DeviceSize alignedEnd =
+            std::min(alignUp(begin + size, nonCoherentAtomSize),
+                     allocation.block->size);
+        return vk::MappedMemoryRange { .memory = *allocation.block->memory,
+                                       .offset = alignedBegin,
+                                       .size = alignedEnd - alignedBegin };
+    }
+};
+
+inline GpuAllocation& GpuAllocation::operator=(GpuAllocation&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        allocator = std::exchange(other.allocator, nullptr);
+        block = std::exchange(other.block, nullptr);
+        rangeOffset = other.rangeOffset;
+        rangeSize = other.rangeSize;
+        requestedSize = other.requestedSize;
+        order = other.order;
+    }
+    return *this;
+}
+
+inline vk::DeviceMemory GpuAllocation::memory() const
+{
+    return *block->memory;
+}
+
+inline uint32_t GpuAllocation::memoryTypeIndex() const
+{
+    return block->memoryTypeIndex;
+}
+
+inline bool GpuAllocation::isCoherent() const { return block->coherent; }
+
+inline void* GpuAllocation::mapped() const
+{
+    return block->mapped != nullptr ? block->mapped + rangeOffset : nullptr;
+}
+
+inline void GpuAllocation::release()
+{
+    if (block != nullptr)
+    {
+        allocator->free(*this);
+        allocator = nullptr;
+        block = nullptr;
+    }
+}
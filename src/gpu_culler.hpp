@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "descriptor_heap.hpp"
+#include "gpu_allocator.hpp"
+#include "pipeline_cache.hpp"
+
+// Frustum culls instances in a compute pass and draws the survivors with
+// drawIndexedIndirectCount, so the CPU records the same few commands however
+// many objects there are. Each visible object gets one indirect command whose
+// firstInstance selects its per-instance attributes. The number of visible
+// objects is copied into a per-frame readback buffer and read once the
+// frame's fence has signaled.
+class GpuCuller
+{
+public:
+    // Must match [numthreads] of cullMain in cull.slang.
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    // Must match CullConstants in cull.slang.
+    struct PushConstants
+    {
+        uint32_t objectCount = 0;
+        uint32_t indexCount = 0;
+        float viewScale = 1.0f;
+        // Radius of the unscaled mesh around its origin.
+        float boundingRadius = 0.0f;
+        // Storage buffer indices in the descriptor heap.
+        uint32_t instanceIndex = 0;
+        uint32_t staticIndex = 0;
+        uint32_t drawCommandsIndex = 0;
+        uint32_t drawCountIndex = 0;
+    };
+
+    // instanceBuffers hold [x | y | rotation] for each frame in flight and
+    // staticBuffer [scale | color], objectCount floats per stream.
+    void init(const vk::raii::Device& device, GpuAllocator& allocator,
+              DescriptorHeap& heap,
+              PersistentPipelineCache& pipelineCache,
+              const vk::raii::ShaderModule& shaderModule,
+              uint32_t objectCount, uint32_t maxDrawIndirectCount,
+              const std::vector<AllocatedBuffer>& instanceBuffers,
+              const AllocatedBuffer& staticBuffer)
+    {
+        this->allocator = &allocator;
+        this->heap = &heap;
+        constants.objectCount = objectCount;
+        maxDrawCount = std::min(objectCount, maxDrawIndirectCount);
+        const uint32_t framesInFlight =
+            static_cast<uint32_t>(instanceBuffers.size());
+
+        drawCommands = allocator.createBuffer(
+            vk::BufferCreateInfo {
+                .size = sizeof(vk::DrawIndexedIndirectCommand) * objectCount,
+                .usage = vk::BufferUsageFlagBits::eStorageBuffer |
+                         vk::BufferUsageFlagBits::eIndirectBuffer,
+                .sharingMode = vk::SharingMode::eExclusive },
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        drawCount = allocator.createBuffer(
+            vk::BufferCreateInfo {
+                .size = sizeof(uint32_t),
+                .usage = vk::BufferUsageFlagBits::eStorageBuffer |
+                         vk::BufferUsageFlagBits::eIndirectBuffer |
+                         vk::BufferUsageFlagBits::eTransferSrc |
+                         vk::BufferUsageFlagBits::eTransferDst,
+                .sharingMode = vk::SharingMode::eExclusive },
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        readbacks.clear();
+        for (uint32_t i = 0; i < framesInFlight; i++)
+        {
+            readbacks.push_back(allocator.createBuffer(
+                vk::BufferCreateInfo {
+                    .size = sizeof(uint32_t),
+                    .usage = vk::BufferUsageFlagBits::eTransferDst,
+                    .sharingMode = vk::SharingMode::eExclusive },
+                vk::MemoryPropertyFlagBits::eHostVisible,
+                vk::MemoryPropertyFlagBits::eHostCached));
+            // nothing culled until the slot's first frame lands
+            *static_cast<uint32_t*>(readbacks.back().allocation.mapped()) =
+                objectCount;
+            allocator.flush(readbacks.back().allocation);
+        }
+
+        // Every buffer is addressed through the descriptor heap, so the
+        // pass binds no sets of its own and only swaps an index per frame.
+        instanceHandles.clear();
+        for (const AllocatedBuffer& instanceBuffer : instanceBuffers)
+        {
+            instanceHandles.push_back(
+                heap.addStorageBuffer(*instanceBuffer.buffer));
+        }
+        staticHandle = heap.addStorageBuffer(*staticBuffer.buffer);
+        drawCommandsHandle = heap.addStorageBuffer(*drawCommands.buffer);
+        drawCountHandle = heap.addStorageBuffer(*drawCount.buffer);
+        constants.staticIndex = staticHandle.get();
+        constants.drawCommandsIndex = drawCommandsHandle.get();
+        constants.drawCountIndex = drawCountHandle.get();
+
+        vk::PushConstantRange pushConstantRange {
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            .offset = 0,
+            .size = sizeof(PushConstants)
+        };
+        pipelineLayout = vk::raii::PipelineLayout(
+            device,
+            vk::PipelineLayoutCreateInfo {
+                .setLayoutCount = 1,
+                .pSetLayouts = &*heap.layout(),
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &pushConstantRange });
+
+        vk::PipelineCreationFeedback feedback;
+        vk::PipelineCreationFeedbackCreateInfo feedbackInfo {
+            .pPipelineCreationFeedback = &feedback
+        };
+        pipeline = vk::raii::Pipeline(
+            device,
+            pipelineCache.get(),
+            vk::ComputePipelineCreateInfo {
+                .pNext = &feedbackInfo,
+                .stage = { .stage = vk::ShaderStageFlagBits::eCompute,
+                           .module = shaderModule,
+                           .pName = "cullMain" },
+                .layout = pipelineLayout });
+        pipelineCache.recordFeedback("cull pipeline", feedback);
+    }
+
+    // Reset the visible count. Must be outside of rendering; the render
+    // graph orders it after the previous frame's reads of drawCountBuffer().
+    void recordClear(const vk::raii::CommandBuffer& commandBuffer) const
+    {
+        commandBuffer.fillBuffer(*drawCount.buffer, 0, sizeof(uint32_t), 0);
+    }
+
+    // Record the culling dispatch, which writes drawCommandBuffer() and
+    // drawCountBuffer(). Must be outside of rendering and after recordClear.
+    void recordCull(const vk::raii::CommandBuffer& commandBuffer,
+                    uint32_t frameIndex, uint32_t indexCount, float viewScale,
+                    float boundingRadius)
+    {
+        constants.indexCount = indexCount;
+        constants.viewScale = viewScale;
+        constants.boundingRadius = boundingRadius;
+        constants.instanceIndex = instanceHandles[frameIndex].get();
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        heap->bind(commandBuffer, vk::PipelineBindPoint::eCompute,
+                   *pipelineLayout);
+        commandBuffer.pushConstants<PushConstants>(
+            pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+        commandBuffer.dispatch(
+            (constants.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+            1,
+            1);
+    }
+
+    // Draw the visible objects. The index and vertex buffers must be bound.
+    void recordDraw(const vk::raii::CommandBuffer& commandBuffer) const
+    {
+        commandBuffer.drawIndexedIndirectCount(
+            *drawCommands.buffer,
+            0,
+            *drawCount.buffer,
+            0,
+            maxDrawCount,
+            sizeof(vk::DrawIndexedIndirectCommand));
+    }
+
+    // Copy the visible count to readbackBuffer(frameIndex). Must be outside
+    // of rendering and after recordCull.
+    void recordReadback(const vk::raii::CommandBuffer& commandBuffer,
+                        uint32_t frameIndex) const
+    {
+        commandBuffer.copyBuffer(
+            *drawCount.buffer,
+            *readbacks[frameIndex].buffer,
+            vk::BufferCopy { .size = sizeof(uint32_t) });
+    }
+
+    // The buffers each record function touches, for declaring the passes in
+    // the render graph, which places every barrier between them.
+    vk::Buffer drawCommandBuffer() const { return *drawCommands.buffer; }
+    vk::Buffer drawCountBuffer() const { return *drawCount.buffer; }
+    vk::Buffer readbackBuffer(uint32_t frameIndex) const
+    {
+        return *readbacks[frameIndex].buffer;
+    }
+
+    // Objects culled by the frame's last submission. Call once its fence has
+    // signaled.
+    uint32_t collect(uint32_t frameIndex)
+    {
+        const GpuAllocation& readback = readbacks[frameIndex].allocation;
+        allocator->invalidate(readback);
+        const uint32_t visible = *static_cast<const uint32_t*>(readback.mapped());
+        lastCulled = constants.objectCount - std::min(visible,
+                                                      constants.objectCount);
+        return lastCulled;
+    }
+
+    uint32_t culledCount() const { return lastCulled; }
+
+private:
+    GpuAllocator* allocator = nullptr;
+    const DescriptorHeap* heap = nullptr;
+    PushConstants constants;
+    uint32_t maxDrawCount = 0;
+    uint32_t lastCulled = 0;
+
+    AllocatedBuffer drawCommands;
+    AllocatedBuffer drawCount;
+    std::vector<AllocatedBuffer> readbacks;
+
+    DescriptorHeap::Handle staticHandle;
+    DescriptorHeap::Handle drawCommandsHandle;
+    DescriptorHeap::Handle drawCountHandle;
+    std::vector<DescriptorHeap::Handle> instanceHandles;
+    vk::raii::PipelineLayout pipelineLayout = nullptr;
+    vk::raii::Pipeline pipeline = nullptr;
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+// Timestamp queries for labelled scopes of GPU work. Each frame in flight owns
+// a slot of the query pool; a slot is reset when its frame starts recording
+// and read back once the frame's fence has signaled, so reading never stalls.
+// Durations feed a rolling window per label.
+class GpuTimer
+{
+public:
+    static constexpr uint32_t MAX_SCOPES_PER_FRAME = 32;
+    static constexpr size_t HISTORY_SIZE = 512;
+
+    struct ScopeStats
+    {
+        std::string label;
+        size_t samples = 0;
+        double minMs = 0.0;
+        double meanMs = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device, uint32_t queueFamilyIndex,
+              uint32_t framesInFlight)
+    {
+        const uint32_t validBits =
+            physicalDevice.getQueueFamilyProperties()[queueFamilyIndex]
+                .timestampValidBits;
+        if (validBits == 0)
+        {
+            std::cout << "gpu timer: queue family " << queueFamilyIndex
+                      << " does not support timestamps" << std::endl;
+            return;
+        }
+        validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+
+        vk::QueryPoolCreateInfo poolInfo {
+            .queryType = vk::QueryType::eTimestamp,
+            .queryCount = framesInFlight * QUERIES_PER_FRAME
+        };
+        queryPool = vk::raii::QueryPool(device, poolInfo);
+        frames.assign(framesInFlight, {});
+    }
+
+    bool supported() const { return !!*queryPool; }
+
+    // Reset the frame's query slot. Must be recorded outside of rendering,
+    // before any scope of the frame.
+    void beginFrame(const vk::raii::CommandBuffer& commandBuffer,
+                    uint32_t frameIndex)
+    {
+        recordingFrame = frameIndex;
+        if (!supported())
+        {
+            return;
+        }
+        frames[frameIndex].scopeCount = 0;
+        commandBuffer.resetQueryPool(
+            *queryPool, frameIndex * QUERIES_PER_FRAME, QUERIES_PER_FRAME);
+    }
+
+    // Returns a handle for endScope. label must outlive the timer, string
+    // literals are expected.
+    uint32_t beginScope(const vk::raii::CommandBuffer& commandBuffer,
+                        const char* label,
+                        vk::PipelineStageFlags2 stage =
+                            vk::PipelineStageFlagBits2::eTopOfPipe)
+    {
+        if (!supported())
+        {
+            return NO_SCOPE;
+        }
+        FrameSlot& frame = frames[recordingFrame];
+        if (frame.scopeCount == MAX_SCOPES_PER_FRAME)
+        {
+            return NO_SCOPE;
+        }
+        const uint32_t scope = frame.scopeCount++;
+        frame.labels[scope] = label;
+        commandBuffer.writeTimestamp2(stage, *queryPool,
+                                      queryIndex(recordingFrame, scope));
+        return scope;
+    }
+
+    void endScope(const vk::raii::CommandBuffer& commandBuffer, uint32_t scope,
+                  vk::PipelineStageFlags2 stage =
+                      vk::PipelineStageFlagBits2::eBottomOfPipe)
+    {
+        if (scope == NO_SCOPE)
+        {
+            return;
+        }
+        commandBuffer.writeTimestamp2(stage, *queryPool,
+                                      queryIndex(recordingFrame, scope) + 1);
+    }
+
+    // Read back the scopes of a frame whose fence has signaled.
+    void collect(uint32_t frameIndex)
+    {
+        if (!supported())
+        {
+            return;
+        }
+        collections++;
+        FrameSlot& frame = frames[frameIndex];
+        if (frame.scopeCount == 0)
+        {
+            return;
+        }
+
+        const uint32_t queryCount = frame.scopeCount * 2;
+        // Each query is followed by its availability word, so a scope that
+        // was never executed is skipped rather than waited for.
+        const std::vector<uint64_t> data = queryPool.getResults<uint64_t>(
+            frameIndex * QUERIES_PER_FRAME,
+            queryCount,
+            queryCount * 2 * sizeof(uint64_t),
+            2 * sizeof(uint64_t),
+            vk::QueryResultFlagBits::e64 |
+                vk::QueryResultFlagBits::eWithAvailability).second;
+        for (uint32_t scope = 0; scope < frame.scopeCount; scope++)
+        {
+            const uint64_t* begin = &data[scope * 4];
+            const uint64_t* end = &data[scope * 4 + 2];
+            if (begin[1] == 0 || end[1] == 0)
+            {
+                continue;
+            }
+            const uint64_t ticks = (end[0] - begin[0]) & validMask;
+            const double ms =
+                static_cast<double>(ticks) * timestampPeriod / 1.0e6;
+            Series& s = seriesFor(frame.labels[scope]);
+            s.push(ms);
+            s.collection = collections;
+        }
+        frame.scopeCount = 0;
+    }
+
+    ScopeStats stats(const char* label) const
+    {
+        for (const Series& s : series)
+        {
+            if (std::strcmp(s.label, label) == 0)
+            {
+                return s.stats();
+            }
+        }
+        return ScopeStats { .label = label };
+    }
+
+    // Duration of label in the frame collected last, negative when that
+    // frame did not time it.
+    double lastMs(const char* label) const
+    {
+        for (const Series& s : series)
+        {
+            if (std::strcmp(s.label, label) == 0 && s.collection != 0 &&
+                s.collection == collections)
+            {
+                return s.samples[(s.next + HISTORY_SIZE - 1) % HISTORY_SIZE];
+            }
+        }
+        return -1.0;
+    }
+
+    std::vector<ScopeStats> allStats() const
+    {
+        std::vector<ScopeStats> all;
+        for (const Series& s : series)
+        {
+            all.push_back(s.stats());
+        }
+        return all;
+    }
+
+    void report(std::ostream& out) const
+    {
+        for (const ScopeStats& s : allStats())
+        {
+            out << "gpu " << s.label << ": min " << s.minMs << " ms, mean "
+                << s.meanMs << " ms, p99 " << s.p99Ms << " ms ("
+                << s.samples << " samples)" << std::endl;
+        }
+    }
+
+private:
+    static constexpr uint32_t QUERIES_PER_FRAME = MAX_SCOPES_PER_FRAME * 2;
+    static constexpr uint32_t NO_SCOPE = ~0u;
+
+    struct FrameSlot
+    {
+        uint32_t scopeCount = 0;
+        const char* labels[MAX_SCOPES_PER_FRAME] = {};
+    };
+
+    struct Series
+    {
+        const char* label = nullptr;
+        std::vector<double> samples;
+        size_t next = 0;
+        // Value of collections when the last sample was pushed.
+        uint64_t collection = 0;
+
+        void push(double ms)
+        {
+            if (samples.size() < HISTORY_SIZE)
+            {
+                samples.push_back(ms);
+            }
+            else
+            {
+                samples[next] = ms;
+            }
+            next = (next + 1) % HISTORY_SIZE;
+        }
+
+        ScopeStats stats() const
+        {
+            ScopeStats result { .label = label, .samples = samples.size() };
+            if (samples.empty())
+            {
+                return result;
+            }
+            std::vector<double> sorted = samples;
+            std::ranges::sort(sorted);
+            double sum = 0.0;
+            for (double ms : sorted)
+            {
+                sum += ms;
+            }
+            result.minMs = sorted.front();
+            result.maxMs = sorted.back();
+            result.meanMs = sum / static_cast<double>(sorted.size());
+            result.p99Ms = sorted[(sorted.size() - 1) * 99 / 100];
+            return result;
+        }
+    };
+
+    vk::raii::QueryPool queryPool = nullptr;
+    std::vector<FrameSlot> frames;
+    std::vector<Series> series;
+    uint32_t recordingFrame = 0;
+    // Frames read back so far.
+    uint64_t collections = 0;
+    uint64_t validMask = ~0ull;
+    float timestampPeriod = 1.0f;
+
+    static uint32_t queryIndex(uint32_t frameIndex, uint32_t scope)
+    {
+        return frameIndex * QUERIES_PER_FRAME + scope * 2;
+    }
+
+    Series& seriesFor(const char* label)
+    {
+        for (Series& s : series)
+        {
+            if (s.label == label || std::strcmp(s.label, label) == 0)
+            {
+                return s;
+            }
+        }
+        Series& s = series.emplace_back();
+        s.label = label;
+        s.samples.reserve(HISTORY_SIZE);
+        return s;
+    }
+};
+
+// Times the commands recorded during its lifetime.
+class GpuScope
+{
+public:
+    GpuScope(GpuTimer& timer, const vk::raii::CommandBuffer& commandBuffer,
+             const char* label)
+        : timer(timer), commandBuffer(commandBuffer),
+          scope(timer.beginScope(commandBuffer, label))
+    {
+    }
+
+    ~GpuScope() { timer.endScope(commandBuffer, scope); }
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    GpuTimer& timer;
+    const vk::raii::CommandBuffer& commandBuffer;
+    uint32_t scope;
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Encoders for 8-bit RGBA or BGRA pixels read back from the GPU, rows packed
+// with no padding. Both are lossless with respect to what they store and need
+// no third-party libraries.
+class ImageEncoder
+{
+public:
+    // RGB PNG with the alpha channel dropped. The zlib stream uses stored
+    // blocks: encoding is a copy plus two checksums, which keeps up with
+    // frame rates at the cost of file size.
+    static std::vector<std::byte> png(const std::byte* pixels, uint32_t width,
+                                      uint32_t height, bool bgra)
+    {
+        // Filter type 0 before every row.
+        const size_t rowBytes = 1 + 3 * static_cast<size_t>(width);
+        std::vector<uint8_t> raw(rowBytes * height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t* out = raw.data() + y * rowBytes;
+            *out++ = 0;
+            const auto* in = reinterpret_cast<const uint8_t*>(pixels) +
+                             static_cast<size_t>(y) * width * 4;
+            toRgb(in, out, width, bgra);
+        }
+
+        std::vector<std::byte> file;
+        file.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 128);
+        static constexpr uint8_t SIGNATURE[] = { 0x89, 'P',  'N',  'G',
+                                                 '\r', '\n', 0x1a, '\n' };
+        append(file, SIGNATURE, sizeof(SIGNATURE));
+
+        uint8_t header[13] = {};
+        storeBigEndian(header, width);
+        storeBigEndian(header + 4, height);
+        header[8] = 8; // bit depth
+        header[9] = 2; // truecolor
+        writeChunk(file, "IHDR", header, sizeof(header));
+
+        std::vector<uint8_t> zlib;
+        zlib.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+        // deflate with a 32 KiB window, no preset dictionary
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        size_t offset = 0;
+        do
+        {
+            const size_t length =
+                std::min(raw.size() - offset, MAX_STORED_BLOCK);
+            const bool last = offset + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(length));
+            zlib.push_back(static_cast<uint8_t>(length >> 8));
+            zlib.push_back(static_cast<uint8_t>(~length));
+            zlib.push_back(static_cast<uint8_t>(~length >> 8));
+            zlib.insert(zlib.end(),
+                        raw.begin() + static_cast<ptrdiff_t>(offset),
+                        raw.begin() + static_cast<ptrdiff_t>(offset + length));
+            offset += length;
+        } while (offset < raw.size());
+        uint8_t checksum[4];
+        storeBigEndian(checksum, adler32(raw.data(), raw.size()));
+        zlib.insert(zlib.end(), checksum, checksum + 4);
+        writeChunk(file, "IDAT", zlib.data(), zlib.size());
+        writeChunk(file, "IEND", nullptr, 0);
+        return file;
+    }
+
+    // Stream header of a YUV4MPEG2 video with full-resolution chroma.
+    static std::string y4mHeader(uint32_t width, uint32_t height,
+                                 uint32_t framesPerSecond)
+    {
+        return "YUV4MPEG2 W" + std::to_string(width) + " H" +
+               std::to_string(height) + " F" +
+               std::to_string(framesPerSecond) + ":1 Ip A1:1 C444\n";
+    }
+
+    // One YUV4MPEG2 frame: Y, Cb and Cr planes, BT.601 limited range.
+    static std::vector<std::byte> y4mFrame(const std::byte* pixels,
+                                           uint32_t width, uint32_t height,
+                                           bool bgra)
+    {
+        static constexpr char MARKER[] = "FRAME\n";
+        const size_t planeSize = static_cast<size_t>(width) * height;
+        std::vector<std::byte> frame(sizeof(MARKER) - 1 + 3 * planeSize);
+        std::memcpy(frame.data(), MARKER, sizeof(MARKER) - 1);
+        auto* luma = reinterpret_cast<uint8_t*>(frame.data()) +
+                     (sizeof(MARKER) - 1);
+        uint8_t* blue = luma + planeSize;
+        uint8_t* red = blue + planeSize;
+        const auto* in = reinterpret_cast<const uint8_t*>(pixels);
+        const int r = bgra ? 2 : 0;
+        const int b = bgra ? 0 : 2;
+        for (size_t i = 0; i < planeSize; i++, in += 4)
+        {
+            const int R = in[r];
+            const int G = in[1];
+            const int B = in[b];
+            luma[i] = static_cast<uint8_t>(
+                ((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+            blue[i] = static_cast<uint8_t>(
+                ((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128);
+            red[i] = static_cast<uint8_t>(
+                ((112 * R - 94 * G - 18 * B + 128) >> 8) + 128);
+        }
+        return frame;
+    }
+
+    static uint32_t crc32(const uint8_t* data, size_t size,
+                          uint32_t crc = 0xffffffffu)
+    {
+        static const std::array<uint32_t, 256> table = []
+        {
+            std::array<uint32_t, 256> result {};
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                result[n] = c;
+            }
+            return result;
+        }();
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    static uint32_t adler32(const uint8_t* data, size_t size)
+    {
+        // Largest run before the sums must be reduced to stay in 32 bits.
+        constexpr size_t RUN = 5552;
+        uint32_t a = 1;
+        uint32_t b = 0;
+        while (size > 0)
+        {
+            const size_t run = std::min(size, RUN);
+            for (size_t i = 0; i < run; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += run;
+            size -= run;
+        }
+        return (b << 16) | a;
+    }
+
+private:
+    static constexpr size_t MAX_STORED_BLOCK = 65535;
+
+    static void toRgb(const uint8_t* in, uint8_t* out, uint32_t count,
+                      bool bgra)
+    {
+        const int r = bgra ? 2 : 0;
+        const int b = bgra ? 0 : 2;
+        for (uint32_t i = 0; i < count; i++, in += 4, out += 3)
+        {
+            out[0] = in[r];
+            out[1] = in[1];
+            out[2] = in[b];
+        }
+    }
+
+    static void storeBigEndian(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+
+    static void append(std::vector<std::byte>& out, const uint8_t* data,
+                       size_t size)
+    {
+        const auto* bytes = reinterpret_cast<const std::byte*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    static void writeChunk(std::vector<std::byte>& out, const char* type,
+                           const uint8_t* data, size_t size)
+    {
+        uint8_t word[4];
+        storeBigEndian(word, static_cast<uint32_t>(size));
+        append(out, word, 4);
+        const auto* typeBytes = reinterpret_cast<const uint8_t*>(type);
+        append(out, typeBytes, 4);
+        if (size > 0)
+        {
+            append(out, data, size);
+        }
+        const uint32_t crc =
+            crc32(data, size, crc32(typeBytes, 4)) ^ 0xffffffffu;
+        storeBigEndian(word, crc);
+        append(out, word, 4);
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Per-instance state of the instanced triangles, kept as a structure of
+// arrays so the update loop streams through contiguous floats and the
+// compiler can vectorize it. Every attribute the vertex shader reads is its
+// own tightly packed stream as well.
+class InstanceField
+{
+public:
+    // Instances processed per parallelFor chunk; large enough that a chunk
+    // amortizes scheduling, small enough to spread 10k instances over cores.
+    static constexpr size_t UPDATE_CHUNK = 4096;
+
+    // One instance is the untransformed triangle at the origin; more are
+    // scattered over the viewport, scaled so their total area stays similar.
+    void reset(size_t count, uint32_t seed = 1)
+    {
+        posX.assign(count, 0.0f);
+        posY.assign(count, 0.0f);
+        velX.assign(count, 0.0f);
+        velY.assign(count, 0.0f);
+        rotation.assign(count, 0.0f);
+        spin.assign(count, 0.0f);
+        scale.assign(count, 1.0f);
+        color.assign(count, 0xffffffffu);
+        if (count <= 1)
+        {
+            return;
+        }
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> speed(-0.25f, 0.25f);
+        std::uniform_real_distribution<float> angle(
+            -std::numbers::pi_v<float>, std::numbers::pi_v<float>);
+        std::uniform_int_distribution<uint32_t> channel(64, 255);
+        const float baseScale = std::clamp(
+            1.5f / std::sqrt(static_cast<float>(count)), 0.002f, 1.0f);
+        for (size_t i = 0; i < count; i++)
+        {
+            posX[i] = position(rng);
+            posY[i] = position(rng);
+            velX[i] = speed(rng);
+            velY[i] = speed(rng);
+            rotation[i] = angle(rng);
+            spin[i] = angle(rng);
+            scale[i] = baseScale;
+            color[i] = channel(rng) | channel(rng) << 8 | channel(rng) << 16 |
+                       0xff000000u;
+        }
+    }
+
+    size_t size() const { return posX.size(); }
+
+    // Static streams, uploaded once.
+    const std::vector<float>& scales() const { return scale; }
+    // R8G8B8A8 unorm, red in the low byte.
+    const std::vector<uint32_t>& colors() const { return color; }
+
+    // Advance the simulation by dt seconds and write the per-frame streams
+    // into dstX, dstY and dstRotation, which hold size() floats each.
+    void update(ThreadPool& pool, float dt, float* dstX, float* dstY,
+                float* dstRotation)
+    {
+        pool.parallelFor(size(),
+                         UPDATE_CHUNK,
+                         [&](size_t begin, size_t end)
+                         {
+                             updateRange(begin,
+                                         end,
+                                         dt,
+                                         dstX,
+                                         dstY,
+                                         dstRotation);
+                         });
+    }
+
+private:
+    std::vector<float> posX;
+    std::vector<float> posY;
+    std::vector<float> velX;
+    std::vector<float> velY;
+    std::vector<float> rotation;
+    std::vector<float> spin;
+    std::vector<float> scale;
+    std::vector<uint32_t> color;
+
+    // One loop per stream: each loop touches few enough arrays that the
+    // compiler's runtime alias checks stay cheap and it vectorizes them. The
+    // selects pick between constants so they compile to masks, not branches.
+    void updateRange(size_t begin, size_t end, float dt, float* dstX,
+                     float* dstY, float* dstRotation)
+    {
+        advanceAxis(begin, end, dt, posX.data(), velX.data(), dstX);
+        advanceAxis(begin, end, dt, posY.data(), velY.data(), dstY);
+
+        constexpr float pi = std::numbers::pi_v<float>;
+        float* r = rotation.data();
+        const float* s = spin.data();
+        for (size_t i = begin; i < end; i++)
+        {
+            // spin stays below pi per second, one wrap brings angle back
+            float angle = r[i] + s[i] * dt;
+            angle += angle > pi ? -2.0f * pi : 0.0f;
+            angle += angle < -pi ? 2.0f * pi : 0.0f;
+            r[i] = angle;
+            dstRotation[i] = angle;
+        }
+    }
+
+    // Move along one axis, bouncing off the viewport edges.
+    static void advanceAxis(size_t begin, size_t end, float dt, float* pos,
+                            float* vel, float* dst)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float p = pos[i] + vel[i] * dt;
+            vel[i] *= std::fabs(p) > 1.0f ? -1.0f : 1.0f;
+            pos[i] = p;
+            dst[i] = p;
+        }
+    }
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Just enough JSON for glTF and benchmark baselines: a recursive descent
+// parser into a tree of values. Missing members and out-of-range elements
+// read as null, so lookups chain without checks and the caller tests the
+// leaf.
+class JsonValue
+{
+public:
+    enum class Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    // Throws std::runtime_error on malformed input.
+    static JsonValue parse(std::string_view text)
+    {
+        Parser parser { text };
+        JsonValue value = parser.value();
+        parser.skipSpace();
+        if (parser.position != text.size())
+        {
+            parser.fail("trailing characters");
+        }
+        return value;
+    }
+
+    Type type() const { return kind; }
+    bool isNull() const { return kind == Type::Null; }
+
+    double number(double fallback = 0.0) const
+    {
+        return kind == Type::Number ? numberValue : fallback;
+    }
+
+    // Numbers that are no valid index, negative or too large for a size_t,
+    // give the fallback too.
+    size_t index(size_t fallback = 0) const
+    {
+        return kind == Type::Number && numberValue >= 0.0 &&
+                       numberValue < 0x1p63
+                   ? static_cast<size_t>(numberValue)
+                   : fallback;
+    }
+
+    bool boolean(bool fallback = false) const
+    {
+        return kind == Type::Bool ? boolValue : fallback;
+    }
+
+    std::string_view string() const { return text; }
+
+    // Elements of an array, members of an object.
+    size_t size() const
+    {
+        return kind == Type::Object ? members.size() : items.size();
+    }
+
+    const JsonValue& operator[](size_t i) const
+    {
+        return kind == Type::Array && i < items.size() ? items[i] : null();
+    }
+
+    const JsonValue& operator[](std::string_view key) const
+    {
+        for (const auto& [name, value] : members)
+        {
+            if (name == key)
+            {
+                return value;
+            }
+        }
+        return null();
+    }
+
+    const std::vector<JsonValue>& elements() const { return items; }
+
+private:
+    Type kind = Type::Null;
+    bool boolValue = false;
+    double numberValue = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    static const JsonValue& null()
+    {
+        static const JsonValue value;
+        return value;
+    }
+
+    struct Parser
+    {
+        std::string_view input;
+        size_t position = 0;
+
+        [[noreturn]] void fail(const char* what) const
+        {
+            throw std::runtime_error("JSON: " + std::string(what) +
+                                     " at offset " + std::to_string(position));
+        }
+
+        void skipSpace()
+        {
+            while (position < input.size() &&
+                   (input[position] == ' ' || input[position] == '\n' ||
+                    input[position] == '\r' || input[position] == '\t'))
+            {
+                position++;
+            }
+        }
+
+        char peek()
+        {
+            skipSpace();
+            if (position == input.size())
+            {
+                fail("unexpected end");
+            }
+            return input[position];
+        }
+
+        void expect(char c)
+        {
+            if (peek() != c)
+            {
+                fail("unexpected character");
+            }
+            position++;
+        }
+
+        bool literal(std::string_view word)
+        {
+            if (input.substr(position, word.size()) != word)
+            {
+                return false;
+            }
+            position += word.size();
+            return true;
+        }
+
+        JsonValue value()
+        {
+            JsonValue result;
+            const char c = peek();
+            if (c == '{')
+            {
+                result.kind = Type::Object;
+                position++;
+                if (peek() == '}')
+                {
+                    position++;
+                    return result;
+                }
+                do
+                {
+                    std::string key = string();
+                    expect(':');
+                    result.members.emplace_back(std::move(key), value());
+                } while (separator('}'));
+            }
+            else if (c == '[')
+            {
+                result.kind = Type::Array;
+                position++;
+                if (peek() == ']')
+                {
+                    position++;
+                    return result;
+                }
+                do
+                {
+                    result.items.push_back(value());
+                } while (separator(']'));
+            }
+            else if (c == '"')
+            {
+                result.kind = Type::String;
+                result.text = string();
+            }
+            else if (literal("true"))
+            {
+                result.kind = Type::Bool;
+                result.boolValue = true;
+            }
+            else if (literal("false"))
+            {
+                result.kind = Type::Bool;
+            }
+            else if (literal("null"))
+            {
+            }
+            else
+            {
+                result.kind = Type::Number;
+                result.numberValue = number();
+            }
+            return result;
+        }
+
+        // After an element: true for a comma, false for the closing bracket.
+        bool separator(char close)
+        {
+            const char c = peek();
+            position++;
+            if (c == ',')
+            {
+                return true;
+            }
+            if (c != close)
+            {
+                fail("expected a comma or closing bracket");
+            }
+            return false;
+        }
+
+        double number()
+        {
+            // strtod needs a terminated string; numbers are short.
+            const size_t start = position;
+            while (position < input.size() &&
+                   std::string_view("+-0123456789.eE").find(input[position]) !=
+                       std::string_view::npos)
+            {
+                position++;
+            }
+            const std::string digits(input.substr(start, position - start));
+            char* end = nullptr;
+            const double result = std::strtod(digits.c_str(), &end);
+            if (digits.empty() || end != digits.c_str() + digits.size())
+            {
+                position = start;
+                fail("invalid number");
+            }
+            return result;
+        }
+
+        std::string string()
+        {
+            expect('"');
+            std::string result;
+            while (true)
+            {
+                if (position == input.size())
+                {
+                    fail("unterminated string");
+                }
+                const char c = input[position++];
+                if (c == '"')
+                {
+                    return result;
+                }
+                if (c != '\\')
+                {
+                    result += c;
+                    continue;
+                }
+                if (position == input.size())
+                {
+                    fail("unterminated string");
+                }
+                const char escaped = input[position++];
+                const std::string_view from = "\"\\/bfnrt";
+                const std::string_view to = "\"\\/\b\f\n\r\t";
+                const size_t found = from.find(escaped);
+                if (found != std::string_view::npos)
+                {
+                    result += to[found];
+                }
+                else if (escaped == 'u' && position + 4 <= input.size())
+                {
+                    // glTF names only; non-ASCII code points become '?'
+                    const unsigned long code = std::strtoul(
+                        std::string(input.substr(position, 4)).c_str(),
+                        nullptr,
+                        16);
+                    result += code < 0x80 ? static_cast<char>(code) : '?';
+                    position += 4;
+                }
+                else
+                {
+                    fail("invalid escape");
+                }
+            }
+        }
+    };
+};
@@ -1,11 +1,24 @@
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 // #include <format>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <vulkan/vulkan_raii.hpp>
@@ -15,9 +28,58 @@
 #define GLFW_INCLUDE_VULKAN // REQUIRED only for GLFW CreateWindowSurface.
 #include <GLFW/glfw3.h>
 
+#include "bench_report.hpp"
+#include "cpu_profiler.hpp"
+#include "deletion_queue.hpp"
+#include "descriptor_heap.hpp"
+#include "embedded_shaders.hpp"
+#include "entry_points.hpp"
+#include "frame_capture.hpp"
+#include "frame_limiter.hpp"
+#include "gpu_allocator.hpp"
+#include "gpu_culler.hpp"
+#include "gpu_timer.hpp"
+#include "instance_field.hpp"
+#include "mapped_file.hpp"
+#include "mesh_loader.hpp"
+#include "meshlet_builder.hpp"
+#include "meshlet_renderer.hpp"
+#include "parallel_recorder.hpp"
+#include "particle_system.hpp"
+#include "pipeline_cache.hpp"
+#include "render_graph.hpp"
+#include "resolution_scaler.hpp"
+#include "shader_reloader.hpp"
+#include "staging_uploader.hpp"
+#include "startup_timer.hpp"
+#include "texture_streamer.hpp"
+#include "thread_pool.hpp"
+#include "vertex_optimizer.hpp"
+#include "vertex_quantizer.hpp"
+
 constexpr uint32_t WIDTH = 800;
 constexpr uint32_t HEIGHT = 600;
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 8;
+// 16.7 million triangles.
+constexpr uint32_t MAX_MESH_DETAIL = 4096;
+constexpr uint32_t DEFAULT_HEADLESS_FRAMES = 1000;
+constexpr const char* DEFAULT_TRACE_PATH = "trace.json";
+// Upper bound on one simulation step, so a stall does not fling instances.
+constexpr float MAX_INSTANCE_STEP = 0.1f;
+// Frames before the textures in use shift by one, paging the set through the
+// whole library.
+constexpr uint64_t TEXTURE_PAGE_FRAMES = 30;
+constexpr uint32_t DEFAULT_FPS_CAP = 60;
+// With present wait, frames presented but not yet on screen while the next
+// one is recorded. One keeps the GPU fed without queueing behind the display.
+constexpr uint64_t MAX_QUEUED_PRESENTS = 1;
+constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+// Acquire timestamps kept for the acquire to present measurement.
+constexpr size_t PRESENT_HISTORY = 16;
+// Frame and present time samples kept for the reports, about 4.6 hours at 60
+// fps. Past that the oldest half is dropped, so a long run stays bounded.
+constexpr size_t MAX_TIME_SAMPLES = 1 << 20;
 
 const std::vector validationLayers = { "VK_LAYER_KHRONOS_validation" };
 
@@ -27,18 +89,288 @@ constexpr bool enableValidationLayers = false;
 constexpr bool enableValidationLayers = true;
 #endif
 
+struct Vertex
+{
+    float pos[2];
+    float color[3];
+
+    static vk::VertexInputBindingDescription getBindingDescription()
+    {
+        return { .binding = 0,
+                 .stride = sizeof(Vertex),
+                 .inputRate = vk::VertexInputRate::eVertex };
+    }
+
+    static std::array<vk::VertexInputAttributeDescription, 2>
+    getAttributeDescriptions()
+    {
+        return { vk::VertexInputAttributeDescription {
+                     .location = 0,
+                     .binding = 0,
+                     .format = vk::Format::eR32G32Sfloat,
+                     .offset = offsetof(Vertex, pos) },
+                 vk::VertexInputAttributeDescription {
+                     .location = 1,
+                     .binding = 0,
+                     .format = vk::Format::eR32G32B32Sfloat,
+                     .offset = offsetof(Vertex, color) } };
+    }
+};
+
+// Per-instance vertex streams, one binding per attribute so each stays a
+// tightly packed array. Position and rotation are rewritten every frame;
+// scale and color are uploaded once.
+struct InstanceStreams
+{
+    static constexpr uint32_t FIRST_BINDING = 1;
+    static constexpr uint32_t FIRST_LOCATION = 2;
+
+    static std::array<vk::VertexInputBindingDescription, 5>
+    getBindingDescriptions()
+    {
+        std::array<vk::VertexInputBindingDescription, 5> bindings;
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i] = { .binding = FIRST_BINDING + i,
+                            .stride = sizeof(float),
+                            .inputRate = vk::VertexInputRate::eInstance };
+        }
+        return bindings;
+    }
+
+    // x, y, rotation, scale, color
+    static std::array<vk::VertexInputAttributeDescription, 5>
+    getAttributeDescriptions()
+    {
+        std::array<vk::VertexInputAttributeDescription, 5> attributes;
+        for (uint32_t i = 0; i < attributes.size(); i++)
+        {
+            attributes[i] = { .location = FIRST_LOCATION + i,
+                              .binding = FIRST_BINDING + i,
+                              .format = vk::Format::eR32Sfloat,
+                              .offset = 0 };
+        }
+        attributes[4].format = vk::Format::eR8G8B8A8Unorm;
+        return attributes;
+    }
+};
+
+// Corners of the triangle, clockwise on screen.
+const std::array<Vertex, 3> TRIANGLE = {
+    Vertex { { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+    Vertex { { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+    Vertex { { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } }
+};
+
+// Vertex input formats of each VertexQuantizer layout. Every one of them is
+// a mandatory vertex buffer format.
+struct VertexFormatInfo
+{
+    const char* name;
+    VertexFormat format;
+    vk::Format position;
+    vk::Format normal;
+    vk::Format uv;
+};
+
+constexpr std::array<VertexFormatInfo, 3> VERTEX_FORMATS = { {
+    { "float",
+      VertexFormat::Float,
+      vk::Format::eR32G32B32Sfloat,
+      vk::Format::eR32G32B32Sfloat,
+      vk::Format::eR32G32Sfloat },
+    { "half",
+      VertexFormat::Half,
+      vk::Format::eR16G16B16A16Sfloat,
+      vk::Format::eR16G16Snorm,
+      vk::Format::eR16G16Sfloat },
+    { "snorm16",
+      VertexFormat::Snorm16,
+      vk::Format::eR16G16B16A16Snorm,
+      vk::Format::eR16G16Snorm,
+      vk::Format::eR16G16Sfloat },
+} };
+// Location of the UV attribute, after the instance attributes.
+constexpr uint32_t UV_LOCATION = 7;
+
+// Must match ViewConstants in shader.slang.
+struct ViewConstants
+{
+    float viewScale = 1.0f;
+    // Descriptor heap indices of the texture table and sampler. Instance i
+    // samples table entry (i + textureOffset) % textureCount; no textures
+    // are sampled when textureCount is 0.
+    uint32_t textureTable = 0;
+    uint32_t textureCount = 0;
+    uint32_t textureOffset = 0;
+    uint32_t sampler = 0;
+};
+
+// How the swapchain trades latency against power.
+enum class PresentPolicy
+{
+    // New frames replace queued ones: Mailbox, else Immediate, which tears.
+    LowLatency,
+    // Vsync with the fewest images, the GPU idles between refreshes.
+    PowerSaving,
+    // Vsync that tears instead of stuttering when a frame is late, with the
+    // CPU held to a frame rate cap.
+    Capped,
+};
+
+struct PresentPolicyInfo
+{
+    const char* name;
+    PresentPolicy policy;
+    // In order of preference; Fifo is always supported.
+    std::array<vk::PresentModeKHR, 3> presentModes;
+    // Swapchain images beyond the surface minimum.
+    uint32_t extraImages;
+};
+
+constexpr std::array<PresentPolicyInfo, 3> PRESENT_POLICIES = { {
+    { "latency",
+      PresentPolicy::LowLatency,
+      { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate,
+        vk::PresentModeKHR::eFifo },
+      1 },
+    { "power",
+      PresentPolicy::PowerSaving,
+      { vk::PresentModeKHR::eFifo, vk::PresentModeKHR::eFifo,
+        vk::PresentModeKHR::eFifo },
+      0 },
+    { "capped",
+      PresentPolicy::Capped,
+      { vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eFifo,
+        vk::PresentModeKHR::eFifo },
+      1 },
+} };
+
+constexpr std::array<std::pair<const char*, vk::PresentModeKHR>, 4>
+    PRESENT_MODE_NAMES = { {
+        { "immediate", vk::PresentModeKHR::eImmediate },
+        { "mailbox", vk::PresentModeKHR::eMailbox },
+        { "fifo", vk::PresentModeKHR::eFifo },
+        { "fifo-relaxed", vk::PresentModeKHR::eFifoRelaxed },
+    } };
+
+struct AppOptions
+{
+    // Render into device-owned images instead of a window surface. No GLFW
+    // calls are made, so this runs on machines without a display.
+    bool headless = false;
+    // Present to a VK_EXT_headless_surface instead of a window: the
+    // swapchain path runs without a display, but nothing is shown.
+    bool headlessSurface = false;
+    uint32_t width = WIDTH;
+    uint32_t height = HEIGHT;
+    // Number of frames to render before exiting, 0 runs until the window is
+    // closed.
+    uint32_t frameCount = 0;
+    // How many frames the CPU may record ahead of the GPU.
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    // Where the pipeline cache is persisted between runs, empty disables it.
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // Chrome trace written at exit, or when F12 is pressed. Empty only dumps
+    // on F12, to the default path.
+    std::string tracePath;
+    // Copies of the triangle to draw. One reproduces the single triangle,
+    // more are scattered over the viewport and animated on the CPU.
+    uint32_t instanceCount = 1;
+    // Draw calls the instances are split into, recorded in parallel.
+    uint32_t drawCount = 1;
+    // Cull instances on the GPU and draw the visible ones indirectly.
+    bool gpuCulling = false;
+    // Rows the triangle is tessellated into, detail squared triangles.
+    uint32_t meshDetail = 1;
+    // Draw through meshlets with task and mesh shaders where supported.
+    bool meshShaders = false;
+    // Meshlets built ahead of time, rebuilt and rewritten when they do not
+    // match the mesh. Empty builds them at every start.
+    std::string meshletCachePath;
+    // OBJ, glTF or GLB mesh drawn instead of the triangle.
+    std::string meshPath;
+    // Vertex encoding of the loaded mesh.
+    VertexFormat vertexFormat = VertexFormat::Snorm16;
+    // Magnification of the view; above 1 pushes instances off screen.
+    float zoom = 1.0f;
+    // Directory to map SPIR-V from instead of using the copies embedded at
+    // build time.
+    std::string shaderDir;
+    // Recompile shader.slang and swap the graphics pipeline when it changes.
+    bool hotReload = false;
+    // Resize the window every frame to measure recreation hitches.
+    bool resizeTest = false;
+    // Threads updating instances and recording draws, including the render
+    // thread. 0 uses every hardware thread.
+    uint32_t threadCount = 0;
+    // Directory of .ktx2 and .dds textures to stream onto the instances.
+    std::string textureDir;
+    // Device memory the streamed textures may hold.
+    uint32_t textureBudgetMiB = TextureStreamer::DEFAULT_BUDGET >> 20;
+    PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+    // Overrides the policy's present mode when the surface supports it.
+    std::optional<vk::PresentModeKHR> presentMode;
+    // Overrides the policy's swapchain image count, 0 keeps it.
+    uint32_t swapchainImages = 0;
+    // Frames per second the CPU is held to, 0 is uncapped.
+    uint32_t fpsCap = 0;
+    // Run every startup step on the render thread, to compare against the
+    // parallel startup.
+    bool serialStartup = false;
+    // Particles simulated in a compute pass and drawn as points, 0 for none.
+    uint32_t particleCount = 0;
+    // Simulate particles on a compute-only queue family when there is one.
+    bool asyncCompute = true;
+    // GPU time per frame the render resolution adapts to, 0 always renders
+    // at the swapchain extent.
+    double frameBudgetMs = 0.0;
+    // Lowest fraction of the swapchain extent rendered at.
+    float minRenderScale = 0.5f;
+    // Where every rendered frame is written: numbered files next to a .png
+    // path, or one .y4m video. Empty captures nothing.
+    std::string capturePath;
+};
+
+// What a run measured, kept for the benchmark.
+struct RunResults
+{
+    std::string deviceName;
+    double startupMs = 0.0;
+    uint64_t frames = 0;
+    // CPU time of every frame.
+    std::vector<float> cpuFrameMs;
+    // GPU time of every frame the timer measured.
+    std::vector<double> gpuFrameMs;
+    // Allocator state after the last frame, before teardown.
+    GpuMemoryStats memory;
+};
+
 class HelloTriangleApplication
 {
 public:
+    explicit HelloTriangleApplication(const AppOptions& options)
+        : options(options), maxFramesInFlight(options.framesInFlight),
+          threadPool(options.threadCount == 0
+                         ? ThreadPool::defaultThreadCount()
+                         : options.threadCount)
+    {
+    }
+
     void run()
     {
-        initWindow();
         initVulkan();
         mainLoop();
         cleanup();
     }
 
+    const RunResults& results() const { return runResults; }
+
 private:
+    AppOptions options;
+    // Before threadPool, so its start includes spawning the workers.
+    StartupTimer startup;
+
     GLFWwindow* window = nullptr;
 
     vk::raii::Context context;
@@ -48,30 +380,161 @@ private:
 
     vk::raii::PhysicalDevice physicalDevice = nullptr;
     vk::raii::Device device = nullptr;
+    GpuAllocator allocator;
+    // Bindless set 0 of every pipeline layout.
+    DescriptorHeap descriptorHeap;
 
     vk::raii::Queue graphicsQueue = nullptr;
     vk::raii::Queue presentQueue = nullptr;
+    // Transfer-only queue when the device has one, otherwise the graphics
+    // queue.
+    vk::raii::Queue transferQueue = nullptr;
+    uint32_t transferIndex = 0;
+    // Compute-only queue when the device has one, otherwise the graphics
+    // queue.
+    vk::raii::Queue computeQueue = nullptr;
+    uint32_t computeIndex = 0;
+    // Queues may alias, and the texture streamer submits from the thread
+    // pool, so every submit and present holds this.
+    std::mutex queueMutex;
+    StagingUploader uploader;
+    TextureStreamer textureStreamer;
+    bool memoryBudgetSupported = false;
 
     vk::raii::SwapchainKHR swapChain = nullptr;
     std::vector<vk::Image> swapChainImages;
     vk::Format swapChainImageFormat = vk::Format::eUndefined;
     vk::Extent2D swapChainExtent;
     std::vector<vk::raii::ImageView> swapChainImageViews;
-
+    // SPIR-V of the graphics and cull pipelines, loaded during startup.
+    // Views into the embedded shaders or into the mapped files.
+    MappedFile graphicsShaderFile;
+    MappedFile cullShaderFile;
+    std::span<const uint32_t> graphicsShaderCode;
+    std::span<const uint32_t> cullShaderCode;
+    // Usage the image is left in at the end of a frame: presentable for the
+    // swapchain, transfer source for offscreen targets.
+    ResourceUsage finalImageUsage = ResourceUsage::Present;
+    vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+
+    // VK_KHR_present_wait: frame n presents with id n + 1, and the next
+    // frame waits until at most MAX_QUEUED_PRESENTS are left on the way to
+    // the display.
+    bool presentWaitSupported = false;
+    uint64_t lastPresentId = 0;
+    uint64_t lastWaitedPresentId = 0;
+    // Ids below this went to a retired swapchain and are never waited for.
+    uint64_t swapchainFirstPresentId = 1;
+    // Indexed by present id.
+    std::array<std::chrono::steady_clock::time_point, PRESENT_HISTORY>
+        acquireTimes;
+    // Acquire until the image reached the display with present wait, until
+    // vkQueuePresentKHR returned without it.
+    std::vector<float> presentLatenciesMs;
+    FrameLimiter frameLimiter;
+
+    // Headless render targets standing in for swapChainImages.
+    std::vector<AllocatedImage> offscreenImages;
+
+    PersistentPipelineCache pipelineCache;
     vk::raii::PipelineLayout pipelineLayout = nullptr;
     vk::raii::Pipeline graphicsPipeline = nullptr;
 
-    vk::raii::CommandPool commandPool = nullptr;
+    ShaderReloader shaderReloader;
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    // Interleaved vertices of options.meshPath, replacing vertices.
+    QuantizedMesh loadedMesh;
+    MappedFile quantizedShaderFile;
+    std::span<const uint32_t> quantizedShaderCode;
+    // Radius of the circle around the origin containing every vertex.
+    float meshRadius = 0.0f;
+    AllocatedBuffer vertexBuffer;
+    AllocatedBuffer indexBuffer;
+
+    InstanceField instances;
+    // [x | y | rotation] streams per frame in flight, written by the CPU
+    // after that frame's fence signals.
+    std::vector<AllocatedBuffer> instanceBuffers;
+    // [scale | color] streams shared by every frame.
+    AllocatedBuffer instanceStaticBuffer;
+    std::chrono::steady_clock::time_point lastInstanceUpdate;
+    double instanceUpdateSeconds = 0.0;
+    double recordSeconds = 0.0;
+
+    GpuCuller culler;
+    uint64_t culledTotal = 0;
+
+    // Set when options.meshShaders is and the device supports them.
+    bool meshShadersSupported = false;
+    MeshletMesh meshlets;
+    AllocatedBuffer meshletBuffer;
+    AllocatedBuffer meshletVertexBuffer;
+    AllocatedBuffer meshletTriangleBuffer;
+    MeshletRenderer meshletRenderer;
+    MappedFile meshletShaderFile;
+    std::span<const uint32_t> meshletShaderCode;
+
+    ParticleSystem particles;
+    MappedFile particleShaderFile;
+    std::span<const uint32_t> particleShaderCode;
+
+    // One pool per frame in flight, reset whole once the frame's fence has
+    // signaled.
+    std::vector<vk::raii::CommandPool> commandPools;
     std::vector<vk::raii::CommandBuffer> commandBuffers;
+    // Secondary buffers holding the draws, recorded on threadPool.
+    ParallelRecorder recorder;
     uint32_t graphicsIndex = 0;
 
+    // The passes of a frame and the barriers between them, rebuilt with the
+    // swapchain. colorTarget is the image being rendered this frame.
+    RenderGraph renderGraph;
+    RenderGraph::Resource colorTarget = 0;
+    // What the render pass draws into: colorTarget, or with dynamic
+    // resolution a full-size transient drawn at renderExtent in its top-left
+    // corner and blitted into colorTarget.
+    RenderGraph::Resource renderTarget = 0;
+    // The visible count copied out for the CPU, a buffer per frame in flight
+    // bound before each frame.
+    RenderGraph::Resource cullReadback = 0;
+    vk::Extent2D renderExtent;
+    ResolutionScaler resolutionScaler;
+    vk::Filter upscaleFilter = vk::Filter::eLinear;
+    FrameCapture frameCapture;
+
+    // Acquire semaphores and fences belong to a frame in flight and are
+    // reused once that frame's fence has signaled. Render-finished semaphores
+    // belong to a swapchain image, since presentation consumes them and only
+    // re-acquiring the image proves that has happened.
     std::vector<vk::raii::Semaphore> presentCompleteSemaphores;
     std::vector<vk::raii::Semaphore> renderFinishedSemaphores;
     std::vector<vk::raii::Fence> inFlightFences;
-    uint32_t semaphoreIndex = 0;
+    uint32_t maxFramesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
     uint32_t currentFrame = 0;
 
+    GpuTimer gpuTimer;
+
     bool frameBufferResized = false;
+    bool traceRequested = false;
+    uint64_t frameNumber = 0;
+    uint64_t swapchainRecreations = 0;
+    // Objects the GPU may still use, keyed by the last frame that recorded
+    // them. Collected once that frame's fence has signaled.
+    DeletionQueue frameDeletionQueue;
+    // Retired swapchains with their views and render-finished semaphores,
+    // keyed by the first present id of the swapchain that replaced them.
+    // Fences do not cover presents that still wait on those semaphores, so
+    // these are held until a present on the new swapchain has completed, or
+    // without present wait, until a full frames in flight cycle of presents
+    // has been queued after it.
+    DeletionQueue swapchainDeletionQueue;
+    // CPU time of every frame, for the worst-case report at exit. Capped at
+    // MAX_TIME_SAMPLES like gpuFrameTimesMs and presentLatenciesMs.
+    std::vector<float> frameTimesMs;
+    std::vector<double> gpuFrameTimesMs;
+    RunResults runResults;
 
 #ifdef __APPLE__
     std::vector<const char*> requiredDeviceExtension = {
@@ -91,16 +554,45 @@ private:
     };
 #endif
 
-    void initWindow()
+    // Declared last so it is destroyed first: the destructor runs every
+    // queued texture, shader and capture job before the device, allocator
+    // and streamer those jobs use are gone.
+    ThreadPool threadPool;
+
+    // Neither headless mode creates a GLFW window.
+    bool hasWindow() const
+    {
+        return !options.headless && !options.headlessSurface;
+    }
+
+    // Render into an internal target scaled to the frame budget and blit it
+    // into the swapchain image.
+    bool dynamicResolution() const { return options.frameBudgetMs > 0.0; }
+
+    // Usage of the swapchain or offscreen images.
+    vk::ImageUsageFlags targetUsage() const
     {
-        glfwInit();
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+        if (options.headless || !options.capturePath.empty())
+        {
+            usage |= vk::ImageUsageFlagBits::eTransferSrc;
+        }
+        if (dynamicResolution())
+        {
+            usage |= vk::ImageUsageFlagBits::eTransferDst;
+        }
+        return usage;
+    }
 
+    void initWindow()
+    {
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         // glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
         glfwSetWindowUserPointer(window, this);
         glfwSetFramebufferSizeCallback(window, frameBufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
     }
 
     static void frameBufferResizeCallback(GLFWwindow* window, int width,
@@ -111,59 +603,420 @@ private:
         app->frameBufferResized = true;
     }
 
+    static void keyCallback(GLFWwindow* window, int key, int scancode,
+                            int action, int mods)
+    {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(
+            glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+        {
+            app->traceRequested = true;
+        }
+    }
+
+    // Steps that do not depend on each other overlap: the pipeline cache
+    // file and SPIR-V load while the instance and device are created, the
+    // instance is created while GLFW opens the window, and the graphics
+    // pipeline compiles on a worker while the swapchain and buffers are set
+    // up.
     void initVulkan()
     {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createGraphicsPipeline();
-        createCommandPool();
-        createCommandBuffers();
-        createSyncObjects();
+        CPU_ZONE("initVulkan");
+        ThreadPool* pool = options.serialStartup ? nullptr : &threadPool;
+        if (options.headless)
+        {
+            // Offscreen targets are never presented, so the swapchain
+            // extension is not needed and software ICDs without WSI qualify.
+            std::erase_if(requiredDeviceExtension,
+                          [](const char* extension)
+                          {
+                              return strcmp(extension,
+                                            vk::KHRSwapchainExtensionName) ==
+                                     0;
+                          });
+            finalImageUsage = ResourceUsage::TransferSource;
+        }
+
+        try
+        {
+            auto cacheRead = startup.async(
+                pool,
+                "readPipelineCache",
+                [this] { pipelineCache.read(options.pipelineCachePath); });
+            auto shadersLoaded =
+                startup.async(pool, "loadShaders", [this] { loadShaders(); });
+            auto meshBuilt = startup.async(pool,
+                                           "createMesh",
+                                           [this]
+                                           {
+                                               createMesh();
+                                               if (options.meshShaders)
+                                               {
+                                                   createMeshlets();
+                                               }
+                                           });
+
+            // GLFW must stay on this thread; the instance only needs its
+            // extension list.
+            if (hasWindow())
+            {
+                startup.run("glfwInit", [] { glfwInit(); });
+            }
+            auto instanceCreated = startup.async(pool,
+                                                 "createInstance",
+                                                 [this]
+                                                 {
+                                                     createInstance();
+                                                     setupDebugMessenger();
+                                                 });
+            if (hasWindow())
+            {
+                startup.run("initWindow", [this] { initWindow(); });
+            }
+            instanceCreated.get();
+
+            if (!options.headless)
+            {
+                startup.run("createSurface", [this] { createSurface(); });
+            }
+            startup.run("pickPhysicalDevice",
+                        [this] { pickPhysicalDevice(); });
+            startup.run("createLogicalDevice",
+                        [this] { createLogicalDevice(); });
+            startup.run("createAllocator", [this] { createAllocator(); });
+            startup.run("createDescriptorHeap",
+                        [this] { createDescriptorHeap(); });
+            cacheRead.get();
+            startup.run("createPipelineCache",
+                        [this] { createPipelineCache(); });
+            startup.run("createPipelineLayout",
+                        [this]
+                        {
+                            chooseRenderFormat();
+                            createPipelineLayout();
+                        });
+            shadersLoaded.get();
+            auto pipelineBuilt =
+                startup.async(pool,
+                              "createGraphicsPipeline",
+                              [this] { createGraphicsPipeline(); });
+
+            startup.run("createSwapChain",
+                        [this]
+                        {
+                            if (options.headless)
+                            {
+                                createOffscreenImages();
+                            }
+                            else
+                            {
+                                createSwapChain();
+                            }
+                            createImageViews();
+                        });
+            startup.run("createCommandPools",
+                        [this] { createCommandPools(); });
+            startup.run("createUploader", [this] { createUploader(); });
+            meshBuilt.get();
+            startup.run("createBuffers",
+                        [this]
+                        {
+                            createVertexBuffer();
+                            createIndexBuffer();
+                            if (meshShadersSupported)
+                            {
+                                createMeshletBuffers();
+                            }
+                            createInstanceBuffers();
+                        });
+            if (options.gpuCulling)
+            {
+                startup.run("createCuller", [this] { createCuller(); });
+            }
+            if (meshShadersSupported)
+            {
+                startup.run("createMeshletRenderer",
+                            [this] { createMeshletRenderer(); });
+            }
+            if (!options.textureDir.empty())
+            {
+                startup.run("createTextureStreamer",
+                            [this] { createTextureStreamer(); });
+            }
+            startup.run("createSyncObjects",
+                        [this]
+                        {
+                            createCommandBuffers();
+                            createSyncObjects();
+                            createGpuTimer();
+                            resolutionScaler.init(options.frameBudgetMs,
+                                                  options.minRenderScale,
+                                                  maxFramesInFlight);
+                        });
+            if (options.particleCount != 0)
+            {
+                startup.run("createParticles", [this] { createParticles(); });
+            }
+            if (!options.capturePath.empty())
+            {
+                startup.run("createFrameCapture",
+                            [this] { createFrameCapture(); });
+            }
+            startup.run("buildRenderGraph", [this] { buildRenderGraph(); });
+            pipelineBuilt.get();
+        }
+        catch (...)
+        {
+            // async steps still reference this
+            startup.waitAll();
+            throw;
+        }
+        if (options.hotReload)
+        {
+            createShaderReloader();
+        }
+    }
+
+    bool shouldClose() const
+    {
+        if (options.frameCount != 0 && frameNumber >= options.frameCount)
+        {
+            return true;
+        }
+        return hasWindow() && glfwWindowShouldClose(window);
     }
 
     void mainLoop()
     {
-        while (!glfwWindowShouldClose(window))
+        const auto start = std::chrono::steady_clock::now();
+        auto frameStart = start;
+        frameLimiter.setRate(options.fpsCap);
+        while (!shouldClose())
         {
-            glfwPollEvents();
+            if (hasWindow())
+            {
+                glfwPollEvents();
+            }
+            if (options.resizeTest)
+            {
+                animateWindowSize();
+            }
             drawFrame();
+
+            const auto frameEnd = std::chrono::steady_clock::now();
+            addTimeSample(
+                frameTimesMs,
+                std::chrono::duration<float, std::milli>(frameEnd - frameStart)
+                    .count());
+            frameStart = frameEnd;
+
+            if (traceRequested)
+            {
+                traceRequested = false;
+                dumpTrace();
+            }
         }
 
+        // Shutdown only: presentation holds semaphores that no fence covers.
+        textureStreamer.wait();
         device.waitIdle();
+        frameDeletionQueue.flush();
+        swapchainDeletionQueue.flush();
+        frameCapture.finish();
+
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (frameNumber > 0)
+        {
+            std::cout << "rendered " << frameNumber << " frames ("
+                      << maxFramesInFlight << " in flight) in "
+                      << elapsed.count() << " s ("
+                      << static_cast<double>(frameNumber) / elapsed.count()
+                      << " fps, "
+                      << 1000.0 * elapsed.count() /
+                             static_cast<double>(frameNumber)
+                      << " ms/frame)" << std::endl;
+            reportFrameTimes();
+            reportPresentLatency();
+            std::cout << "updated " << instances.size() << " instances on "
+                      << threadPool.threadCount() << " threads in "
+                      << 1000.0 * instanceUpdateSeconds /
+                             static_cast<double>(frameNumber)
+                      << " ms/frame" << std::endl;
+            std::cout << "recorded " << options.drawCount << " draws on "
+                      << recorder.slotCount() << " threads in "
+                      << 1000.0 * recordSeconds /
+                             static_cast<double>(frameNumber)
+                      << " ms/frame" << std::endl;
+            if (options.gpuCulling)
+            {
+                std::cout << "culled "
+                          << static_cast<double>(culledTotal) /
+                                 static_cast<double>(frameNumber)
+                          << " of " << instances.size()
+                          << " instances per frame" << std::endl;
+            }
+        }
+        if (!options.textureDir.empty())
+        {
+            textureStreamer.report(std::cout);
+        }
+        if (meshShadersSupported)
+        {
+            meshletRenderer.report(std::cout);
+        }
+        if (options.particleCount != 0 && frameNumber > 0)
+        {
+            particles.report(std::cout, frameNumber, elapsed.count());
+        }
+        gpuTimer.report(std::cout);
+        allocator.report(std::cout);
+        if (frameNumber > 0)
+        {
+            renderGraph.report(std::cout);
+        }
+        resolutionScaler.report(std::cout);
+        frameCapture.report(std::cout);
+        if (!options.tracePath.empty())
+        {
+            dumpTrace();
+        }
+
+        runResults = RunResults {
+            .deviceName = physicalDevice.getProperties().deviceName.data(),
+            .startupMs = startup.firstFrameMs(),
+            .frames = frameNumber,
+            .cpuFrameMs = std::move(frameTimesMs),
+            .gpuFrameMs = std::move(gpuFrameTimesMs),
+            .memory = allocator.stats()
+        };
+    }
+
+    template <typename T>
+    static void addTimeSample(std::vector<T>& samples, T value)
+    {
+        if (samples.size() == MAX_TIME_SAMPLES)
+        {
+            samples.erase(samples.begin(),
+                          samples.begin() + MAX_TIME_SAMPLES / 2);
+        }
+        samples.push_back(value);
+    }
+
+    void reportFrameTimes()
+    {
+        std::vector<float> sorted = frameTimesMs;
+        std::ranges::sort(sorted);
+        const size_t p99 = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+        std::cout << "frame time: median " << sorted[sorted.size() / 2]
+                  << " ms, p99 " << sorted[p99] << " ms, worst "
+                  << sorted.back() << " ms";
+        if (options.resizeTest)
+        {
+            std::cout << " (" << swapchainRecreations << " recreations)";
+        }
+        std::cout << std::endl;
+    }
+
+    void reportPresentLatency()
+    {
+        if (presentLatenciesMs.empty())
+        {
+            return;
+        }
+        std::vector<float> sorted = presentLatenciesMs;
+        std::ranges::sort(sorted);
+        const size_t p99 = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+        std::cout << (presentWaitSupported ? "acquire to present: "
+                                           : "acquire to present call: ")
+                  << "median " << sorted[sorted.size() / 2] << " ms, p99 "
+                  << sorted[p99] << " ms, worst " << sorted.back() << " ms ("
+                  << vk::to_string(presentMode) << ", "
+                  << swapChainImages.size() << " images";
+        if (frameLimiter.enabled())
+        {
+            std::cout << ", capped at " << options.fpsCap << " fps";
+        }
+        std::cout << ")" << std::endl;
+    }
+
+    // Sweep the window between half and full size, one step per frame.
+    void animateWindowSize()
+    {
+        const double phase = 0.5 + 0.5 * std::sin(frameNumber * 0.05);
+        glfwSetWindowSize(window,
+                          static_cast<int>(WIDTH / 2 + phase * WIDTH / 2),
+                          static_cast<int>(HEIGHT / 2 + phase * HEIGHT / 2));
+    }
+
+    void dumpTrace() const
+    {
+        const std::string path =
+            options.tracePath.empty() ? DEFAULT_TRACE_PATH : options.tracePath;
+        if (CpuProfiler::dumpChromeTrace(path))
+        {
+            std::cout << "wrote cpu trace to " << path << std::endl;
+        }
+        else
+        {
+            std::cerr << "failed to write cpu trace to " << path << std::endl;
+        }
     }
 
     void cleanupSwapChain()
     {
         swapChainImageViews.clear();
         swapChain = nullptr;
+        offscreenImages.clear();
     }
 
     void recreateSwapChain()
     {
-        int width = 0;
-        int height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0)
+        CPU_ZONE("recreateSwapChain");
+        if (hasWindow())
         {
+            int width = 0;
+            int height = 0;
             glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
+            while (width == 0 || height == 0)
+            {
+                glfwGetFramebufferSize(window, &width, &height);
+                glfwWaitEvents();
+            }
         }
 
-        device.waitIdle();
-        cleanupSwapChain();
-
-        createSwapChain();
+        // Frames in flight keep using the old swapchain's images, views and
+        // semaphores, and its pending presents wait on the semaphores; they
+        // are handed over and retired rather than waited for. Views go first
+        // so they never outlive their images.
+        vk::raii::SwapchainKHR oldSwapChain = std::move(swapChain);
+        createSwapChain(*oldSwapChain);
+        swapchainFirstPresentId = lastPresentId + 1;
+        swapchainDeletionQueue.retire(swapchainFirstPresentId,
+                                      std::move(swapChainImageViews));
+        swapchainDeletionQueue.retire(swapchainFirstPresentId,
+                                      std::move(renderFinishedSemaphores));
+        swapchainDeletionQueue.retire(swapchainFirstPresentId,
+                                      std::move(oldSwapChain));
+        swapChainImageViews.clear();
+        renderFinishedSemaphores.clear();
         createImageViews();
+        createRenderFinishedSemaphores();
+        frameDeletionQueue.retire(frameNumber, renderGraph.reset());
+        buildRenderGraph();
+        swapchainRecreations++;
     }
 
     void cleanup()
     {
+        // a rebuild in progress still uses the device
+        shaderReloader.wait();
+        pipelineCache.save();
         cleanupSwapChain();
+        if (!hasWindow())
+        {
+            return;
+        }
         glfwDestroyWindow(window);
 
         glfwTerminate();
@@ -171,6 +1024,7 @@ private:
 
     void createInstance()
     {
+        CPU_ZONE("createInstance");
         constexpr vk::ApplicationInfo appInfo {
             .pApplicationName = "Hello Triangle",
             .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
@@ -244,6 +1098,7 @@ private:
 
     void setupDebugMessenger()
     {
+        CPU_ZONE("setupDebugMessenger");
         if (!enableValidationLayers)
             return;
 
@@ -266,6 +1121,12 @@ private:
 
     void createSurface()
     {
+        CPU_ZONE("createSurface");
+        if (options.headlessSurface)
+        {
+            surface = instance.createHeadlessSurfaceEXT({});
+            return;
+        }
         VkSurfaceKHR _surface;
         if (glfwCreateWindowSurface(*instance, window, nullptr, &_surface) != 0)
         {
@@ -276,6 +1137,7 @@ private:
 
     void pickPhysicalDevice()
     {
+        CPU_ZONE("pickPhysicalDevice");
         std::vector<vk::raii::PhysicalDevice> devices =
             instance.enumeratePhysicalDevices();
         const auto devIter = std::ranges::find_if(
@@ -318,15 +1180,35 @@ private:
 
                 auto features = device.template getFeatures2<
                     vk::PhysicalDeviceFeatures2,
+                    vk::PhysicalDeviceVulkan12Features,
                     vk::PhysicalDeviceVulkan13Features,
                     vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
                 bool supportsRequiredFeatures =
+                    features.template get<vk::PhysicalDeviceVulkan12Features>()
+                        .timelineSemaphore &&
+                    supportsDescriptorIndexing(
+                        features.template get<vk::PhysicalDeviceFeatures2>()
+                            .features,
+                        features.template get<
+                            vk::PhysicalDeviceVulkan12Features>()) &&
                     features.template get<vk::PhysicalDeviceVulkan13Features>()
                         .dynamicRendering &&
                     features
                         .template get<
                             vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>()
                         .extendedDynamicState;
+                if (options.gpuCulling)
+                {
+                    supportsRequiredFeatures =
+                        supportsRequiredFeatures &&
+                        features.template get<vk::PhysicalDeviceFeatures2>()
+                            .features.multiDrawIndirect &&
+                        features.template get<vk::PhysicalDeviceFeatures2>()
+                            .features.drawIndirectFirstInstance &&
+                        features
+                            .template get<vk::PhysicalDeviceVulkan12Features>()
+                            .drawIndirectCount;
+                }
 
                 return supportsVulkan1_3 && supportsGraphics &&
                        supportsAllRequiredExtensions &&
@@ -344,6 +1226,7 @@ private:
 
     void createLogicalDevice()
     {
+        CPU_ZONE("createLogicalDevice");
         // find the index of the first queue family that supports graphics
         std::vector<vk::QueueFamilyProperties> queueFamilyProperties =
             physicalDevice.getQueueFamilyProperties();
@@ -363,38 +1246,43 @@ private:
         graphicsIndex = static_cast<uint32_t>(std::distance(
             queueFamilyProperties.begin(), graphicsQueueFamilyProperty));
 
-        auto presentIndex =
-            physicalDevice.getSurfaceSupportKHR(graphicsIndex, *surface)
-                ? graphicsIndex
-                : static_cast<uint32_t>(queueFamilyProperties.size());
-        if (presentIndex == queueFamilyProperties.size())
+        // without a surface the graphics queue stands in for presentation
+        uint32_t presentIndex = graphicsIndex;
+        if (!options.headless)
         {
-            for (size_t i = 0; i < queueFamilyProperties.size(); i++)
-            {
-                if ((queueFamilyProperties[i].queueFlags &
-                     vk::QueueFlagBits::eGraphics) &&
-                    physicalDevice.getSurfaceSupportKHR(
-                        static_cast<uint32_t>(i), *surface))
-                {
-                    graphicsIndex = static_cast<uint32_t>(i);
-                    presentIndex = graphicsIndex;
-                    break;
-                }
-            }
+            presentIndex =
+                physicalDevice.getSurfaceSupportKHR(graphicsIndex, *surface)
+                    ? graphicsIndex
+                    : static_cast<uint32_t>(queueFamilyProperties.size());
             if (presentIndex == queueFamilyProperties.size())
             {
-                // there's nothing like a single family index that supports both
-                // graphics and present -> look for another family index that
-                // supports present
                 for (size_t i = 0; i < queueFamilyProperties.size(); i++)
                 {
-                    if (physicalDevice.getSurfaceSupportKHR(
+                    if ((queueFamilyProperties[i].queueFlags &
+                         vk::QueueFlagBits::eGraphics) &&
+                        physicalDevice.getSurfaceSupportKHR(
                             static_cast<uint32_t>(i), *surface))
                     {
-                        presentIndex = static_cast<uint32_t>(i);
+                        graphicsIndex = static_cast<uint32_t>(i);
+                        presentIndex = graphicsIndex;
                         break;
                     }
                 }
+                if (presentIndex == queueFamilyProperties.size())
+                {
+                    // there's nothing like a single family index that
+                    // supports both graphics and present -> look for another
+                    // family index that supports present
+                    for (size_t i = 0; i < queueFamilyProperties.size(); i++)
+                    {
+                        if (physicalDevice.getSurfaceSupportKHR(
+                                static_cast<uint32_t>(i), *surface))
+                        {
+                            presentIndex = static_cast<uint32_t>(i);
+                            break;
+                        }
+                    }
+                }
             }
         }
         if ((graphicsIndex == queueFamilyProperties.size()) ||
@@ -404,54 +1292,217 @@ private:
                                      "present -> terminating");
         }
 
+        // Prefer a transfer-only family (a dedicated DMA engine) so uploads
+        // run beside graphics work, then any transfer family without
+        // graphics, and fall back to the graphics queue.
+        transferIndex = graphicsIndex;
+        int transferScore = 0;
+        for (size_t i = 0; i < queueFamilyProperties.size(); i++)
+        {
+            const vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+            if (!(flags & vk::QueueFlagBits::eTransfer) ||
+                (flags & vk::QueueFlagBits::eGraphics))
+            {
+                continue;
+            }
+            const int score = (flags & vk::QueueFlagBits::eCompute) ? 1 : 2;
+            if (score > transferScore)
+            {
+                transferIndex = static_cast<uint32_t>(i);
+                transferScore = score;
+            }
+        }
+
+        // Async compute wants a compute family without graphics, ideally not
+        // the one uploads already use.
+        computeIndex = graphicsIndex;
+        int computeScore = 0;
+        for (size_t i = 0; options.asyncCompute && i < queueFamilyProperties.size();
+             i++)
+        {
+            const vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+            if (!(flags & vk::QueueFlagBits::eCompute) ||
+                (flags & vk::QueueFlagBits::eGraphics))
+            {
+                continue;
+            }
+            const int score = i == transferIndex ? 1 : 2;
+            if (score > computeScore)
+            {
+                computeIndex = static_cast<uint32_t>(i);
+                computeScore = score;
+            }
+        }
+
         // query for Vulkan 1.3 features
         vk::StructureChain<vk::PhysicalDeviceFeatures2,
+                           vk::PhysicalDeviceVulkan12Features,
                            vk::PhysicalDeviceVulkan13Features,
-                           vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>
+                           vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+                           vk::PhysicalDevicePresentIdFeaturesKHR,
+                           vk::PhysicalDevicePresentWaitFeaturesKHR,
+                           vk::PhysicalDeviceMeshShaderFeaturesEXT>
             featureChain = {
-                {}, // vk::PhysicalDeviceFeatures2
+                { .features = { .shaderSampledImageArrayDynamicIndexing =
+                                    vk::True,
+                                .shaderStorageBufferArrayDynamicIndexing =
+                                    vk::True } }, // vk::PhysicalDeviceFeatures2
+                { .descriptorIndexing = vk::True,
+                  .descriptorBindingSampledImageUpdateAfterBind = vk::True,
+                  .descriptorBindingStorageBufferUpdateAfterBind = vk::True,
+                  .descriptorBindingUpdateUnusedWhilePending = vk::True,
+                  .descriptorBindingPartiallyBound = vk::True,
+                  .shaderSampledImageArrayNonUniformIndexing = vk::True,
+                  .runtimeDescriptorArray = vk::True,
+                  .timelineSemaphore =
+                      vk::True }, // vk::PhysicalDeviceVulkan12Features
                 { .synchronization2 = vk::True,
                   .dynamicRendering =
                       vk::True }, // vk::PhysicalDeviceVulkan13Features
                 { .extendedDynamicState = vk::
-                      True } // vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT
+                      True }, // vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT
+                { .presentId =
+                      vk::True }, // vk::PhysicalDevicePresentIdFeaturesKHR
+                { .presentWait =
+                      vk::True }, // vk::PhysicalDevicePresentWaitFeaturesKHR
+                { .taskShader = vk::True,
+                  .meshShader =
+                      vk::True } // vk::PhysicalDeviceMeshShaderFeaturesEXT
             };
+        // Streamed textures may be BC compressed; TextureStreamer rejects
+        // them on devices without the feature.
+        featureChain.get<vk::PhysicalDeviceFeatures2>()
+            .features.textureCompressionBC =
+            physicalDevice.getFeatures().textureCompressionBC;
+        if (options.gpuCulling)
+        {
+            featureChain.get<vk::PhysicalDeviceFeatures2>()
+                .features.multiDrawIndirect = vk::True;
+            // cull.slang writes each instance's index into firstInstance
+            featureChain.get<vk::PhysicalDeviceFeatures2>()
+                .features.drawIndirectFirstInstance = vk::True;
+            featureChain.get<vk::PhysicalDeviceVulkan12Features>()
+                .drawIndirectCount = vk::True;
+        }
 
-        // create a Device
+        // create a Device with one queue from each distinct family
         float queuePriority = 0.0f;
-        vk::DeviceQueueCreateInfo deviceQueueCreateInfo { .queueFamilyIndex =
-                                                              graphicsIndex,
-                                                          .queueCount = 1,
-                                                          .pQueuePriorities =
-                                                              &queuePriority };
+        std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
+        for (uint32_t family :
+             { graphicsIndex, presentIndex, transferIndex, computeIndex })
+        {
+            if (std::ranges::none_of(
+                    deviceQueueCreateInfos,
+                    [family](const auto& info)
+                    { return info.queueFamilyIndex == family; }))
+            {
+                deviceQueueCreateInfos.push_back(
+                    { .queueFamilyIndex = family,
+                      .queueCount = 1,
+                      .pQueuePriorities = &queuePriority });
+            }
+        }
+        std::vector<const char*> enabledExtensions = requiredDeviceExtension;
+        const std::vector<vk::ExtensionProperties> extensionProperties =
+            physicalDevice.enumerateDeviceExtensionProperties();
+        auto supports = [&](const char* name)
+        {
+            return std::ranges::any_of(
+                extensionProperties,
+                [name](const vk::ExtensionProperties& extension)
+                { return strcmp(extension.extensionName, name) == 0; });
+        };
+        // Optional: lets texture streaming respect the driver's budget.
+        memoryBudgetSupported = supports(vk::EXTMemoryBudgetExtensionName);
+        if (memoryBudgetSupported)
+        {
+            enabledExtensions.push_back(vk::EXTMemoryBudgetExtensionName);
+        }
+        // Optional: paces frames on the display and measures when they
+        // reach it.
+        if (!options.headless && supports(vk::KHRPresentIdExtensionName) &&
+            supports(vk::KHRPresentWaitExtensionName))
+        {
+            const auto presentFeatures = physicalDevice.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDevicePresentIdFeaturesKHR,
+                vk::PhysicalDevicePresentWaitFeaturesKHR>();
+            presentWaitSupported =
+                presentFeatures.get<vk::PhysicalDevicePresentIdFeaturesKHR>()
+                    .presentId &&
+                presentFeatures.get<vk::PhysicalDevicePresentWaitFeaturesKHR>()
+                    .presentWait;
+        }
+        if (presentWaitSupported)
+        {
+            enabledExtensions.push_back(vk::KHRPresentIdExtensionName);
+            enabledExtensions.push_back(vk::KHRPresentWaitExtensionName);
+        }
+        else
+        {
+            featureChain.unlink<vk::PhysicalDevicePresentIdFeaturesKHR>();
+            featureChain.unlink<vk::PhysicalDevicePresentWaitFeaturesKHR>();
+        }
+        // Optional: the vertex pipeline draws whatever mesh shaders cannot.
+        meshShadersSupported = options.meshShaders &&
+                               supports(vk::EXTMeshShaderExtensionName) &&
+                               MeshletRenderer::supported(physicalDevice);
+        if (meshShadersSupported)
+        {
+            enabledExtensions.push_back(vk::EXTMeshShaderExtensionName);
+        }
+        else
+        {
+            featureChain.unlink<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+            if (options.meshShaders)
+            {
+                std::cout << "mesh shaders are not supported, drawing with "
+                             "the vertex pipeline"
+                          << std::endl;
+            }
+        }
+
         vk::DeviceCreateInfo deviceCreateInfo {
             .pNext = &featureChain.get<vk::PhysicalDeviceFeatures2>(),
-            .queueCreateInfoCount = 1,
-            .pQueueCreateInfos = &deviceQueueCreateInfo,
+            .queueCreateInfoCount =
+                static_cast<uint32_t>(deviceQueueCreateInfos.size()),
+            .pQueueCreateInfos = deviceQueueCreateInfos.data(),
             .enabledExtensionCount =
-                static_cast<uint32_t>(requiredDeviceExtension.size()),
-            .ppEnabledExtensionNames = requiredDeviceExtension.data()
+                static_cast<uint32_t>(enabledExtensions.size()),
+            .ppEnabledExtensionNames = enabledExtensions.data()
         };
 
         device = vk::raii::Device(physicalDevice, deviceCreateInfo);
         graphicsQueue = vk::raii::Queue(device, graphicsIndex, 0);
         presentQueue = vk::raii::Queue(device, presentIndex, 0);
+        transferQueue = vk::raii::Queue(device, transferIndex, 0);
+        computeQueue = vk::raii::Queue(device, computeIndex, 0);
     }
 
-    void createSwapChain()
+    // oldSwapChain, when set, is retired by the new swapchain; its images
+    // already acquired stay valid until it is destroyed.
+    void createSwapChain(vk::SwapchainKHR oldSwapChain = nullptr)
     {
+        CPU_ZONE("createSwapChain");
         auto surfaceCapabilites =
             physicalDevice.getSurfaceCapabilitiesKHR(surface);
-        swapChainImageFormat = chooseSwapSurfaceFormat(
-            physicalDevice.getSurfaceFormatsKHR(surface));
         swapChainExtent = chooseSwapExtent(surfaceCapabilites);
-        auto minImageCount = std::max(3u, surfaceCapabilites.minImageCount);
-        minImageCount = (surfaceCapabilites.maxImageCount > 0 &&
-                         minImageCount > surfaceCapabilites.maxImageCount)
-                            ? surfaceCapabilites.maxImageCount
-                            : minImageCount;
-
-        uint32_t imageCount = surfaceCapabilites.minImageCount + 1;
+        if ((surfaceCapabilites.supportedUsageFlags & targetUsage()) !=
+            targetUsage())
+        {
+            throw std::runtime_error(
+                "surface does not support transfers with its images");
+        }
+        presentMode = chooseSwapPresentMode(
+            physicalDevice.getSurfacePresentModesKHR(surface),
+            oldSwapChain == nullptr);
+
+        uint32_t imageCount =
+            options.swapchainImages != 0
+                ? options.swapchainImages
+                : surfaceCapabilites.minImageCount +
+                      presentPolicy().extraImages;
+        imageCount = std::max(imageCount, surfaceCapabilites.minImageCount);
         if (surfaceCapabilites.maxImageCount > 0 &&
             imageCount > surfaceCapabilites.maxImageCount)
         {
@@ -460,26 +1511,66 @@ private:
         vk::SwapchainCreateInfoKHR swapChainCreateInfo {
             .flags = vk::SwapchainCreateFlagsKHR(),
             .surface = surface,
-            .minImageCount = minImageCount,
+            .minImageCount = imageCount,
             .imageFormat = swapChainImageFormat,
             .imageColorSpace = vk::ColorSpaceKHR::eSrgbNonlinear,
             .imageExtent = swapChainExtent,
             .imageArrayLayers = 1,
-            .imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
+            .imageUsage = targetUsage(),
             .imageSharingMode = vk::SharingMode::eExclusive,
             .preTransform = surfaceCapabilites.currentTransform,
             .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
-            .presentMode = chooseSwapPresentMode(
-                physicalDevice.getSurfacePresentModesKHR(surface)),
-            .clipped = vk::True
+            .presentMode = presentMode,
+            .clipped = vk::True,
+            .oldSwapchain = oldSwapChain
         };
 
         swapChain = vk::raii::SwapchainKHR(device, swapChainCreateInfo);
         swapChainImages = swapChain.getImages();
+        if (oldSwapChain == nullptr)
+        {
+            std::cout << "presenting with " << vk::to_string(presentMode)
+                      << ", " << swapChainImages.size() << " images"
+                      << (presentWaitSupported ? ", present wait" : "")
+                      << std::endl;
+        }
+    }
+
+    void createOffscreenImages()
+    {
+        CPU_ZONE("createOffscreenImages");
+        swapChainExtent = vk::Extent2D { options.width, options.height };
+
+        swapChainImages.clear();
+        offscreenImages.clear();
+
+        vk::ImageCreateInfo imageInfo {
+            .imageType = vk::ImageType::e2D,
+            .format = swapChainImageFormat,
+            .extent = { swapChainExtent.width, swapChainExtent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = targetUsage(),
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        };
+
+        // One target per frame in flight: the frame's fence then also guards
+        // reuse of its image, the job the acquire semaphore does for a
+        // swapchain.
+        for (size_t i = 0; i < maxFramesInFlight; i++)
+        {
+            offscreenImages.push_back(allocator.createImage(
+                imageInfo, vk::MemoryPropertyFlagBits::eDeviceLocal));
+            swapChainImages.push_back(*offscreenImages.back().image);
+        }
     }
 
     void createImageViews()
     {
+        CPU_ZONE("createImageViews");
         swapChainImageViews.clear();
 
         vk::ImageViewCreateInfo imageViewCreateInfo {
@@ -495,28 +1586,218 @@ private:
         }
     }
 
-    void createGraphicsPipeline()
+    void createAllocator()
     {
-        vk::raii::ShaderModule shaderModule =
-            createShaderModule(readFile(SHADER_DIR "slang.spv"));
+        CPU_ZONE("createAllocator");
+        allocator.init(physicalDevice, device);
+        renderGraph.init(device, allocator);
+    }
 
-        vk::PipelineShaderStageCreateInfo vertShaderStageInfo {
-            .stage = vk::ShaderStageFlagBits::eVertex,
-            .module = shaderModule,
-            .pName = "vertMain"
-        };
-        vk::PipelineShaderStageCreateInfo fragShaderStageInfo {
-            .stage = vk::ShaderStageFlagBits::eFragment,
-            .module = shaderModule,
-            .pName = "fragMain"
-        };
-        vk::PipelineShaderStageCreateInfo shaderStages[] = {
-            vertShaderStageInfo, fragShaderStageInfo
-        };
+    // Features DescriptorHeap relies on. Shaders index the heap's arrays with
+    // push constants, which needs the core dynamic indexing features.
+    static bool supportsDescriptorIndexing(
+        const vk::PhysicalDeviceFeatures& coreFeatures,
+        const vk::PhysicalDeviceVulkan12Features& features)
+    {
+        return coreFeatures.shaderSampledImageArrayDynamicIndexing &&
+               coreFeatures.shaderStorageBufferArrayDynamicIndexing &&
+               features.descriptorIndexing &&
+               features.descriptorBindingSampledImageUpdateAfterBind &&
+               features.descriptorBindingStorageBufferUpdateAfterBind &&
+               features.descriptorBindingUpdateUnusedWhilePending &&
+               features.descriptorBindingPartiallyBound &&
+               features.shaderSampledImageArrayNonUniformIndexing &&
+               features.runtimeDescriptorArray;
+    }
 
-        vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
-        vk::PipelineInputAssemblyStateCreateInfo inputAssembly {
-            .topology = vk::PrimitiveTopology::eTriangleList
+    void createDescriptorHeap()
+    {
+        CPU_ZONE("createDescriptorHeap");
+        descriptorHeap.init(physicalDevice, device);
+    }
+
+    void createPipelineCache()
+    {
+        CPU_ZONE("createPipelineCache");
+        pipelineCache.load(physicalDevice, device);
+    }
+
+    // Map the SPIR-V the startup pipelines are built from. Mapped files, only
+    // used with --shader-dir, are prefetched here, so the disk read starts
+    // off the render thread rather than inside vkCreateShaderModule.
+    void loadShaders()
+    {
+        graphicsShaderCode =
+            shaderCode("slang.spv", SLANG_SPV, graphicsShaderFile);
+        if (options.gpuCulling)
+        {
+            cullShaderCode = shaderCode("cull.spv", CULL_SPV, cullShaderFile);
+        }
+        if (options.particleCount != 0)
+        {
+            particleShaderCode =
+                shaderCode("particles.spv", PARTICLES_SPV, particleShaderFile);
+        }
+        if (options.meshShaders)
+        {
+            meshletShaderCode =
+                shaderCode("meshlets.spv", MESHLETS_SPV, meshletShaderFile);
+        }
+        if (!options.meshPath.empty())
+        {
+            quantizedShaderCode = shaderCode(
+                "quantized.spv", QUANTIZED_SPV, quantizedShaderFile);
+        }
+        for (const MappedFile* file : { &graphicsShaderFile,
+                                        &cullShaderFile,
+                                        &particleShaderFile,
+                                        &meshletShaderFile,
+                                        &quantizedShaderFile })
+        {
+            file->prefetch();
+        }
+    }
+
+    // The color format pipelines are built for, known before the swapchain
+    // exists. Offscreen targets use the format chooseSwapSurfaceFormat
+    // prefers, so headless output matches what a window shows. Kept across
+    // swapchain recreation, which the pipelines depend on.
+    void chooseRenderFormat()
+    {
+        swapChainImageFormat =
+            options.headless ? vk::Format::eB8G8R8A8Srgb
+                             : chooseSwapSurfaceFormat(
+                                   physicalDevice.getSurfaceFormatsKHR(surface));
+        if (!dynamicResolution())
+        {
+            return;
+        }
+        const vk::FormatFeatureFlags features =
+            physicalDevice.getFormatProperties(swapChainImageFormat)
+                .optimalTilingFeatures;
+        if (!(features & vk::FormatFeatureFlagBits::eBlitSrc) ||
+            !(features & vk::FormatFeatureFlagBits::eBlitDst))
+        {
+            throw std::runtime_error(
+                "--frame-budget needs a render format that supports blits");
+        }
+        upscaleFilter =
+            features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear
+                ? vk::Filter::eLinear
+                : vk::Filter::eNearest;
+    }
+
+    void createPipelineLayout()
+    {
+        vk::PushConstantRange pushConstantRange {
+            .stageFlags = vk::ShaderStageFlagBits::eVertex |
+                          vk::ShaderStageFlagBits::eFragment,
+            .offset = 0,
+            .size = sizeof(ViewConstants)
+        };
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo {
+            .setLayoutCount = 1,
+            .pSetLayouts = &*descriptorHeap.layout(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange
+        };
+        pipelineLayout = vk::raii::PipelineLayout(device, pipelineLayoutInfo);
+    }
+
+    // Runs on a worker during startup, beside the render thread's steps.
+    void createGraphicsPipeline()
+    {
+        CPU_ZONE("createGraphicsPipeline");
+        vk::PipelineCreationFeedback pipelineFeedback;
+        graphicsPipeline =
+            buildGraphicsPipeline(graphicsShaderCode, pipelineFeedback);
+        pipelineCache.recordFeedback("graphics pipeline", pipelineFeedback);
+    }
+
+    // Build the graphics pipeline from SPIR-V containing vertMain and
+    // fragMain. A loaded mesh replaces vertMain with quantizedVertMain.
+    // Only reads state that is fixed after startup, so shader reloads call
+    // it from worker threads.
+    [[nodiscard]] vk::raii::Pipeline
+    buildGraphicsPipeline(std::span<const uint32_t> code,
+                          vk::PipelineCreationFeedback& pipelineFeedback) const
+    {
+        vk::raii::ShaderModule shaderModule = createShaderModule(code);
+        const bool meshLoaded = !options.meshPath.empty();
+        vk::raii::ShaderModule quantizedModule =
+            meshLoaded ? createShaderModule(quantizedShaderCode) : nullptr;
+
+        const vk::Bool32 octahedralNormals =
+            options.vertexFormat != VertexFormat::Float;
+        const vk::SpecializationMapEntry specializationEntry {
+            .constantID = 0, .offset = 0, .size = sizeof(vk::Bool32)
+        };
+        const vk::SpecializationInfo specializationInfo {
+            .mapEntryCount = 1,
+            .pMapEntries = &specializationEntry,
+            .dataSize = sizeof(octahedralNormals),
+            .pData = &octahedralNormals
+        };
+        vk::PipelineShaderStageCreateInfo vertShaderStageInfo {
+            .stage = vk::ShaderStageFlagBits::eVertex,
+            .module = meshLoaded ? *quantizedModule : *shaderModule,
+            .pName = meshLoaded ? "quantizedVertMain" : "vertMain",
+            .pSpecializationInfo = meshLoaded ? &specializationInfo : nullptr
+        };
+        vk::PipelineShaderStageCreateInfo fragShaderStageInfo {
+            .stage = vk::ShaderStageFlagBits::eFragment,
+            .module = shaderModule,
+            .pName = "fragMain"
+        };
+        vk::PipelineShaderStageCreateInfo shaderStages[] = {
+            vertShaderStageInfo, fragShaderStageInfo
+        };
+
+        std::vector bindingDescriptions = { Vertex::getBindingDescription() };
+        std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
+        if (meshLoaded)
+        {
+            const VertexLayout layout =
+                VertexQuantizer::layout(options.vertexFormat);
+            const VertexFormatInfo& formats =
+                *std::ranges::find(VERTEX_FORMATS,
+                                   options.vertexFormat,
+                                   &VertexFormatInfo::format);
+            bindingDescriptions[0].stride = layout.stride;
+            attributeDescriptions = {
+                { .location = 0,
+                  .binding = 0,
+                  .format = formats.position,
+                  .offset = 0 },
+                { .location = 1,
+                  .binding = 0,
+                  .format = formats.normal,
+                  .offset = layout.normalOffset },
+                { .location = UV_LOCATION,
+                  .binding = 0,
+                  .format = formats.uv,
+                  .offset = layout.uvOffset },
+            };
+        }
+        else
+        {
+            std::ranges::copy(Vertex::getAttributeDescriptions(),
+                              std::back_inserter(attributeDescriptions));
+        }
+        std::ranges::copy(InstanceStreams::getBindingDescriptions(),
+                          std::back_inserter(bindingDescriptions));
+        std::ranges::copy(InstanceStreams::getAttributeDescriptions(),
+                          std::back_inserter(attributeDescriptions));
+        vk::PipelineVertexInputStateCreateInfo vertexInputInfo {
+            .vertexBindingDescriptionCount =
+                static_cast<uint32_t>(bindingDescriptions.size()),
+            .pVertexBindingDescriptions = bindingDescriptions.data(),
+            .vertexAttributeDescriptionCount =
+                static_cast<uint32_t>(attributeDescriptions.size()),
+            .pVertexAttributeDescriptions = attributeDescriptions.data()
+        };
+        vk::PipelineInputAssemblyStateCreateInfo inputAssembly {
+            .topology = vk::PrimitiveTopology::eTriangleList
         };
         vk::PipelineViewportStateCreateInfo viewportState { .viewportCount = 1,
                                                             .scissorCount = 1 };
@@ -558,10 +1839,11 @@ private:
             .pDynamicStates = dynamicStates.data()
         };
 
-        vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-        pipelineLayout = vk::raii::PipelineLayout(device, pipelineLayoutInfo);
-
+        vk::PipelineCreationFeedbackCreateInfo feedbackCreateInfo {
+            .pPipelineCreationFeedback = &pipelineFeedback
+        };
         vk::PipelineRenderingCreateInfo pipelineRederingCreateInfo {
+            .pNext = &feedbackCreateInfo,
             .colorAttachmentCount = 1,
             .pColorAttachmentFormats = &swapChainImageFormat
         };
@@ -581,322 +1863,1875 @@ private:
             .renderPass = nullptr
         };
 
-        graphicsPipeline = vk::raii::Pipeline(device, nullptr, pipelineInfo);
+        return vk::raii::Pipeline(device, pipelineCache.get(), pipelineInfo);
     }
 
-    void createCommandPool()
+    void createCommandPools()
     {
+        CPU_ZONE("createCommandPools");
         vk::CommandPoolCreateInfo poolInfo {
-            .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+            .flags = vk::CommandPoolCreateFlagBits::eTransient,
             .queueFamilyIndex = graphicsIndex
         };
 
-        commandPool = vk::raii::CommandPool(device, poolInfo);
+        commandPools.clear();
+        for (uint32_t i = 0; i < maxFramesInFlight; i++)
+        {
+            commandPools.emplace_back(device, poolInfo);
+        }
     }
 
-    void createCommandBuffers()
+    void createUploader()
     {
-        commandBuffers.clear();
-        vk::CommandBufferAllocateInfo allocInfo {
-            .commandPool = commandPool,
-            .level = vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = MAX_FRAMES_IN_FLIGHT
-        };
-        commandBuffers = vk::raii::CommandBuffers(device, allocInfo);
+        CPU_ZONE("createUploader");
+        uploader.init(device,
+                      allocator,
+                      transferQueue,
+                      transferIndex,
+                      graphicsIndex,
+                      StagingUploader::DEFAULT_RING_SIZE,
+                      &queueMutex);
     }
 
-    void createSyncObjects()
+    // Device-local buffer filled through the staging ring. It is left owned
+    // by the transfer queue family; the first frame acquires it.
+    AllocatedBuffer createDeviceLocalBuffer(const void* data,
+                                            vk::DeviceSize size,
+                                            vk::BufferUsageFlags usage,
+                                            vk::PipelineStageFlags2 dstStage,
+                                            vk::AccessFlags2 dstAccess)
     {
-        presentCompleteSemaphores.clear();
-        renderFinishedSemaphores.clear();
-        inFlightFences.clear();
-
-        for (size_t i = 0; i < swapChainImages.size(); i++)
-        {
-            presentCompleteSemaphores.emplace_back(
-                vk::raii::Semaphore(device, vk::SemaphoreCreateInfo()));
-            renderFinishedSemaphores.emplace_back(
-                vk::raii::Semaphore(device, vk::SemaphoreCreateInfo()));
-        }
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        {
-            inFlightFences.emplace_back(vk::raii::Fence(
-                device, { .flags = vk::FenceCreateFlagBits::eSignaled }));
-        }
+        AllocatedBuffer buffer = allocator.createBuffer(
+            vk::BufferCreateInfo {
+                .size = size,
+                .usage = usage | vk::BufferUsageFlagBits::eTransferDst,
+                .sharingMode = vk::SharingMode::eExclusive },
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        uploader.uploadBuffer(
+            *buffer.buffer, 0, data, size, dstStage, dstAccess);
+        return buffer;
     }
 
-    void recordCommandBuffer(uint32_t imageIndex)
+    void createVertexBuffer()
     {
-        commandBuffers[currentFrame].begin({});
-
-        transition_image_layout(
-            imageIndex,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::eColorAttachmentOptimal,
-            {},
-            vk::AccessFlagBits2::eColorAttachmentWrite,
-            vk::PipelineStageFlagBits2::eTopOfPipe,
-            vk::PipelineStageFlagBits2::eColorAttachmentOutput);
+        CPU_ZONE("createVertexBuffer");
+        // mesh shaders fetch vertices as a storage buffer
+        const bool loaded = !options.meshPath.empty();
+        vertexBuffer = createDeviceLocalBuffer(
+            loaded ? static_cast<const void*>(loadedMesh.vertices.data())
+                   : vertices.data(),
+            loaded ? loadedMesh.vertices.size()
+                   : sizeof(vertices[0]) * vertices.size(),
+            vk::BufferUsageFlagBits::eVertexBuffer |
+                vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::PipelineStageFlagBits2::eVertexAttributeInput |
+                meshShaderStages(),
+            vk::AccessFlagBits2::eVertexAttributeRead |
+                vk::AccessFlagBits2::eShaderStorageRead);
+    }
 
-        vk::ClearValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
-        vk::RenderingAttachmentInfo attachmentInfo = {
-            .imageView = swapChainImageViews[imageIndex],
-            .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
-            .loadOp = vk::AttachmentLoadOp::eClear,
-            .storeOp = vk::AttachmentStoreOp::eStore,
-            .clearValue = clearColor
-        };
+    void createIndexBuffer()
+    {
+        CPU_ZONE("createIndexBuffer");
+        indexBuffer = createDeviceLocalBuffer(
+            indices.data(),
+            sizeof(indices[0]) * indices.size(),
+            vk::BufferUsageFlagBits::eIndexBuffer,
+            vk::PipelineStageFlagBits2::eIndexInput,
+            vk::AccessFlagBits2::eIndexRead);
+    }
 
-        vk::RenderingInfo renderingInfo = {
-            .renderArea = { .offset = { 0, 0 }, .extent = swapChainExtent },
-            .layerCount = 1,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &attachmentInfo
+    void createMeshletBuffers()
+    {
+        CPU_ZONE("createMeshletBuffers");
+        auto upload = [this](const auto& data)
+        {
+            return createDeviceLocalBuffer(
+                data.data(),
+                sizeof(data[0]) * data.size(),
+                vk::BufferUsageFlagBits::eStorageBuffer,
+                meshShaderStages(),
+                vk::AccessFlagBits2::eShaderStorageRead);
         };
+        meshletBuffer = upload(meshlets.meshlets);
+        meshletVertexBuffer = upload(meshlets.vertices);
+        meshletTriangleBuffer = upload(meshlets.triangles);
+    }
 
-        commandBuffers[currentFrame].beginRendering(renderingInfo);
-
-        commandBuffers[currentFrame].bindPipeline(
-            vk::PipelineBindPoint::eGraphics, graphicsPipeline);
-
-        commandBuffers[currentFrame].setViewport(
-            0,
-            vk::Viewport(0.0f,
-                         0.0f,
-                         static_cast<float>(swapChainExtent.width),
-                         static_cast<float>(swapChainExtent.height),
-                         0.0f,
-                         1.0f));
-        commandBuffers[currentFrame].setScissor(
-            0, vk::Rect2D(vk::Offset2D(0, 0), swapChainExtent));
+    // Task and mesh shader stages when they are enabled, for barriers and
+    // waits that also cover the vertex pipeline.
+    vk::PipelineStageFlags2 meshShaderStages() const
+    {
+        return meshShadersSupported
+                   ? vk::PipelineStageFlagBits2::eTaskShaderEXT |
+                         vk::PipelineStageFlagBits2::eMeshShaderEXT
+                   : vk::PipelineStageFlags2 {};
+    }
 
-        commandBuffers[currentFrame].draw(3, 1, 0, 0);
+    void createInstanceBuffers()
+    {
+        CPU_ZONE("createInstanceBuffers");
+        instances.reset(options.instanceCount);
+        const vk::DeviceSize streamSize = sizeof(float) * instances.size();
+
+        // Scale and color share one device-local buffer, color stream last.
+        std::vector<std::byte> staticStreams(2 * streamSize);
+        std::memcpy(staticStreams.data(), instances.scales().data(),
+                    streamSize);
+        std::memcpy(staticStreams.data() + streamSize,
+                    instances.colors().data(), streamSize);
+        // The cull pass and mesh shaders read them as a storage buffer.
+        instanceStaticBuffer = createDeviceLocalBuffer(
+            staticStreams.data(),
+            staticStreams.size(),
+            vk::BufferUsageFlagBits::eVertexBuffer |
+                vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::PipelineStageFlagBits2::eVertexAttributeInput |
+                vk::PipelineStageFlagBits2::eComputeShader |
+                meshShaderStages(),
+            vk::AccessFlagBits2::eVertexAttributeRead |
+                vk::AccessFlagBits2::eShaderStorageRead);
+        // vertex, index and instance data go out as a single batch
+        uploader.flush();
+
+        // Written every frame, so the GPU reads them straight from host
+        // visible memory, device-local where the device allows it.
+        instanceBuffers.clear();
+        for (uint32_t i = 0; i < maxFramesInFlight; i++)
+        {
+            instanceBuffers.push_back(allocator.createBuffer(
+                vk::BufferCreateInfo {
+                    .size = 3 * streamSize,
+                    .usage = vk::BufferUsageFlagBits::eVertexBuffer |
+                             vk::BufferUsageFlagBits::eStorageBuffer,
+                    .sharingMode = vk::SharingMode::eExclusive },
+                vk::MemoryPropertyFlagBits::eHostVisible,
+                vk::MemoryPropertyFlagBits::eDeviceLocal));
+        }
+        lastInstanceUpdate = std::chrono::steady_clock::now();
+    }
 
-        commandBuffers[currentFrame].endRendering();
+    void createTextureStreamer()
+    {
+        CPU_ZONE("createTextureStreamer");
+        std::vector<std::filesystem::path> paths;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(options.textureDir))
+        {
+            const std::filesystem::path extension = entry.path().extension();
+            if (entry.is_regular_file() &&
+                (extension == ".ktx2" || extension == ".dds"))
+            {
+                paths.push_back(entry.path());
+            }
+        }
+        if (paths.empty())
+        {
+            throw std::runtime_error("no .ktx2 or .dds textures in " +
+                                     options.textureDir);
+        }
+        std::ranges::sort(paths);
+
+        textureStreamer.init(
+            physicalDevice,
+            device,
+            allocator,
+            descriptorHeap,
+            transferQueue,
+            transferIndex,
+            graphicsIndex,
+            queueMutex,
+            maxFramesInFlight,
+            static_cast<uint32_t>(paths.size()),
+            memoryBudgetSupported,
+            static_cast<vk::DeviceSize>(options.textureBudgetMiB) << 20);
+        for (const std::filesystem::path& path : paths)
+        {
+            textureStreamer.add(path);
+        }
+        std::cout << "streaming " << paths.size() << " textures from "
+                  << options.textureDir << std::endl;
+    }
 
-        transition_image_layout(
-            imageIndex,
-            vk::ImageLayout::eColorAttachmentOptimal,
-            vk::ImageLayout::ePresentSrcKHR,
-            vk::AccessFlagBits2::eColorAttachmentWrite,         // srcAccessMask
-            {},                                                 // dstAccessMask
-            vk::PipelineStageFlagBits2::eColorAttachmentOutput, // srcStage
-            vk::PipelineStageFlagBits2::eBottomOfPipe           // dstStage
-        );
+    uint32_t textureOffset() const
+    {
+        return static_cast<uint32_t>(frameNumber / TEXTURE_PAGE_FRAMES %
+                                     textureStreamer.size());
+    }
 
-        commandBuffers[currentFrame].end();
+    // Request every texture an instance samples at the instances' on-screen
+    // size, then publish and schedule streaming work.
+    void updateTextures()
+    {
+        const uint32_t count = textureStreamer.size();
+        const uint32_t used = static_cast<uint32_t>(
+            std::min<size_t>(count, instances.size()));
+        // Clip space spans the height in two units.
+        const float pixels = meshRadius *
+                             instances.scales().front() * options.zoom *
+                             static_cast<float>(swapChainExtent.height) *
+                             resolutionScaler.scale();
+        for (uint32_t i = 0; i < used; i++)
+        {
+            textureStreamer.request((i + textureOffset()) % count, pixels);
+        }
+        textureStreamer.update(threadPool, frameNumber, frameDeletionQueue);
+        textureStreamer.writeTable(currentFrame);
     }
 
-    void transition_image_layout(uint32_t imageIndex, vk::ImageLayout oldLayout,
-                                 vk::ImageLayout newLayout,
-                                 vk::AccessFlags2 srcAccessMask,
-                                 vk::AccessFlags2 dstAccessMask,
-                                 vk::PipelineStageFlags2 srcStageMask,
-                                 vk::PipelineStageFlags2 dstStageMask)
-    {
-        vk::ImageMemoryBarrier2 barrier = {
-            .srcStageMask = srcStageMask,
-            .srcAccessMask = srcAccessMask,
-            .dstStageMask = dstStageMask,
-            .dstAccessMask = dstAccessMask,
-            .oldLayout = oldLayout,
-            .newLayout = newLayout,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = swapChainImages[imageIndex],
-            .subresourceRange = { .aspectMask = vk::ImageAspectFlagBits::eColor,
-                                  .baseMipLevel = 0,
-                                  .levelCount = 1,
-                                  .baseArrayLayer = 0,
-                                  .layerCount = 1 }
-        };
-        vk::DependencyInfo dependencyInfo = { .dependencyFlags = {},
-                                              .imageMemoryBarrierCount = 1,
-                                              .pImageMemoryBarriers =
-                                                  &barrier };
-        commandBuffers[currentFrame].pipelineBarrier2(dependencyInfo);
+    void createCuller()
+    {
+        CPU_ZONE("createCuller");
+        vk::raii::ShaderModule shaderModule =
+            createShaderModule(cullShaderCode);
+        culler.init(device,
+                    allocator,
+                    descriptorHeap,
+                    pipelineCache,
+                    shaderModule,
+                    static_cast<uint32_t>(instances.size()),
+                    physicalDevice.getProperties().limits.maxDrawIndirectCount,
+                    instanceBuffers,
+                    instanceStaticBuffer);
     }
 
-    void drawFrame()
+    void createParticles()
     {
-        // while (vk::Result::eTimeout ==
-        //        device.waitForFences(
-        //            *inFlightFences[currentFrame], vk::True, UINT64_MAX))
-        //     ;
-        presentQueue.waitIdle();
+        CPU_ZONE("createParticles");
+        vk::raii::ShaderModule shaderModule =
+            createShaderModule(particleShaderCode);
+        const bool async = computeIndex != graphicsIndex;
+        particles.init(physicalDevice,
+                       device,
+                       allocator,
+                       descriptorHeap,
+                       pipelineCache,
+                       shaderModule,
+                       swapChainImageFormat,
+                       options.particleCount,
+                       maxFramesInFlight,
+                       gpuTimer,
+                       async ? &computeQueue : nullptr,
+                       computeIndex,
+                       graphicsIndex,
+                       &queueMutex);
+    }
 
-        auto [result, imageIndex] = swapChain.acquireNextImage(
-            UINT64_MAX, *presentCompleteSemaphores[semaphoreIndex], nullptr);
-        if (result == vk::Result::eErrorOutOfDateKHR)
+    // Tessellate TRIANGLE into options.meshDetail rows. Row r holds r + 1
+    // vertices and the triangles between rows keep the corners' winding.
+    void createMesh()
+    {
+        CPU_ZONE("createMesh");
+        if (!options.meshPath.empty())
         {
-            recreateSwapChain();
+            loadMesh();
             return;
         }
-        if (result != vk::Result::eSuccess &&
-            result != vk::Result::eSuboptimalKHR)
+        const uint32_t detail = options.meshDetail;
+        vertices.clear();
+        vertices.reserve((detail + 1) * (detail + 2) / 2);
+        for (uint32_t row = 0; row <= detail; row++)
         {
-            throw std::runtime_error("failed to acquire swap chain image!");
+            for (uint32_t column = 0; column <= row; column++)
+            {
+                const float weights[3] = {
+                    static_cast<float>(detail - row) / detail,
+                    static_cast<float>(row - column) / detail,
+                    static_cast<float>(column) / detail
+                };
+                Vertex vertex {};
+                for (uint32_t corner = 0; corner < 3; corner++)
+                {
+                    for (uint32_t i = 0; i < 2; i++)
+                    {
+                        vertex.pos[i] +=
+                            weights[corner] * TRIANGLE[corner].pos[i];
+                    }
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        vertex.color[i] +=
+                            weights[corner] * TRIANGLE[corner].color[i];
+                    }
+                }
+                vertices.push_back(vertex);
+            }
         }
 
-        device.resetFences(*inFlightFences[currentFrame]);
-        commandBuffers[currentFrame].reset();
-        recordCommandBuffer(imageIndex);
-
-        vk::PipelineStageFlags waitDestinationStageMask(
-            vk::PipelineStageFlagBits::eColorAttachmentOutput);
-        const vk::SubmitInfo submitInfo {
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &*presentCompleteSemaphores[semaphoreIndex],
-            .pWaitDstStageMask = &waitDestinationStageMask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*commandBuffers[currentFrame],
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &*renderFinishedSemaphores[imageIndex]
-        };
-        graphicsQueue.submit(submitInfo, *inFlightFences[currentFrame]);
-
-        const vk::PresentInfoKHR presentInfoKHR {
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &*renderFinishedSemaphores[imageIndex],
-            .swapchainCount = 1,
-            .pSwapchains = &*swapChain,
-            .pImageIndices = &imageIndex
-        };
-        result = presentQueue.presentKHR(presentInfoKHR);
-        if (result == vk::Result::eErrorOutOfDateKHR ||
-            result == vk::Result::eSuboptimalKHR || frameBufferResized)
+        auto rowStart = [](uint32_t row) { return row * (row + 1) / 2; };
+        indices.clear();
+        indices.reserve(3 * static_cast<size_t>(detail) * detail);
+        for (uint32_t row = 0; row < detail; row++)
         {
-            frameBufferResized = false;
-            recreateSwapChain();
+            const uint32_t top = rowStart(row);
+            const uint32_t bottom = rowStart(row + 1);
+            for (uint32_t column = 0; column <= row; column++)
+            {
+                indices.insert(indices.end(),
+                               { top + column, bottom + column,
+                                 bottom + column + 1 });
+                if (column < row)
+                {
+                    indices.insert(indices.end(),
+                                   { top + column, bottom + column + 1,
+                                     top + column + 1 });
+                }
+            }
         }
-        else if (result != vk::Result::eSuccess)
+
+        meshRadius = 0.0f;
+        for (const Vertex& vertex : TRIANGLE)
         {
-            throw std::runtime_error("failed to present swap chain image!");
+            meshRadius =
+                std::max(meshRadius, std::hypot(vertex.pos[0], vertex.pos[1]));
         }
-        semaphoreIndex =
-            (semaphoreIndex + 1) % presentCompleteSemaphores.size();
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
-    [[nodiscard]] vk::raii::ShaderModule
-    createShaderModule(const std::vector<char>& code) const
+    // Load options.meshPath on threadPool, reorder it for the vertex cache
+    // and fetch, and pack the vertices in options.vertexFormat.
+    void loadMesh()
     {
-        vk::ShaderModuleCreateInfo createInfo {
-            .codeSize = code.size() * sizeof(char),
-            .pCode = reinterpret_cast<const uint32_t*>(code.data())
-        };
-        vk::raii::ShaderModule shaderModule { device, createInfo };
-
-        return shaderModule;
+        const auto start = std::chrono::steady_clock::now();
+        MeshData mesh = MeshLoader::load(options.meshPath, threadPool);
+        const auto loaded = std::chrono::steady_clock::now();
+
+        const double acmrBefore =
+            VertexOptimizer::acmr(mesh.indices, mesh.vertexCount());
+        VertexOptimizer::optimizeVertexCache(mesh.indices, mesh.vertexCount());
+        const double acmrAfter =
+            VertexOptimizer::acmr(mesh.indices, mesh.vertexCount());
+        uint32_t usedCount = 0;
+        const std::vector<uint32_t> remap =
+            VertexOptimizer::optimizeVertexFetch(
+                mesh.indices, mesh.vertexCount(), usedCount);
+        mesh.positions = VertexOptimizer::remapStream<float>(
+            mesh.positions, 3, remap, usedCount);
+        mesh.normals = VertexOptimizer::remapStream<float>(
+            mesh.normals, 3, remap, usedCount);
+        mesh.uvs =
+            VertexOptimizer::remapStream<float>(mesh.uvs, 2, remap, usedCount);
+        loadedMesh =
+            VertexQuantizer::quantize(mesh, options.vertexFormat, threadPool);
+        indices = std::move(mesh.indices);
+        // quantized.slang draws the normalized mesh at half size
+        meshRadius = 0.5f * loadedMesh.radius;
+
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        const Milliseconds loadTime = loaded - start;
+        const Milliseconds totalTime = std::chrono::steady_clock::now() - start;
+        const double millionTriangles =
+            static_cast<double>(indices.size() / 3) / 1e6;
+        const uint32_t stride = loadedMesh.layout.stride;
+        const uint32_t floatStride =
+            VertexQuantizer::layout(VertexFormat::Float).stride;
+        std::cout << "mesh: " << indices.size() / 3 << " triangles, "
+                  << usedCount << " vertices from " << options.meshPath
+                  << " in " << totalTime.count() << " ms ("
+                  << loadTime.count() / millionTriangles
+                  << " ms per million triangles to parse, "
+                  << totalTime.count() / millionTriangles << " total)"
+                  << std::endl;
+        // Every cache miss fetches one vertex.
+        std::cout << "mesh: ACMR " << acmrBefore << " -> " << acmrAfter
+                  << ", " << stride << " bytes per vertex (" << floatStride
+                  << " as float), ~"
+                  << acmrAfter * static_cast<double>(indices.size() / 3) *
+                         stride / 1024.0
+                  << " KiB vertex fetch per instance" << std::endl;
     }
 
-    std::vector<const char*> getRequiredExtensions()
+    // Load the meshlets saved for this mesh, or build them on threadPool and
+    // save them for the next start.
+    void createMeshlets()
     {
-        uint32_t glfwExtensionCount = 0;
-        auto glfwExtensions =
-            glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector extensions(glfwExtensions,
-                               glfwExtensions + glfwExtensionCount);
-        if (enableValidationLayers)
+        CPU_ZONE("createMeshlets");
+        std::vector<float> positions;
+        positions.reserve(3 * vertices.size());
+        for (const Vertex& vertex : vertices)
         {
-            extensions.push_back(vk::EXTDebugUtilsExtensionName);
+            positions.insert(positions.end(),
+                             { vertex.pos[0], vertex.pos[1], 0.0f });
+        }
+        const uint64_t sourceHash = MeshletBuilder::hash(indices, positions);
+        if (!options.meshletCachePath.empty())
+        {
+            std::string reason;
+            if (std::optional<MeshletMesh> loaded =
+                    MeshletMesh::load(options.meshletCachePath,
+                                      sourceHash,
+                                      vertices.size(),
+                                      reason))
+            {
+                meshlets = std::move(*loaded);
+                std::cout << "meshlets: loaded " << meshlets.meshlets.size()
+                          << " from " << options.meshletCachePath
+                          << std::endl;
+                return;
+            }
+            std::cout << "meshlets: rebuilding (" << reason << ")"
+                      << std::endl;
         }
 
-#ifdef __APPLE__
-        extensions.push_back(vk::KHRGetPhysicalDeviceProperties2ExtensionName);
-        extensions.push_back(vk::KHRPortabilityEnumerationExtensionName);
-#endif
-
-        return extensions;
+        const auto start = std::chrono::steady_clock::now();
+        meshlets = MeshletBuilder::build(indices, positions, threadPool);
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << "meshlets: built " << meshlets.meshlets.size()
+                  << " from " << indices.size() / 3 << " triangles in "
+                  << elapsed.count() << " ms on " << threadPool.threadCount()
+                  << " threads" << std::endl;
+        if (!options.meshletCachePath.empty() &&
+            !meshlets.save(options.meshletCachePath))
+        {
+            std::cerr << "meshlets: failed to write "
+                      << options.meshletCachePath << std::endl;
+        }
     }
 
-    static vk::Format chooseSwapSurfaceFormat(
-        const std::vector<vk::SurfaceFormatKHR>& availableFormats)
+    void createMeshletRenderer()
     {
-        const auto formatIt = std::ranges::find_if(
-            availableFormats,
-            [](const auto& format)
-            {
-                return format.format == vk::Format::eB8G8R8A8Srgb &&
-                       format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
-            });
-        return formatIt != availableFormats.end() ? formatIt->format
-                                                  : availableFormats[0].format;
+        CPU_ZONE("createMeshletRenderer");
+        vk::raii::ShaderModule shaderModule =
+            createShaderModule(meshletShaderCode);
+        meshletRenderer.init(physicalDevice,
+                             device,
+                             descriptorHeap,
+                             pipelineCache,
+                             shaderModule,
+                             swapChainImageFormat,
+                             meshlets,
+                             static_cast<uint32_t>(instances.size()),
+                             meshletBuffer,
+                             meshletVertexBuffer,
+                             meshletTriangleBuffer,
+                             vertexBuffer,
+                             instanceBuffers,
+                             instanceStaticBuffer);
     }
 
-    static vk::PresentModeKHR chooseSwapPresentMode(
-        const std::vector<vk::PresentModeKHR>& availablePresentModes)
+    // Advance the simulation and write this frame's instance streams. The
+    // frame's fence has signaled, so the GPU is done reading its buffer.
+    void updateInstances()
     {
-        return std::ranges::any_of(
-                   availablePresentModes,
-                   [](const vk::PresentModeKHR value)
-                   { return vk::PresentModeKHR::eMailbox == value; })
-                   ? vk::PresentModeKHR::eMailbox
-                   : vk::PresentModeKHR::eFifo;
+        CPU_ZONE("updateInstances");
+        const auto now = std::chrono::steady_clock::now();
+        const float dt = std::min(
+            std::chrono::duration<float>(now - lastInstanceUpdate).count(),
+            MAX_INSTANCE_STEP);
+        lastInstanceUpdate = now;
+
+        const AllocatedBuffer& buffer = instanceBuffers[currentFrame];
+        auto* streams = static_cast<float*>(buffer.allocation.mapped());
+        const size_t count = instances.size();
+        instances.update(threadPool,
+                         dt,
+                         streams,
+                         streams + count,
+                         streams + 2 * count);
+        allocator.flush(buffer.allocation);
+
+        instanceUpdateSeconds += std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - now)
+                                     .count();
     }
 
-    vk::Extent2D
-    chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities)
+    void createCommandBuffers()
     {
-        if (capabilities.currentExtent.width !=
-            std::numeric_limits<uint32_t>::max())
+        CPU_ZONE("createCommandBuffers");
+        commandBuffers.clear();
+        for (const vk::raii::CommandPool& pool : commandPools)
         {
-            return capabilities.currentExtent;
+            vk::CommandBufferAllocateInfo allocInfo {
+                .commandPool = pool,
+                .level = vk::CommandBufferLevel::ePrimary,
+                .commandBufferCount = 1
+            };
+            commandBuffers.push_back(
+                std::move(vk::raii::CommandBuffers(device, allocInfo).front()));
         }
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
 
-        return { std::clamp<uint32_t>(width,
-                                      capabilities.minImageExtent.width,
-                                      capabilities.maxImageExtent.width),
-                 std::clamp<uint32_t>(height,
-                                      capabilities.minImageExtent.height,
-                                      capabilities.maxImageExtent.height) };
+        // One recording slot per thread, unless there are fewer draws. GPU
+        // culling records a single indirect draw.
+        recorder.init(device,
+                      graphicsIndex,
+                      maxFramesInFlight,
+                      options.gpuCulling
+                          ? 1
+                          : std::min(threadPool.threadCount(),
+                                     options.drawCount));
     }
 
-    static std::vector<char> readFile(const std::string& filename)
+    void createSyncObjects()
     {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-        if (!file.is_open())
+        CPU_ZONE("createSyncObjects");
+        presentCompleteSemaphores.clear();
+        inFlightFences.clear();
+
+        for (size_t i = 0; i < maxFramesInFlight; i++)
         {
-            throw std::runtime_error("failed to open file!");
+            presentCompleteSemaphores.emplace_back(
+                vk::raii::Semaphore(device, vk::SemaphoreCreateInfo()));
+            inFlightFences.emplace_back(vk::raii::Fence(
+                device, { .flags = vk::FenceCreateFlagBits::eSignaled }));
         }
 
-        std::vector<char> buffer(file.tellg());
-        file.seekg(0, std::ios::beg);
-        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
-
-        // std::cout << "SPIRV bytecode size: "
-        //           << static_cast<std::streamsize>(buffer.size()) << '\n';
-        file.close();
-        return buffer;
+        createRenderFinishedSemaphores();
     }
 
-    static VKAPI_ATTR vk::Bool32 VKAPI_CALL
-    debugCallback(vk::DebugUtilsMessageSeverityFlagBitsEXT severity,
-                  vk::DebugUtilsMessageTypeFlagsEXT type,
-                  const vk::DebugUtilsMessengerCallbackDataEXT* pCallbackData,
-                  void* pUserData)
+    void createRenderFinishedSemaphores()
     {
-        // for some reason tree sitter works with this useless comment
-        if (severity == vk::DebugUtilsMessageSeverityFlagBitsEXT::eError ||
-            severity == vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning)
+        CPU_ZONE("createRenderFinishedSemaphores");
+        renderFinishedSemaphores.clear();
+
+        for (size_t i = 0; i < swapChainImages.size(); i++)
         {
-            std::cerr << "validation layer: type " << vk::to_string(type)
-                      << " msg: " << pCallbackData->pMessage << std::endl;
+            renderFinishedSemaphores.emplace_back(
+                vk::raii::Semaphore(device, vk::SemaphoreCreateInfo()));
         }
+    }
 
-        return vk::False;
+    void createFrameCapture()
+    {
+        CPU_ZONE("createFrameCapture");
+        frameCapture.init(allocator,
+                          threadPool,
+                          options.capturePath,
+                          swapChainImageFormat,
+                          options.fpsCap != 0 ? options.fpsCap
+                                              : DEFAULT_FPS_CAP,
+                          maxFramesInFlight);
     }
-};
 
-int main()
+    void createGpuTimer()
+    {
+        CPU_ZONE("createGpuTimer");
+        gpuTimer.init(physicalDevice, device, graphicsIndex, maxFramesInFlight);
+    }
+
+    void createShaderReloader()
+    {
+        CPU_ZONE("createShaderReloader");
+        const char* slangc = std::getenv("SLANGC");
+        const std::string compileCommand =
+            std::string(slangc ? slangc : "slangc") +
+            " \"" SHADER_DIR "shader.slang\" -target spirv -profile spirv_1_4"
+            " -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain"
+            " -entry fragMain";
+        // Compiled into the build tree and deleted once the pipeline is
+        // built; the sources only hold .slang.
+        std::error_code error;
+        std::filesystem::create_directories(RELOAD_DIR, error);
+        shaderReloader.init(SHADER_DIR "shader.slang",
+                            RELOAD_DIR "slang.spv",
+                            compileCommand,
+                            [this](std::span<const uint32_t> spirv)
+                            {
+                                vk::PipelineCreationFeedback feedback;
+                                return buildGraphicsPipeline(spirv, feedback);
+                            });
+        std::cout << "shader reload: watching " << SHADER_DIR "shader.slang"
+                  << std::endl;
+    }
+
+    // Swap in a reloaded pipeline between frames. The old one is retired
+    // behind the current frame, so nothing waits for the device to go idle.
+    void swapReloadedPipeline()
+    {
+        shaderReloader.poll(threadPool);
+        if (std::optional<vk::raii::Pipeline> pipeline =
+                shaderReloader.takePipeline())
+        {
+            frameDeletionQueue.retire(
+                frameNumber,
+                std::exchange(graphicsPipeline, std::move(*pipeline)));
+        }
+    }
+
+    // Declare the frame's passes and what they touch; the graph derives the
+    // barriers between them once, here, instead of on every frame.
+    void buildRenderGraph()
+    {
+        CPU_ZONE("buildRenderGraph");
+        // A swapchain image is acquired by the semaphore wait at color
+        // attachment output; an offscreen one is fenced with its frame.
+        colorTarget = renderGraph.importImage(
+            "swapchain",
+            vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+            finalImageUsage);
+        renderTarget = colorTarget;
+        if (dynamicResolution())
+        {
+            // Sized for the largest scale, so scaling never reallocates.
+            renderTarget = renderGraph.createImage(
+                "scene",
+                { .format = swapChainImageFormat,
+                  .extent = swapChainExtent,
+                  .usage = vk::ImageUsageFlagBits::eColorAttachment |
+                           vk::ImageUsageFlagBits::eTransferSrc });
+        }
+
+        // The render pass reads what the compute passes write: indirect
+        // commands and, on the graphics queue, the particles it draws.
+        std::vector<RenderGraph::Use> renderUses = {
+            { renderTarget, ResourceUsage::ColorAttachment }
+        };
+        RenderGraph::Resource drawCount = 0;
+        if (options.gpuCulling)
+        {
+            const RenderGraph::Resource drawCommands =
+                renderGraph.importBuffer("draw commands");
+            renderGraph.bindBuffer(drawCommands, culler.drawCommandBuffer());
+            drawCount = renderGraph.importBuffer("draw count");
+            renderGraph.bindBuffer(drawCount, culler.drawCountBuffer());
+            cullReadback = renderGraph.importBuffer("cull readback",
+                                                   ResourceUsage::HostRead);
+            renderGraph.addPass(
+                "clear draw count",
+                { { drawCount, ResourceUsage::TransferDestination } },
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                { culler.recordClear(commandBuffer); });
+            renderGraph.addPass(
+                "cull",
+                { { drawCommands, ResourceUsage::StorageWrite },
+                  { drawCount, ResourceUsage::StorageWrite } },
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                {
+                    const GpuScope scope(gpuTimer, commandBuffer, "cull");
+                    culler.recordCull(commandBuffer,
+                                      currentFrame,
+                                      static_cast<uint32_t>(indices.size()),
+                                      options.zoom,
+                                      meshRadius);
+                });
+            renderUses.push_back({ drawCommands, ResourceUsage::IndirectRead });
+            renderUses.push_back({ drawCount, ResourceUsage::IndirectRead });
+        }
+        if (options.particleCount != 0)
+        {
+            // The ring slot changes every frame, so the buffers stay unbound
+            // and get global barriers. On the compute queue the timeline
+            // semaphore orders them instead.
+            std::vector<RenderGraph::Use> particleUses;
+            if (!particles.async())
+            {
+                const RenderGraph::Resource particleBuffers =
+                    renderGraph.importBuffer("particles");
+                particleUses.push_back(
+                    { particleBuffers, ResourceUsage::StorageWrite });
+                renderUses.push_back(
+                    { particleBuffers, ResourceUsage::VertexInput });
+            }
+            renderGraph.addPass(
+                "particles",
+                std::move(particleUses),
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                { particles.simulate(commandBuffer, currentFrame); });
+        }
+        renderGraph.addPass(
+            "render",
+            std::move(renderUses),
+            [this](const vk::raii::CommandBuffer& commandBuffer)
+            { recordRender(commandBuffer); });
+        if (dynamicResolution())
+        {
+            renderGraph.addPass(
+                "upscale",
+                { { renderTarget, ResourceUsage::TransferSource },
+                  { colorTarget, ResourceUsage::TransferDestination } },
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                { recordUpscale(commandBuffer); });
+        }
+        if (frameCapture.enabled())
+        {
+            renderGraph.addPass(
+                "capture",
+                { { colorTarget, ResourceUsage::TransferSource } },
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                {
+                    const GpuScope scope(gpuTimer, commandBuffer, "capture");
+                    frameCapture.recordCopy(commandBuffer,
+                                            currentFrame,
+                                            renderGraph.image(colorTarget),
+                                            swapChainExtent);
+                });
+        }
+        if (options.gpuCulling)
+        {
+            renderGraph.addPass(
+                "readback",
+                { { drawCount, ResourceUsage::TransferSource },
+                  { cullReadback, ResourceUsage::TransferDestination } },
+                [this](const vk::raii::CommandBuffer& commandBuffer)
+                { culler.recordReadback(commandBuffer, currentFrame); });
+        }
+        renderGraph.compile();
+    }
+
+    void recordCommandBuffer(uint32_t imageIndex)
+    {
+        CPU_ZONE("recordCommandBuffer");
+        const auto start = std::chrono::steady_clock::now();
+        commandBuffers[currentFrame].begin({});
+        gpuTimer.beginFrame(commandBuffers[currentFrame], currentFrame);
+        uploader.recordAcquireBarriers(commandBuffers[currentFrame]);
+        textureStreamer.recordAcquireBarriers(commandBuffers[currentFrame]);
+        {
+            const GpuScope scope(gpuTimer, commandBuffers[currentFrame],
+                                 "frame");
+            renderExtent =
+                resolutionScaler.begin(currentFrame, swapChainExtent);
+            renderGraph.bindImage(colorTarget,
+                                  swapChainImages[imageIndex],
+                                  swapChainImageViews[imageIndex]);
+            if (options.gpuCulling)
+            {
+                renderGraph.bindBuffer(cullReadback,
+                                       culler.readbackBuffer(currentFrame));
+            }
+            renderGraph.execute(commandBuffers[currentFrame]);
+        }
+        commandBuffers[currentFrame].end();
+        recordSeconds += std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    }
+
+    // Clear the color target and execute the draws recorded in parallel.
+    void recordRender(const vk::raii::CommandBuffer& commandBuffer)
+    {
+        vk::ClearValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
+        vk::RenderingAttachmentInfo attachmentInfo = {
+            .imageView = renderGraph.imageView(renderTarget),
+            .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+            .loadOp = vk::AttachmentLoadOp::eClear,
+            .storeOp = vk::AttachmentStoreOp::eStore,
+            .clearValue = clearColor
+        };
+
+        vk::RenderingInfo renderingInfo = {
+            .flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers,
+            .renderArea = { .offset = { 0, 0 }, .extent = renderExtent },
+            .layerCount = 1,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &attachmentInfo
+        };
+
+        const GpuScope scope(gpuTimer, commandBuffer, "render");
+        commandBuffer.beginRendering(renderingInfo);
+
+        // Secondaries inherit the attachment formats but no other state.
+        const vk::CommandBufferInheritanceRenderingInfo inheritanceRendering {
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &swapChainImageFormat,
+            .rasterizationSamples = vk::SampleCountFlagBits::e1
+        };
+        const vk::CommandBufferInheritanceInfo inheritance {
+            .pNext = &inheritanceRendering
+        };
+        const std::vector<vk::CommandBuffer>& secondaries = recorder.record(
+            threadPool,
+            currentFrame,
+            inheritance,
+            vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+                vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+            [this](const vk::raii::CommandBuffer& commandBuffer, uint32_t slot)
+            { recordDraws(commandBuffer, slot); });
+        commandBuffer.executeCommands(secondaries);
+
+        commandBuffer.endRendering();
+    }
+
+    // Stretch the rendered corner of renderTarget over the whole image.
+    void recordUpscale(const vk::raii::CommandBuffer& commandBuffer)
+    {
+        const GpuScope scope(gpuTimer, commandBuffer, "upscale");
+        const vk::ImageSubresourceLayers layers {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        };
+        const vk::ImageBlit2 region {
+            .srcSubresource = layers,
+            .srcOffsets = std::array<vk::Offset3D, 2> {
+                vk::Offset3D { 0, 0, 0 },
+                vk::Offset3D { static_cast<int32_t>(renderExtent.width),
+                               static_cast<int32_t>(renderExtent.height),
+                               1 } },
+            .dstSubresource = layers,
+            .dstOffsets = std::array<vk::Offset3D, 2> {
+                vk::Offset3D { 0, 0, 0 },
+                vk::Offset3D { static_cast<int32_t>(swapChainExtent.width),
+                               static_cast<int32_t>(swapChainExtent.height),
+                               1 } }
+        };
+        commandBuffer.blitImage2(vk::BlitImageInfo2 {
+            .srcImage = renderGraph.image(renderTarget),
+            .srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .dstImage = renderGraph.image(colorTarget),
+            .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+            .regionCount = 1,
+            .pRegions = &region,
+            .filter = upscaleFilter });
+    }
+
+    // Record the slot's share of the draws. Called concurrently for
+    // different slots, so it only reads shared state.
+    void recordDraws(const vk::raii::CommandBuffer& commandBuffer,
+                     uint32_t slot) const
+    {
+        // Points go first so the instance state below is bound last.
+        if (options.particleCount != 0 && slot == 0)
+        {
+            particles.recordDraw(commandBuffer, renderExtent, options.zoom);
+        }
+
+        commandBuffer.setViewport(
+            0,
+            vk::Viewport(0.0f,
+                         0.0f,
+                         static_cast<float>(renderExtent.width),
+                         static_cast<float>(renderExtent.height),
+                         0.0f,
+                         1.0f));
+        commandBuffer.setScissor(
+            0, vk::Rect2D(vk::Offset2D(0, 0), renderExtent));
+
+        // Draws are split evenly between slots, instances between draws.
+        const uint64_t draws = options.drawCount;
+        const uint64_t slots = recorder.slotCount();
+        const uint64_t count = instances.size();
+        if (meshShadersSupported)
+        {
+            for (uint64_t draw = slot * draws / slots;
+                 draw < (slot + 1) * draws / slots;
+                 draw++)
+            {
+                const uint64_t first = draw * count / draws;
+                const uint64_t last = (draw + 1) * count / draws;
+                meshletRenderer.recordDraw(commandBuffer,
+                                           currentFrame,
+                                           options.zoom,
+                                           static_cast<uint32_t>(first),
+                                           static_cast<uint32_t>(last - first));
+            }
+            return;
+        }
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                   graphicsPipeline);
+        // Instance streams are consecutive ranges of their buffers.
+        const vk::DeviceSize streamSize = sizeof(float) * instances.size();
+        const vk::Buffer instanceBuffer = *instanceBuffers[currentFrame].buffer;
+        const vk::Buffer instanceStatic = *instanceStaticBuffer.buffer;
+        commandBuffer.bindVertexBuffers(
+            0,
+            { *vertexBuffer.buffer,
+              instanceBuffer,
+              instanceBuffer,
+              instanceBuffer,
+              instanceStatic,
+              instanceStatic },
+            { 0, 0, streamSize, 2 * streamSize, 0, streamSize });
+        commandBuffer.bindIndexBuffer(
+            *indexBuffer.buffer, 0, vk::IndexType::eUint32);
+        // Bound once per command buffer, resources are picked by index.
+        descriptorHeap.bind(
+            commandBuffer, vk::PipelineBindPoint::eGraphics, *pipelineLayout);
+        ViewConstants view { .viewScale = options.zoom };
+        if (!options.textureDir.empty())
+        {
+            view.textureTable = textureStreamer.tableIndex(currentFrame);
+            view.textureCount = textureStreamer.size();
+            view.textureOffset = textureOffset();
+            view.sampler = textureStreamer.samplerIndex();
+        }
+        commandBuffer.pushConstants<ViewConstants>(
+            pipelineLayout,
+            vk::ShaderStageFlagBits::eVertex |
+                vk::ShaderStageFlagBits::eFragment,
+            0,
+            view);
+
+        if (options.gpuCulling)
+        {
+            culler.recordDraw(commandBuffer);
+            return;
+        }
+
+        for (uint64_t draw = slot * draws / slots;
+             draw < (slot + 1) * draws / slots;
+             draw++)
+        {
+            const uint64_t first = draw * count / draws;
+            const uint64_t last = (draw + 1) * count / draws;
+            commandBuffer.drawIndexed(static_cast<uint32_t>(indices.size()),
+                                      static_cast<uint32_t>(last - first),
+                                      0,
+                                      0,
+                                      static_cast<uint32_t>(first));
+        }
+    }
+
+    void drawFrame()
+    {
+        CPU_ZONE("drawFrame");
+        paceFrame();
+        // Only wait for the frame that last used this slot's command buffer
+        // and semaphore; the other frames in flight keep the GPU busy.
+        {
+            CPU_ZONE("waitForFences");
+            while (vk::Result::eTimeout ==
+                   device.waitForFences(
+                       *inFlightFences[currentFrame], vk::True, UINT64_MAX))
+                ;
+        }
+        gpuTimer.collect(currentFrame);
+        const double gpuFrameMs = gpuTimer.lastMs("frame");
+        if (gpuFrameMs >= 0.0)
+        {
+            addTimeSample(gpuFrameTimesMs, gpuFrameMs);
+        }
+        resolutionScaler.collect(currentFrame, gpuFrameMs);
+        frameCapture.collect(currentFrame);
+        // Every frame up to the one that last used this slot has completed.
+        if (frameNumber >= maxFramesInFlight)
+        {
+            CPU_ZONE("collectDeletions");
+            frameDeletionQueue.collect(frameNumber - maxFramesInFlight);
+        }
+        if (options.gpuCulling)
+        {
+            culledTotal += culler.collect(currentFrame);
+        }
+        if (options.particleCount != 0)
+        {
+            particles.collect(currentFrame);
+        }
+        updateInstances();
+        if (!options.textureDir.empty())
+        {
+            updateTextures();
+        }
+        if (options.hotReload)
+        {
+            swapReloadedPipeline();
+        }
+
+        auto [result, imageIndex] = acquireNextImage();
+        acquireTimes[(frameNumber + 1) % PRESENT_HISTORY] =
+            std::chrono::steady_clock::now();
+        if (result == vk::Result::eErrorOutOfDateKHR)
+        {
+            recreateSwapChain();
+            return;
+        }
+        if (result != vk::Result::eSuccess &&
+            result != vk::Result::eSuboptimalKHR)
+        {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+
+        {
+            CPU_ZONE("resetFences");
+            device.resetFences(*inFlightFences[currentFrame]);
+        }
+        commandPools[currentFrame].reset();
+        recordCommandBuffer(imageIndex);
+
+        // Uploads the frame reads from must have landed. Waiting on a value
+        // the timeline has already reached costs nothing.
+        std::array<vk::SemaphoreSubmitInfo, 4> waitInfos;
+        uint32_t waitCount = 0;
+        waitInfos[waitCount++] = {
+            .semaphore = *uploader.timelineSemaphore(),
+            .value = uploader.submittedValue(),
+            .stageMask = vk::PipelineStageFlagBits2::eVertexAttributeInput |
+                         vk::PipelineStageFlagBits2::eIndexInput |
+                         vk::PipelineStageFlagBits2::eComputeShader |
+                         meshShaderStages()
+        };
+        if (!options.textureDir.empty())
+        {
+            waitInfos[waitCount++] = {
+                .semaphore = *textureStreamer.timelineSemaphore(),
+                .value = textureStreamer.publishedValue(),
+                .stageMask = vk::PipelineStageFlagBits2::eFragmentShader
+            };
+        }
+        if (options.particleCount != 0 && particles.async())
+        {
+            waitInfos[waitCount++] = particles.waitInfo();
+        }
+        // offscreen targets have no acquire or present to synchronize with
+        if (!options.headless)
+        {
+            waitInfos[waitCount++] = {
+                .semaphore = *presentCompleteSemaphores[currentFrame],
+                .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput
+            };
+        }
+        // Present must wait for the transition to ePresentSrcKHR, so the
+        // signal covers the stages that barrier runs in.
+        const vk::SemaphoreSubmitInfo signalInfo {
+            .semaphore = *renderFinishedSemaphores[imageIndex],
+            .stageMask = RenderGraph::presentStages()
+        };
+        const vk::CommandBufferSubmitInfo commandBufferInfo {
+            .commandBuffer = *commandBuffers[currentFrame]
+        };
+        const vk::SubmitInfo2 submitInfo {
+            .waitSemaphoreInfoCount = waitCount,
+            .pWaitSemaphoreInfos = waitInfos.data(),
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+            .signalSemaphoreInfoCount = options.headless ? 0u : 1u,
+            .pSignalSemaphoreInfos = &signalInfo
+        };
+        {
+            CPU_ZONE("submit");
+            std::scoped_lock lock(queueMutex);
+            graphicsQueue.submit2(submitInfo, *inFlightFences[currentFrame]);
+        }
+
+        result = presentImage(imageIndex);
+        if (result == vk::Result::eErrorOutOfDateKHR ||
+            result == vk::Result::eSuboptimalKHR || frameBufferResized)
+        {
+            frameBufferResized = false;
+            recreateSwapChain();
+        }
+        else if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to present swap chain image!");
+        }
+        if (frameNumber == 0)
+        {
+            startup.firstFrame(std::cout);
+        }
+        currentFrame = (currentFrame + 1) % maxFramesInFlight;
+        frameNumber++;
+    }
+
+    // Hold the frame back until the display has caught up with present wait,
+    // then to the frame rate cap.
+    void paceFrame()
+    {
+        if (presentWaitSupported && frameNumber > MAX_QUEUED_PRESENTS)
+        {
+            const uint64_t presentId = frameNumber - MAX_QUEUED_PRESENTS;
+            if (presentId > lastWaitedPresentId &&
+                presentId >= swapchainFirstPresentId)
+            {
+                waitForPresent(presentId);
+            }
+        }
+        frameLimiter.wait();
+    }
+
+    void waitForPresent(uint64_t presentId)
+    {
+        CPU_ZONE("waitForPresent");
+        vk::Result result = vk::Result::eTimeout;
+        try
+        {
+            result =
+                swapChain.waitForPresent(presentId, PRESENT_WAIT_TIMEOUT_NS);
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            // the next acquire or present recreates the swapchain
+        }
+        // A timeout, e.g. from a minimized window, skips the sample.
+        if (result == vk::Result::eSuccess ||
+            result == vk::Result::eSuboptimalKHR)
+        {
+            // Earlier presents, including those to retired swapchains, have
+            // been consumed.
+            swapchainDeletionQueue.collect(presentId);
+            addTimeSample(presentLatenciesMs,
+                          std::chrono::duration<float, std::milli>(
+                              std::chrono::steady_clock::now() -
+                              acquireTimes[presentId % PRESENT_HISTORY])
+                              .count());
+        }
+        lastWaitedPresentId = presentId;
+    }
+
+    std::pair<vk::Result, uint32_t> acquireNextImage()
+    {
+        CPU_ZONE("acquireNextImage");
+        if (options.headless)
+        {
+            return { vk::Result::eSuccess, currentFrame };
+        }
+        return swapChain.acquireNextImage(
+            UINT64_MAX, *presentCompleteSemaphores[currentFrame], nullptr);
+    }
+
+    vk::Result presentImage(uint32_t imageIndex)
+    {
+        CPU_ZONE("presentImage");
+        if (options.headless)
+        {
+            return vk::Result::eSuccess;
+        }
+        const uint64_t presentId = frameNumber + 1;
+        const vk::PresentIdKHR presentIdInfo { .swapchainCount = 1,
+                                               .pPresentIds = &presentId };
+        const vk::PresentInfoKHR presentInfoKHR {
+            .pNext = presentWaitSupported ? &presentIdInfo : nullptr,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &*renderFinishedSemaphores[imageIndex],
+            .swapchainCount = 1,
+            .pSwapchains = &*swapChain,
+            .pImageIndices = &imageIndex
+        };
+        vk::Result result;
+        {
+            std::scoped_lock lock(queueMutex);
+            result = presentQueue.presentKHR(presentInfoKHR);
+        }
+        lastPresentId = presentId;
+        if (!presentWaitSupported)
+        {
+            if (presentId > maxFramesInFlight)
+            {
+                swapchainDeletionQueue.collect(presentId - maxFramesInFlight);
+            }
+            addTimeSample(presentLatenciesMs,
+                          std::chrono::duration<float, std::milli>(
+                              std::chrono::steady_clock::now() -
+                              acquireTimes[presentId % PRESENT_HISTORY])
+                              .count());
+        }
+        return result;
+    }
+
+    [[nodiscard]] vk::raii::ShaderModule
+    createShaderModule(std::span<const uint32_t> code) const
+    {
+        vk::ShaderModuleCreateInfo createInfo {
+            .codeSize = code.size_bytes(),
+            .pCode = code.data()
+        };
+        vk::raii::ShaderModule shaderModule { device, createInfo };
+
+        return shaderModule;
+    }
+
+    std::vector<const char*> getRequiredExtensions()
+    {
+        std::vector<const char*> extensions;
+        if (options.headlessSurface)
+        {
+            extensions.push_back(vk::KHRSurfaceExtensionName);
+            extensions.push_back(vk::EXTHeadlessSurfaceExtensionName);
+        }
+        else if (!options.headless)
+        {
+            uint32_t glfwExtensionCount = 0;
+            auto glfwExtensions =
+                glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions,
+                              glfwExtensions + glfwExtensionCount);
+        }
+        if (enableValidationLayers)
+        {
+            extensions.push_back(vk::EXTDebugUtilsExtensionName);
+        }
+
+#ifdef __APPLE__
+        extensions.push_back(vk::KHRGetPhysicalDeviceProperties2ExtensionName);
+        extensions.push_back(vk::KHRPortabilityEnumerationExtensionName);
+#endif
+
+        return extensions;
+    }
+
+    static vk::Format chooseSwapSurfaceFormat(
+        const std::vector<vk::SurfaceFormatKHR>& availableFormats)
+    {
+        const auto formatIt = std::ranges::find_if(
+            availableFormats,
+            [](const auto& format)
+            {
+                return format.format == vk::Format::eB8G8R8A8Srgb &&
+                       format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
+            });
+        return formatIt != availableFormats.end() ? formatIt->format
+                                                  : availableFormats[0].format;
+    }
+
+    const PresentPolicyInfo& presentPolicy() const
+    {
+        return *std::ranges::find(PRESENT_POLICIES,
+                                  options.presentPolicy,
+                                  &PresentPolicyInfo::policy);
+    }
+
+    // The --present-mode override when supported, else the policy's first
+    // supported mode.
+    vk::PresentModeKHR chooseSwapPresentMode(
+        const std::vector<vk::PresentModeKHR>& availablePresentModes,
+        bool warn) const
+    {
+        auto available = [&](vk::PresentModeKHR mode)
+        { return std::ranges::find(availablePresentModes, mode) !=
+                 availablePresentModes.end(); };
+        if (options.presentMode)
+        {
+            if (available(*options.presentMode))
+            {
+                return *options.presentMode;
+            }
+            if (warn)
+            {
+                std::cerr << vk::to_string(*options.presentMode)
+                          << " is not supported by the surface, using the "
+                          << presentPolicy().name << " policy" << std::endl;
+            }
+        }
+        const auto modeIt =
+            std::ranges::find_if(presentPolicy().presentModes, available);
+        return modeIt != presentPolicy().presentModes.end()
+                   ? *modeIt
+                   : vk::PresentModeKHR::eFifo;
+    }
+
+    vk::Extent2D
+    chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities)
+    {
+        if (capabilities.currentExtent.width !=
+            std::numeric_limits<uint32_t>::max())
+        {
+            return capabilities.currentExtent;
+        }
+        int width = static_cast<int>(options.width);
+        int height = static_cast<int>(options.height);
+        if (window != nullptr)
+        {
+            glfwGetFramebufferSize(window, &width, &height);
+        }
+
+        return { std::clamp<uint32_t>(width,
+                                      capabilities.minImageExtent.width,
+                                      capabilities.maxImageExtent.width),
+                 std::clamp<uint32_t>(height,
+                                      capabilities.minImageExtent.height,
+                                      capabilities.maxImageExtent.height) };
+    }
+
+    // SPIR-V words of fileName: the embedded copy unless --shader-dir is
+    // given, otherwise the file mapped into mapped, which must outlive the
+    // returned span.
+    std::span<const uint32_t> shaderCode(const char* fileName,
+                                         std::span<const uint32_t> embedded,
+                                         MappedFile& mapped) const
+    {
+        if (options.shaderDir.empty())
+        {
+            return embedded;
+        }
+        mapped = MappedFile(std::filesystem::path(options.shaderDir) /
+                            fileName);
+        return mapped.words();
+    }
+
+    static VKAPI_ATTR vk::Bool32 VKAPI_CALL
+    debugCallback(vk::DebugUtilsMessageSeverityFlagBitsEXT severity,
+                  vk::DebugUtilsMessageTypeFlagsEXT type,
+                  const vk::DebugUtilsMessengerCallbackDataEXT* pCallbackData,
+                  void* pUserData)
+    {
+        // for some reason tree sitter works with this useless comment
+        if (severity == vk::DebugUtilsMessageSeverityFlagBitsEXT::eError ||
+            severity == vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning)
+        {
+            std::cerr << "validation layer: type " << vk::to_string(type)
+                      << " msg: " << pCallbackData->pMessage << std::endl;
+        }
+
+        return vk::False;
+    }
+};
+
+static uint32_t parseUint(const std::string& value, const std::string& name)
+{
+    try
+    {
+        // std::stoul accepts a sign and wraps negative values, so only plain
+        // digits are allowed through.
+        if (value.empty() || value[0] < '0' || value[0] > '9')
+        {
+            throw std::invalid_argument(value);
+        }
+        size_t end = 0;
+        const unsigned long long parsed = std::stoull(value, &end);
+        if (end == value.size() &&
+            parsed <= std::numeric_limits<uint32_t>::max())
+        {
+            return static_cast<uint32_t>(parsed);
+        }
+    }
+    catch (const std::logic_error&)
+    {
+    }
+    throw std::runtime_error("invalid value for " + name + ": " + value);
+}
+
+static float parseFloat(const std::string& value, const std::string& name)
+{
+    try
+    {
+        size_t end = 0;
+        const float parsed = std::stof(value, &end);
+        if (end == value.size())
+        {
+            return parsed;
+        }
+    }
+    catch (const std::logic_error&)
+    {
+    }
+    throw std::runtime_error("invalid value for " + name + ": " + value);
+}
+
+// WIDTHxHEIGHT.
+static vk::Extent2D parseSize(const std::string& value,
+                              const std::string& name)
+{
+    const size_t x = value.find('x');
+    if (x == std::string::npos)
+    {
+        throw std::runtime_error("expected WIDTHxHEIGHT for " + name);
+    }
+    return { parseUint(value.substr(0, x), name),
+             parseUint(value.substr(x + 1), name) };
+}
+
+static AppOptions parseOptions(int argc, char* argv[])
+{
+    AppOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        auto nextValue = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (arg == "--frames")
+        {
+            options.frameCount = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--frames-in-flight")
+        {
+            options.framesInFlight = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--pipeline-cache")
+        {
+            options.pipelineCachePath = nextValue();
+        }
+        else if (arg == "--no-pipeline-cache")
+        {
+            options.pipelineCachePath.clear();
+        }
+        else if (arg == "--trace")
+        {
+            options.tracePath = nextValue();
+        }
+        else if (arg == "--instances")
+        {
+            options.instanceCount = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--draws")
+        {
+            options.drawCount = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--gpu-culling")
+        {
+            options.gpuCulling = true;
+        }
+        else if (arg == "--mesh-detail")
+        {
+            options.meshDetail = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--mesh-shaders")
+        {
+            options.meshShaders = true;
+        }
+        else if (arg == "--meshlet-cache")
+        {
+            options.meshletCachePath = nextValue();
+        }
+        else if (arg == "--mesh")
+        {
+            options.meshPath = nextValue();
+        }
+        else if (arg == "--vertex-format")
+        {
+            const std::string value = nextValue();
+            const auto it = std::ranges::find_if(
+                VERTEX_FORMATS,
+                [&value](const VertexFormatInfo& info)
+                { return value == info.name; });
+            if (it == VERTEX_FORMATS.end())
+            {
+                throw std::runtime_error("invalid value for " + arg + ": " +
+                                         value);
+            }
+            options.vertexFormat = it->format;
+        }
+        else if (arg == "--zoom")
+        {
+            options.zoom = parseFloat(nextValue(), arg);
+        }
+        else if (arg == "--shader-dir")
+        {
+            options.shaderDir = nextValue();
+        }
+        else if (arg == "--hot-reload")
+        {
+            options.hotReload = true;
+        }
+        else if (arg == "--resize-test")
+        {
+            options.resizeTest = true;
+        }
+        else if (arg == "--threads")
+        {
+            options.threadCount = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--textures")
+        {
+            options.textureDir = nextValue();
+        }
+        else if (arg == "--texture-budget")
+        {
+            options.textureBudgetMiB = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--headless-surface")
+        {
+            options.headlessSurface = true;
+        }
+        else if (arg == "--present")
+        {
+            const std::string value = nextValue();
+            const auto it = std::ranges::find_if(
+                PRESENT_POLICIES,
+                [&value](const PresentPolicyInfo& info)
+                { return value == info.name; });
+            if (it == PRESENT_POLICIES.end())
+            {
+                throw std::runtime_error("invalid value for " + arg + ": " +
+                                         value);
+            }
+            options.presentPolicy = it->policy;
+        }
+        else if (arg == "--present-mode")
+        {
+            const std::string value = nextValue();
+            const auto it = std::ranges::find_if(
+                PRESENT_MODE_NAMES,
+                [&value](const auto& name) { return value == name.first; });
+            if (it == PRESENT_MODE_NAMES.end())
+            {
+                throw std::runtime_error("invalid value for " + arg + ": " +
+                                         value);
+            }
+            options.presentMode = it->second;
+        }
+        else if (arg == "--swapchain-images")
+        {
+            options.swapchainImages = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--fps-cap")
+        {
+            options.fpsCap = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--serial-startup")
+        {
+            options.serialStartup = true;
+        }
+        else if (arg == "--particles")
+        {
+            options.particleCount = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--no-async-compute")
+        {
+            options.asyncCompute = false;
+        }
+        else if (arg == "--frame-budget")
+        {
+            options.frameBudgetMs = parseFloat(nextValue(), arg);
+        }
+        else if (arg == "--min-render-scale")
+        {
+            options.minRenderScale = parseFloat(nextValue(), arg);
+        }
+        else if (arg == "--capture")
+        {
+            options.capturePath = nextValue();
+            FrameCapture::containerFor(options.capturePath);
+        }
+        else if (arg == "--size")
+        {
+            const vk::Extent2D size = parseSize(nextValue(), arg);
+            options.width = size.width;
+            options.height = size.height;
+        }
+        else
+        {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (options.headless && options.headlessSurface)
+    {
+        throw std::runtime_error(
+            "--headless and --headless-surface are exclusive");
+    }
+    if ((options.headless || options.headlessSurface) &&
+        options.frameCount == 0)
+    {
+        options.frameCount = DEFAULT_HEADLESS_FRAMES;
+    }
+    if (options.presentPolicy == PresentPolicy::Capped &&
+        options.fpsCap == 0)
+    {
+        options.fpsCap = DEFAULT_FPS_CAP;
+    }
+    if (options.width == 0 || options.height == 0)
+    {
+        throw std::runtime_error("render size must be non-zero");
+    }
+    if (options.framesInFlight == 0 ||
+        options.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+    {
+        throw std::runtime_error("--frames-in-flight must be between 1 and " +
+                                 std::to_string(MAX_FRAMES_IN_FLIGHT));
+    }
+    if (options.instanceCount == 0)
+    {
+        throw std::runtime_error("--instances must be at least 1");
+    }
+    if (options.resizeTest && (options.headless || options.headlessSurface))
+    {
+        throw std::runtime_error("--resize-test needs a window");
+    }
+    if (!(options.zoom > 0.0f))
+    {
+        throw std::runtime_error("--zoom must be positive");
+    }
+    if (!(options.frameBudgetMs >= 0.0))
+    {
+        throw std::runtime_error("--frame-budget must not be negative");
+    }
+    if (!(options.minRenderScale > 0.0f && options.minRenderScale <= 1.0f))
+    {
+        throw std::runtime_error("--min-render-scale must be in (0, 1]");
+    }
+    if (options.drawCount == 0 || options.drawCount > options.instanceCount)
+    {
+        throw std::runtime_error(
+            "--draws must be between 1 and the instance count");
+    }
+    if (options.meshDetail == 0 || options.meshDetail > MAX_MESH_DETAIL)
+    {
+        throw std::runtime_error("--mesh-detail must be between 1 and " +
+                                 std::to_string(MAX_MESH_DETAIL));
+    }
+    if (options.meshShaders &&
+        (options.gpuCulling || !options.textureDir.empty()))
+    {
+        throw std::runtime_error(
+            "--mesh-shaders cannot be combined with --gpu-culling or "
+            "--textures");
+    }
+    if (!options.meshPath.empty() &&
+        (options.meshShaders || options.meshDetail != 1))
+    {
+        throw std::runtime_error(
+            "--mesh cannot be combined with --mesh-shaders or --mesh-detail");
+    }
+    return options;
+}
+
+struct BenchOptions
+{
+    // Scenes to run, empty runs all of them.
+    std::vector<std::string> scenes;
+    // Frames measured per scene, after the warmup.
+    uint32_t frames = 500;
+    // Frames rendered first and left out of the statistics.
+    uint32_t warmup = 50;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    // Instances drawn by the instances scene.
+    uint32_t instances = 10000;
+    // JSON report, "-" for stdout.
+    std::string outputPath = "bench.json";
+    // Report of an earlier run to check this one against.
+    std::string baselinePath;
+    // Fraction a metric may exceed the baseline by.
+    double tolerance = 0.1;
+    // Keep the application's own reports.
+    bool verbose = false;
+};
+
+struct BenchScene
+{
+    const char* name;
+    const char* description;
+    void (*configure)(AppOptions&, const BenchOptions&);
+};
+
+constexpr std::array<BenchScene, 4> BENCH_SCENES = { {
+    { "triangle", "the single triangle: fixed per-frame overhead",
+      [](AppOptions&, const BenchOptions&) {} },
+    { "instances", "animated instances in one draw: CPU update and upload",
+      [](AppOptions& options, const BenchOptions& bench)
+      { options.instanceCount = bench.instances; } },
+    { "fill-rate", "one triangle magnified past the target: per-pixel cost",
+      [](AppOptions& options, const BenchOptions&) { options.zoom = 4.0f; } },
+    { "vertex-bound", "four instances of a 512-row mesh: per-vertex cost",
+      [](AppOptions& options, const BenchOptions&)
+      {
+          options.instanceCount = 4;
+          options.meshDetail = 512;
+      } },
+} };
+
+static BenchOptions parseBenchOptions(int argc, char* argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        auto nextValue = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--scene")
+        {
+            const std::string name = nextValue();
+            if (std::ranges::find_if(BENCH_SCENES,
+                                     [&name](const BenchScene& scene)
+                                     { return name == scene.name; }) ==
+                BENCH_SCENES.end())
+            {
+                throw std::runtime_error("unknown scene: " + name);
+            }
+            options.scenes.push_back(name);
+        }
+        else if (arg == "--frames")
+        {
+            options.frames = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--warmup")
+        {
+            options.warmup = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--size")
+        {
+            const vk::Extent2D size = parseSize(nextValue(), arg);
+            options.width = size.width;
+            options.height = size.height;
+        }
+        else if (arg == "--instances")
+        {
+            options.instances = parseUint(nextValue(), arg);
+        }
+        else if (arg == "--output")
+        {
+            options.outputPath = nextValue();
+        }
+        else if (arg == "--baseline")
+        {
+            options.baselinePath = nextValue();
+        }
+        else if (arg == "--tolerance")
+        {
+            options.tolerance = parseFloat(nextValue(), arg) / 100.0;
+        }
+        else if (arg == "--verbose")
+        {
+            options.verbose = true;
+        }
+        else
+        {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (options.frames == 0)
+    {
+        throw std::runtime_error("--frames must be at least 1");
+    }
+    if (options.width == 0 || options.height == 0)
+    {
+        throw std::runtime_error("--size must not be zero");
+    }
+    if (options.instances == 0)
+    {
+        throw std::runtime_error("--instances must be at least 1");
+    }
+    if (!(options.tolerance >= 0.0))
+    {
+        throw std::runtime_error("--tolerance must not be negative");
+    }
+    return options;
+}
+
+// Swallows the application's reports while a scene runs.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+static SceneResult runScene(const BenchScene& scene,
+                            const BenchOptions& bench, std::string& device)
+{
+    AppOptions options;
+    options.headless = true;
+    options.width = bench.width;
+    options.height = bench.height;
+    options.frameCount = bench.warmup + bench.frames;
+    scene.configure(options, bench);
+
+    RunResults results;
+    {
+        NullBuffer null;
+        std::streambuf* const cout = std::cout.rdbuf();
+        if (!bench.verbose)
+        {
+            std::cout.rdbuf(&null);
+        }
+        try
+        {
+            HelloTriangleApplication app(options);
+            app.run();
+            results = app.results();
+        }
+        catch (...)
+        {
+            std::cout.rdbuf(cout);
+            throw;
+        }
+        std::cout.rdbuf(cout);
+    }
+
+    device = results.deviceName;
+    const FrameTimeStats cpu =
+        FrameTimeStats::of(results.cpuFrameMs, bench.warmup);
+    return SceneResult {
+        .name = scene.name,
+        .frames = results.frames,
+        .fps = cpu.mean > 0.0 ? 1000.0 / cpu.mean : 0.0,
+        .startupMs = results.startupMs,
+        .cpu = cpu,
+        .gpu = FrameTimeStats::of(results.gpuFrameMs, bench.warmup),
+        .reservedBytes = results.memory.reservedBytes,
+        .allocatedBytes = results.memory.allocatedBytes,
+        .deviceMemoryCount = results.memory.deviceMemoryCount
+    };
+}
+
+// Runs each scene headless for a fixed number of frames, writes the JSON
+// report and fails when a metric regressed against the baseline.
+int runBench(int argc, char* argv[])
+{
+    try
+    {
+        CpuProfiler::setThreadName("main");
+        const BenchOptions bench = parseBenchOptions(argc, argv);
+        BenchReport report;
+        report.width = bench.width;
+        report.height = bench.height;
+        report.warmupFrames = bench.warmup;
+        for (const BenchScene& scene : BENCH_SCENES)
+        {
+            if (!bench.scenes.empty() &&
+                std::ranges::find(bench.scenes, scene.name) ==
+                    bench.scenes.end())
+            {
+                continue;
+            }
+            std::cerr << scene.name << ": " << scene.description << std::endl;
+            const SceneResult& result = report.scenes.emplace_back(
+                runScene(scene, bench, report.device));
+            std::cerr << "  " << result.fps << " fps, cpu p50 "
+                      << result.cpu.p50 << " ms p99 " << result.cpu.p99
+                      << " ms, gpu p50 " << result.gpu.p50 << " ms p99 "
+                      << result.gpu.p99 << " ms" << std::endl;
+        }
+
+        if (bench.outputPath == "-")
+        {
+            report.write(std::cout);
+        }
+        else
+        {
+            std::ofstream out(bench.outputPath, std::ios::trunc);
+            report.write(out);
+            if (!out)
+            {
+                throw std::runtime_error("failed to write " +
+                                         bench.outputPath);
+            }
+        }
+
+        if (!bench.baselinePath.empty())
+        {
+            std::ifstream in(bench.baselinePath);
+            if (!in)
+            {
+                throw std::runtime_error("failed to open " +
+                                         bench.baselinePath);
+            }
+            const std::string text { std::istreambuf_iterator<char>(in),
+                                     std::istreambuf_iterator<char>() };
+            const std::vector<std::string> regressions =
+                report.compare(JsonValue::parse(text), bench.tolerance);
+            for (const std::string& regression : regressions)
+            {
+                std::cerr << "regression: " << regression << std::endl;
+            }
+            if (!regressions.empty())
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runApp(int argc, char* argv[])
 {
     try
     {
-        HelloTriangleApplication app;
+        CpuProfiler::setThreadName("main");
+        HelloTriangleApplication app(parseOptions(argc, argv));
         app.run();
     }
     catch (const std::exception& e)
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The mapping starts on a page
+// boundary, so its contents can be viewed as uint32_t words without a copy.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("failed to open " + path.string());
+        }
+        LARGE_INTEGER fileSize {};
+        GetFileSizeEx(file, &fileSize);
+        size = static_cast<size_t>(fileSize.QuadPart);
+        if (size > 0)
+        {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY,
+                                                0, 0, nullptr);
+            if (mapping != nullptr)
+            {
+                data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("failed to open " + path.string());
+        }
+        struct stat info {};
+        fstat(fd, &info);
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0)
+        {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                data = nullptr;
+            }
+        }
+        close(fd);
+#endif
+        if (size > 0 && data == nullptr)
+        {
+            throw std::runtime_error("failed to map " + path.string());
+        }
+    }
+
+    ~MappedFile() { unmap(); }
+
+    MappedFile(MappedFile&& other) noexcept
+        : data(std::exchange(other.data, nullptr)),
+          size(std::exchange(other.size, 0))
+    {
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const std::byte> bytes() const
+    {
+        return { static_cast<const std::byte*>(data), size };
+    }
+
+    // Throws if the file is not a whole number of words.
+    std::span<const uint32_t> words() const
+    {
+        if (size % sizeof(uint32_t) != 0)
+        {
+            throw std::runtime_error("mapped file is not a whole number of "
+                                     "32-bit words");
+        }
+        return { static_cast<const uint32_t*>(data),
+                 size / sizeof(uint32_t) };
+    }
+
+    // Ask the OS to start reading the whole file into the page cache, so
+    // later accesses do not fault on the disk one page at a time. Only a
+    // hint: failures are ignored.
+    void prefetch() const
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range { .VirtualAddress = data,
+                                         .NumberOfBytes = size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise(data, size, MADV_WILLNEED);
+#endif
+    }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+
+    void unmap()
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+        data = nullptr;
+    }
+};
@@ -0,0 +1,737 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "json_value.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+// Triangle mesh as separate float streams, one entry per unique vertex.
+struct MeshData
+{
+    // x, y, z per vertex.
+    std::vector<float> positions;
+    // Unit x, y, z per vertex.
+    std::vector<float> normals;
+    // u, v per vertex, zero when the file has none.
+    std::vector<float> uvs;
+    std::vector<uint32_t> indices;
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// Loads OBJ, glTF and GLB meshes from memory-mapped files, parsing on a
+// ThreadPool. OBJ text is cut into chunks at line boundaries and parsed in
+// parallel; glTF accessors are copied out of the mapped buffers in parallel.
+// Every primitive of a glTF file is merged into one mesh and node transforms
+// are ignored. Missing normals are computed from the faces.
+class MeshLoader
+{
+public:
+    static MeshData load(const std::filesystem::path& path, ThreadPool& pool)
+    {
+        CPU_ZONE("loadMesh");
+        std::string extension = path.extension().string();
+        std::ranges::transform(extension, extension.begin(),
+                               [](unsigned char c)
+                               { return static_cast<char>(std::tolower(c)); });
+        MeshData mesh;
+        if (extension == ".obj")
+        {
+            mesh = loadObj(path, pool);
+        }
+        else if (extension == ".gltf" || extension == ".glb")
+        {
+            mesh = loadGltf(path, extension == ".glb", pool);
+        }
+        else
+        {
+            throw std::runtime_error("unsupported mesh format: " +
+                                     path.string());
+        }
+        if (mesh.indices.empty())
+        {
+            throw std::runtime_error("no triangles in " + path.string());
+        }
+        if (mesh.normals.empty())
+        {
+            computeNormals(mesh);
+        }
+        if (mesh.uvs.empty())
+        {
+            mesh.uvs.assign(2 * mesh.vertexCount(), 0.0f);
+        }
+        return mesh;
+    }
+
+private:
+    // Bytes of OBJ text per parse task.
+    static constexpr size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+    // One face corner: position, texcoord and normal indices. Relative
+    // (negative) indices are resolved against the chunk's own counts and
+    // marked, then offset by the counts of earlier chunks.
+    struct ObjCorner
+    {
+        std::array<int64_t, 3> index;
+        uint8_t relative;
+    };
+
+    struct ObjChunk
+    {
+        std::vector<float> positions;
+        std::vector<float> uvs;
+        std::vector<float> normals;
+        // Three corners per triangle, faces fanned around their first.
+        std::vector<ObjCorner> corners;
+        // Set instead of throwing, so a bad face is reported once every chunk
+        // has been parsed.
+        bool malformed = false;
+    };
+
+    static MeshData loadObj(const std::filesystem::path& path,
+                            ThreadPool& pool)
+    {
+        const MappedFile file(path);
+        const std::string_view text(
+            reinterpret_cast<const char*>(file.bytes().data()),
+            file.bytes().size());
+
+        // Chunk boundaries move forward to the next line start.
+        std::vector<size_t> starts = { 0 };
+        while (starts.back() + OBJ_CHUNK_SIZE < text.size())
+        {
+            const size_t newline =
+                text.find('\n', starts.back() + OBJ_CHUNK_SIZE);
+            if (newline == std::string_view::npos)
+            {
+                break;
+            }
+            starts.push_back(newline + 1);
+        }
+        starts.push_back(text.size());
+
+        std::vector<ObjChunk> chunks(starts.size() - 1);
+        pool.parallelFor(chunks.size(),
+                         1,
+                         [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; i++)
+                             {
+                                 chunks[i] = parseObjChunk(text.substr(
+                                     starts[i], starts[i + 1] - starts[i]));
+                             }
+                         });
+        if (std::ranges::any_of(chunks, &ObjChunk::malformed))
+        {
+            throw std::runtime_error("malformed OBJ face in " + path.string());
+        }
+
+        // Counts of positions, texcoords and normals before each chunk.
+        std::vector<std::array<int64_t, 3>> bases(chunks.size());
+        std::array<int64_t, 3> totals = {};
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            bases[i] = totals;
+            totals[0] += static_cast<int64_t>(chunks[i].positions.size() / 3);
+            totals[1] += static_cast<int64_t>(chunks[i].uvs.size() / 2);
+            totals[2] += static_cast<int64_t>(chunks[i].normals.size() / 3);
+        }
+        std::vector<float> positions;
+        std::vector<float> uvs;
+        std::vector<float> normals;
+        for (ObjChunk& chunk : chunks)
+        {
+            positions.insert(positions.end(), chunk.positions.begin(),
+                             chunk.positions.end());
+            uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+            normals.insert(normals.end(), chunk.normals.begin(),
+                           chunk.normals.end());
+        }
+
+        // Corners sharing all three indices become one vertex. Vertices are
+        // chained per position, and a position rarely has more than a few,
+        // so this is a short walk instead of a hash lookup.
+        MeshData mesh;
+        std::vector<uint32_t> firstVertex(totals[0], UINT32_MAX);
+        std::vector<uint32_t> nextVertex;
+        std::vector<CornerKey> vertexKeys;
+        // Most meshes have about one vertex per position.
+        vertexKeys.reserve(totals[0]);
+        nextVertex.reserve(totals[0]);
+        mesh.positions.reserve(3 * totals[0]);
+        mesh.normals.reserve(3 * totals[0]);
+        mesh.uvs.reserve(2 * totals[0]);
+        bool missingNormal = false;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            mesh.indices.reserve(mesh.indices.size() +
+                                 chunks[i].corners.size());
+            for (const ObjCorner& corner : chunks[i].corners)
+            {
+                CornerKey key;
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    int64_t index = corner.index[k];
+                    if (corner.relative & (1u << k))
+                    {
+                        index += bases[i][k];
+                    }
+                    if (index < (k == 0 ? 0 : -1) || index >= totals[k])
+                    {
+                        throw std::runtime_error("face index out of range in " +
+                                                 path.string());
+                    }
+                    key[k] = index;
+                }
+                missingNormal |= key[2] < 0;
+                uint32_t vertex = firstVertex[key[0]];
+                while (vertex != UINT32_MAX && vertexKeys[vertex] != key)
+                {
+                    vertex = nextVertex[vertex];
+                }
+                if (vertex == UINT32_MAX)
+                {
+                    vertex = static_cast<uint32_t>(vertexKeys.size());
+                    vertexKeys.push_back(key);
+                    nextVertex.push_back(firstVertex[key[0]]);
+                    firstVertex[key[0]] = vertex;
+                    appendVertex(mesh, key, positions, uvs, normals);
+                }
+                mesh.indices.push_back(vertex);
+            }
+        }
+        // Normals are recomputed if any corner lacks one.
+        if (missingNormal)
+        {
+            mesh.normals.clear();
+        }
+        if (totals[1] == 0)
+        {
+            mesh.uvs.clear();
+        }
+        return mesh;
+    }
+
+    using CornerKey = std::array<int64_t, 3>;
+
+    static void appendVertex(MeshData& mesh, const CornerKey& key,
+                             const std::vector<float>& positions,
+                             const std::vector<float>& uvs,
+                             const std::vector<float>& normals)
+    {
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            mesh.positions.push_back(positions[3 * key[0] + i]);
+            mesh.normals.push_back(key[2] < 0 ? 0.0f
+                                              : normals[3 * key[2] + i]);
+        }
+        // OBJ puts v = 0 at the bottom of the image, Vulkan at the top.
+        mesh.uvs.push_back(key[1] < 0 ? 0.0f : uvs[2 * key[1]]);
+        mesh.uvs.push_back(key[1] < 0 ? 0.0f : 1.0f - uvs[2 * key[1] + 1]);
+    }
+
+    static ObjChunk parseObjChunk(std::string_view text)
+    {
+        ObjChunk chunk;
+        std::vector<ObjCorner> face;
+        size_t position = 0;
+        while (position < text.size())
+        {
+            size_t end = text.find('\n', position);
+            if (end == std::string_view::npos)
+            {
+                end = text.size();
+            }
+            std::string_view line = text.substr(position, end - position);
+            position = end + 1;
+
+            if (line.starts_with("v "))
+            {
+                parseFloats(line.substr(2), 3, chunk.positions);
+            }
+            else if (line.starts_with("vt "))
+            {
+                parseFloats(line.substr(3), 2, chunk.uvs);
+            }
+            else if (line.starts_with("vn "))
+            {
+                parseFloats(line.substr(3), 3, chunk.normals);
+            }
+            else if (line.starts_with("f "))
+            {
+                face.clear();
+                if (!parseFace(line.substr(2), chunk, face))
+                {
+                    chunk.malformed = true;
+                    break;
+                }
+                for (size_t i = 2; i < face.size(); i++)
+                {
+                    chunk.corners.insert(chunk.corners.end(),
+                                         { face[0], face[i - 1], face[i] });
+                }
+            }
+        }
+        return chunk;
+    }
+
+    static void skipSpace(std::string_view& text)
+    {
+        while (!text.empty() &&
+               (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+    }
+
+    // Append count floats, missing ones as zero.
+    static void parseFloats(std::string_view text, uint32_t count,
+                            std::vector<float>& out)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            skipSpace(text);
+            float value = 0.0f;
+            const auto result =
+                std::from_chars(text.data(), text.data() + text.size(), value);
+            if (result.ec == std::errc())
+            {
+                text.remove_prefix(result.ptr - text.data());
+            }
+            out.push_back(value);
+        }
+    }
+
+    // Corners written as v, v/vt, v//vn or v/vt/vn. Returns false for a
+    // corner without a position index.
+    static bool parseFace(std::string_view text, const ObjChunk& chunk,
+                          std::vector<ObjCorner>& face)
+    {
+        const std::array<int64_t, 3> counts = {
+            static_cast<int64_t>(chunk.positions.size() / 3),
+            static_cast<int64_t>(chunk.uvs.size() / 2),
+            static_cast<int64_t>(chunk.normals.size() / 3)
+        };
+        while (true)
+        {
+            skipSpace(text);
+            if (text.empty() || text.front() == '\r')
+            {
+                return true;
+            }
+            ObjCorner corner { .index = { -1, -1, -1 }, .relative = 0 };
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                int64_t value = 0;
+                const auto result = std::from_chars(
+                    text.data(), text.data() + text.size(), value);
+                if (result.ec == std::errc())
+                {
+                    text.remove_prefix(result.ptr - text.data());
+                    if (value < 0)
+                    {
+                        corner.index[k] = counts[k] + value;
+                        corner.relative |= static_cast<uint8_t>(1u << k);
+                    }
+                    else
+                    {
+                        corner.index[k] = value - 1;
+                    }
+                }
+                else if (k == 0)
+                {
+                    return false;
+                }
+                if (text.empty() || text.front() != '/')
+                {
+                    break;
+                }
+                text.remove_prefix(1);
+            }
+            face.push_back(corner);
+        }
+    }
+
+    // glTF component types.
+    static constexpr uint32_t UNSIGNED_BYTE = 5121;
+    static constexpr uint32_t UNSIGNED_SHORT = 5123;
+    static constexpr uint32_t UNSIGNED_INT = 5125;
+    static constexpr uint32_t FLOAT = 5126;
+    static constexpr uint32_t TRIANGLES = 4;
+
+    struct GltfFile
+    {
+        MappedFile file;
+        JsonValue json;
+        std::vector<std::span<const std::byte>> buffers;
+        // External buffers, kept mapped while accessors are read.
+        std::vector<MappedFile> bufferFiles;
+    };
+
+    static MeshData loadGltf(const std::filesystem::path& path, bool binary,
+                             ThreadPool& pool)
+    {
+        GltfFile gltf;
+        gltf.file = MappedFile(path);
+        const std::span<const std::byte> bytes = gltf.file.bytes();
+        std::span<const std::byte> binChunk;
+        if (binary)
+        {
+            // 12-byte header, then a JSON chunk and an optional BIN chunk.
+            auto word = [&](size_t offset)
+            {
+                uint32_t value = 0;
+                if (offset + 4 > bytes.size())
+                {
+                    throw std::runtime_error("truncated GLB: " +
+                                             path.string());
+                }
+                std::memcpy(&value, bytes.data() + offset, 4);
+                return value;
+            };
+            if (word(0) != 0x46546c67 || word(4) != 2) // "glTF", version 2
+            {
+                throw std::runtime_error("not a glTF 2 binary: " +
+                                         path.string());
+            }
+            // Lengths are 32-bit in the file; sums are done in size_t so a
+            // huge length cannot wrap past the checks.
+            const size_t jsonLength = word(12);
+            if (word(16) != 0x4e4f534a || 20 + jsonLength > bytes.size())
+            {
+                throw std::runtime_error("missing GLB JSON chunk: " +
+                                         path.string());
+            }
+            gltf.json = JsonValue::parse(std::string_view(
+                reinterpret_cast<const char*>(bytes.data() + 20), jsonLength));
+            const size_t binOffset = 20 + (jsonLength + 3) / 4 * 4;
+            if (binOffset + 8 <= bytes.size() &&
+                word(binOffset + 4) == 0x004e4942) // "BIN\0"
+            {
+                binChunk = bytes.subspan(
+                    binOffset + 8,
+                    std::min<size_t>(word(binOffset),
+                                     bytes.size() - binOffset - 8));
+            }
+        }
+        else
+        {
+            gltf.json = JsonValue::parse(std::string_view(
+                reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+        }
+
+        for (const JsonValue& buffer : gltf.json["buffers"].elements())
+        {
+            const std::string_view uri = buffer["uri"].string();
+            if (uri.empty())
+            {
+                gltf.buffers.push_back(binChunk);
+            }
+            else if (uri.starts_with("data:"))
+            {
+                throw std::runtime_error(
+                    "embedded base64 buffers are not supported: " +
+                    path.string());
+            }
+            else
+            {
+                gltf.bufferFiles.emplace_back(path.parent_path() /
+                                              std::string(uri));
+                gltf.buffers.push_back(gltf.bufferFiles.back().bytes());
+            }
+        }
+
+        MeshData mesh;
+        for (const JsonValue& gltfMesh : gltf.json["meshes"].elements())
+        {
+            for (const JsonValue& primitive :
+                 gltfMesh["primitives"].elements())
+            {
+                if (primitive["mode"].index(TRIANGLES) != TRIANGLES)
+                {
+                    continue;
+                }
+                appendPrimitive(gltf, primitive, pool, mesh);
+            }
+        }
+        // Normals are recomputed if any primitive lacks them.
+        auto isNan = [](float v) { return std::isnan(v); };
+        if (std::ranges::any_of(mesh.normals, isNan))
+        {
+            mesh.normals.clear();
+        }
+        std::ranges::replace_if(mesh.uvs, isNan, 0.0f);
+        return mesh;
+    }
+
+    static void appendPrimitive(const GltfFile& gltf,
+                                const JsonValue& primitive, ThreadPool& pool,
+                                MeshData& mesh)
+    {
+        const JsonValue& attributes = primitive["attributes"];
+        if (attributes["POSITION"].isNull())
+        {
+            return;
+        }
+        const size_t base = mesh.vertexCount();
+        const size_t count =
+            readAccessor(gltf, attributes["POSITION"], 3, pool, mesh.positions);
+
+        // Streams the primitive lacks are filled with NaN so they stay
+        // aligned with the positions.
+        auto optional = [&](const char* name, uint32_t components,
+                            std::vector<float>& out)
+        {
+            if (attributes[name].isNull())
+            {
+                out.resize(components * (base + count), NAN);
+            }
+            else if (readAccessor(gltf, attributes[name], components, pool,
+                                  out) != count)
+            {
+                throw std::runtime_error("glTF attribute counts differ");
+            }
+        };
+        optional("NORMAL", 3, mesh.normals);
+        optional("TEXCOORD_0", 2, mesh.uvs);
+
+        const size_t first = mesh.indices.size();
+        if (primitive["indices"].isNull())
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                mesh.indices.push_back(static_cast<uint32_t>(base + i));
+            }
+        }
+        else
+        {
+            readIndices(gltf, primitive["indices"], pool, mesh.indices);
+        }
+        for (size_t i = first; i < mesh.indices.size(); i++)
+        {
+            if (mesh.indices[i] >= count)
+            {
+                throw std::runtime_error("glTF index out of range");
+            }
+            mesh.indices[i] += static_cast<uint32_t>(base);
+        }
+        mesh.indices.resize(first + (mesh.indices.size() - first) / 3 * 3);
+    }
+
+    // Bytes and layout of an accessor.
+    struct AccessorView
+    {
+        std::span<const std::byte> data;
+        size_t count = 0;
+        size_t stride = 0;
+        uint32_t componentType = 0;
+        bool normalized = false;
+    };
+
+    // The accessor must lie within its buffer view and the view within its
+    // buffer. Offsets and lengths come straight from the file, so every sum
+    // is checked by subtraction instead of added up.
+    static AccessorView accessorView(const GltfFile& gltf,
+                                     const JsonValue& accessorIndex,
+                                     uint32_t components)
+    {
+        const JsonValue& accessor =
+            gltf.json["accessors"][accessorIndex.index(SIZE_MAX)];
+        if (accessor.isNull())
+        {
+            throw std::runtime_error("invalid glTF accessor");
+        }
+        // Without a view an accessor is all zeros, which no mesh relies on.
+        if (accessor["bufferView"].isNull() || !accessor["sparse"].isNull())
+        {
+            throw std::runtime_error(
+                "sparse or view-less glTF accessors are not supported");
+        }
+        const size_t viewIndex = accessor["bufferView"].index(SIZE_MAX);
+        const JsonValue& view = gltf.json["bufferViews"][viewIndex];
+        const size_t bufferIndex = view["buffer"].index(SIZE_MAX);
+        if (view.isNull() || bufferIndex >= gltf.buffers.size())
+        {
+            throw std::runtime_error("invalid glTF accessor");
+        }
+
+        AccessorView result {
+            .data = {},
+            .count = accessor["count"].index(),
+            .componentType =
+                static_cast<uint32_t>(accessor["componentType"].index()),
+            .normalized = accessor["normalized"].boolean(),
+        };
+        const size_t componentSize =
+            result.componentType == UNSIGNED_BYTE    ? 1
+            : result.componentType == UNSIGNED_SHORT ? 2
+                                                     : 4;
+        const size_t elementSize = componentSize * components;
+        result.stride = view["byteStride"].index(elementSize);
+        const std::span<const std::byte> buffer = gltf.buffers[bufferIndex];
+        // Offsets default to zero, but one that is present must be valid.
+        auto offset = [](const JsonValue& value) -> uint64_t
+        { return value.isNull() ? 0 : value.index(SIZE_MAX); };
+        const uint64_t viewOffset = offset(view["byteOffset"]);
+        const uint64_t viewLength = view["byteLength"].index(SIZE_MAX);
+        const uint64_t accessorOffset = offset(accessor["byteOffset"]);
+        if (result.stride < elementSize || viewOffset > buffer.size() ||
+            viewLength > buffer.size() - viewOffset ||
+            accessorOffset > viewLength)
+        {
+            throw std::runtime_error("glTF accessor out of bounds");
+        }
+        const uint64_t available = viewLength - accessorOffset;
+        if (result.count != 0 &&
+            (elementSize > available ||
+             result.count - 1 > (available - elementSize) / result.stride))
+        {
+            throw std::runtime_error("glTF accessor out of bounds");
+        }
+        const size_t size =
+            result.count == 0
+                ? 0
+                : (result.count - 1) * result.stride + elementSize;
+        result.data = buffer.subspan(viewOffset + accessorOffset, size);
+        return result;
+    }
+
+    // Append a float accessor, or a normalized integer one, as floats.
+    static size_t readAccessor(const GltfFile& gltf, const JsonValue& index,
+                               uint32_t components, ThreadPool& pool,
+                               std::vector<float>& out)
+    {
+        const AccessorView view = accessorView(gltf, index, components);
+        if (view.componentType != FLOAT &&
+            !(view.normalized && (view.componentType == UNSIGNED_BYTE ||
+                                  view.componentType == UNSIGNED_SHORT)))
+        {
+            throw std::runtime_error("unsupported glTF attribute format");
+        }
+        const size_t first = out.size();
+        out.resize(first + components * view.count);
+        pool.parallelFor(
+            view.count,
+            16384,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const std::byte* element =
+                        view.data.data() + i * view.stride;
+                    float* target = out.data() + first + components * i;
+                    for (uint32_t c = 0; c < components; c++)
+                    {
+                        target[c] = component(element, c, view.componentType);
+                    }
+                }
+            });
+        return view.count;
+    }
+
+    static float component(const std::byte* element, uint32_t c,
+                           uint32_t componentType)
+    {
+        if (componentType == FLOAT)
+        {
+            float value;
+            std::memcpy(&value, element + 4 * c, 4);
+            return value;
+        }
+        if (componentType == UNSIGNED_SHORT)
+        {
+            uint16_t value;
+            std::memcpy(&value, element + 2 * c, 2);
+            return static_cast<float>(value) / 65535.0f;
+        }
+        return static_cast<float>(element[c]) / 255.0f;
+    }
+
+    static void readIndices(const GltfFile& gltf, const JsonValue& index,
+                            ThreadPool& pool, std::vector<uint32_t>& out)
+    {
+        const AccessorView view = accessorView(gltf, index, 1);
+        if (view.componentType != UNSIGNED_BYTE &&
+            view.componentType != UNSIGNED_SHORT &&
+            view.componentType != UNSIGNED_INT)
+        {
+            throw std::runtime_error("unsupported glTF index format");
+        }
+        const size_t first = out.size();
+        out.resize(first + view.count);
+        pool.parallelFor(
+            view.count,
+            65536,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const std::byte* element =
+                        view.data.data() + i * view.stride;
+                    uint32_t value = 0;
+                    std::memcpy(&value, element,
+                                view.componentType == UNSIGNED_INT     ? 4
+                                : view.componentType == UNSIGNED_SHORT ? 2
+                                                                       : 1);
+                    out[first + i] = value; // little-endian hosts only
+                }
+            });
+    }
+
+    // Area-weighted vertex normals from the winding of the faces.
+    static void computeNormals(MeshData& mesh)
+    {
+        mesh.normals.assign(mesh.positions.size(), 0.0f);
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+        {
+            const float* a = &mesh.positions[3 * mesh.indices[t]];
+            const float* b = &mesh.positions[3 * mesh.indices[t + 1]];
+            const float* c = &mesh.positions[3 * mesh.indices[t + 2]];
+            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                                      e1[2] * e2[0] - e1[0] * e2[2],
+                                      e1[0] * e2[1] - e1[1] * e2[0] };
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                float* target = &mesh.normals[3 * mesh.indices[t + corner]];
+                for (uint32_t i = 0; i < 3; i++)
+                {
+                    target[i] += normal[i];
+                }
+            }
+        }
+        for (size_t v = 0; v < mesh.vertexCount(); v++)
+        {
+            float* normal = &mesh.normals[3 * v];
+            const float length = std::hypot(normal[0], normal[1], normal[2]);
+            if (length > 0.0f)
+            {
+                for (uint32_t i = 0; i < 3; i++)
+                {
+                    normal[i] /= length;
+                }
+            }
+            else
+            {
+                normal[2] = 1.0f;
+            }
+        }
+    }
+};
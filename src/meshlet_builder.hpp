@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "thread_pool.hpp"
+
+// Must match Meshlet in meshlets.slang.
+struct Meshlet
+{
+    // Limits recommended for VK_EXT_mesh_shader on current hardware. Local
+    // indices must fit in 8 bits.
+    static constexpr uint32_t MAX_VERTICES = 64;
+    static constexpr uint32_t MAX_TRIANGLES = 124;
+
+    // Bounding sphere of the vertices.
+    float center[3] = {};
+    float radius = 0.0f;
+    // Every triangle faces away from a viewer looking along d when
+    // dot(d, coneAxis) >= coneCutoff. Meshlets whose normals spread over
+    // more than a hemisphere get a zero axis, so they are never culled.
+    float coneAxis[3] = {};
+    float coneCutoff = 1.0f;
+    // Ranges of MeshletMesh::vertices and MeshletMesh::triangles.
+    uint32_t vertexOffset = 0;
+    uint32_t triangleOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+};
+
+// An indexed mesh split into meshlets. Each meshlet lists the mesh vertices
+// it uses, and its triangles index into that list, so a mesh shader
+// workgroup transforms every vertex once and emits local triangles.
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    // Mesh vertex index of each meshlet vertex.
+    std::vector<uint32_t> vertices;
+    // Three 8-bit meshlet vertex indices per triangle, lowest byte first.
+    std::vector<uint32_t> triangles;
+    // Hash of the indices and positions the meshlets were built from.
+    uint64_t sourceHash = 0;
+
+    // Write to path through a temporary file and a rename. Returns false if
+    // the file could not be written.
+    bool save(const std::filesystem::path& path) const
+    {
+        const FileHeader header {
+            .sourceHash = sourceHash,
+            .meshletCount = meshlets.size(),
+            .vertexCount = vertices.size(),
+            .triangleCount = triangles.size(),
+            .payloadHash = payloadHash(),
+        };
+        std::filesystem::path tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            write(file, &header, sizeof(header));
+            write(file, meshlets.data(), sizeof(Meshlet) * meshlets.size());
+            write(file, vertices.data(), sizeof(uint32_t) * vertices.size());
+            write(file, triangles.data(), sizeof(uint32_t) * triangles.size());
+            if (!file)
+            {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tmpPath, path, error);
+        if (error)
+        {
+            std::filesystem::remove(tmpPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    // Read meshlets saved from the mesh hashing to sourceHash, or nothing
+    // with the reason if path holds anything else. Every range and index is
+    // checked, since the mesh shader reads through them unchecked;
+    // meshVertexCount bounds the mesh vertex indices.
+    static std::optional<MeshletMesh> load(const std::filesystem::path& path,
+                                           uint64_t sourceHash,
+                                           size_t meshVertexCount,
+                                           std::string& reason)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            reason = "no meshlet file";
+            return std::nullopt;
+        }
+        FileHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != MAGIC ||
+            header.fileVersion != FILE_VERSION)
+        {
+            reason = "unrecognized file header";
+            return std::nullopt;
+        }
+        if (header.sourceHash != sourceHash)
+        {
+            reason = "built from a different mesh";
+            return std::nullopt;
+        }
+
+        // Sizes must add up to the file before anything is allocated.
+        std::error_code error;
+        const uint64_t payloadSize =
+            std::filesystem::file_size(path, error) - sizeof(header);
+        if (error || header.meshletCount > payloadSize / sizeof(Meshlet) ||
+            header.vertexCount > payloadSize / sizeof(uint32_t) ||
+            header.triangleCount > payloadSize / sizeof(uint32_t) ||
+            header.meshletCount * sizeof(Meshlet) +
+                    (header.vertexCount + header.triangleCount) *
+                        sizeof(uint32_t) !=
+                payloadSize)
+        {
+            reason = "truncated";
+            return std::nullopt;
+        }
+
+        MeshletMesh mesh;
+        mesh.sourceHash = sourceHash;
+        mesh.meshlets.resize(header.meshletCount);
+        mesh.vertices.resize(header.vertexCount);
+        mesh.triangles.resize(header.triangleCount);
+        read(file, mesh.meshlets.data(), sizeof(Meshlet) * mesh.meshlets.size());
+        read(file, mesh.vertices.data(), sizeof(uint32_t) * mesh.vertices.size());
+        read(file, mesh.triangles.data(),
+             sizeof(uint32_t) * mesh.triangles.size());
+        if (!file || file.peek() != std::ifstream::traits_type::eof())
+        {
+            reason = "truncated";
+            return std::nullopt;
+        }
+        if (mesh.payloadHash() != header.payloadHash)
+        {
+            reason = "checksum mismatch";
+            return std::nullopt;
+        }
+        if (!mesh.valid(meshVertexCount))
+        {
+            reason = "meshlet out of range";
+            return std::nullopt;
+        }
+        return mesh;
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x4c4d564c; // "LVML"
+    static constexpr uint32_t FILE_VERSION = 2;
+
+    struct FileHeader
+    {
+        uint32_t magic = MAGIC;
+        uint32_t fileVersion = FILE_VERSION;
+        uint64_t sourceHash = 0;
+        uint64_t meshletCount = 0;
+        uint64_t vertexCount = 0;
+        uint64_t triangleCount = 0;
+        uint64_t payloadHash = 0;
+    };
+
+    // 64-bit FNV-1a over the meshlets, vertices and triangles, to catch torn
+    // or corrupted files.
+    uint64_t payloadHash() const
+    {
+        uint64_t value = 0xcbf29ce484222325ull;
+        auto mix = [&value](const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                value = (value ^ bytes[i]) * 0x100000001b3ull;
+            }
+        };
+        mix(meshlets.data(), sizeof(Meshlet) * meshlets.size());
+        mix(vertices.data(), sizeof(uint32_t) * vertices.size());
+        mix(triangles.data(), sizeof(uint32_t) * triangles.size());
+        return value;
+    }
+
+    // Whether every meshlet stays within the limits and its ranges, and every
+    // index it holds points at a vertex that exists.
+    bool valid(size_t meshVertexCount) const
+    {
+        for (const Meshlet& meshlet : meshlets)
+        {
+            if (meshlet.vertexCount > Meshlet::MAX_VERTICES ||
+                meshlet.triangleCount > Meshlet::MAX_TRIANGLES ||
+                static_cast<uint64_t>(meshlet.vertexOffset) +
+                        meshlet.vertexCount >
+                    vertices.size() ||
+                static_cast<uint64_t>(meshlet.triangleOffset) +
+                        meshlet.triangleCount >
+                    triangles.size())
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            {
+                if (vertices[meshlet.vertexOffset + i] >= meshVertexCount)
+                {
+                    return false;
+                }
+            }
+            for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+            {
+                const uint32_t packed = triangles[meshlet.triangleOffset + i];
+                for (uint32_t corner = 0; corner < 3; corner++)
+                {
+                    if (((packed >> (8 * corner)) & 0xff) >=
+                        meshlet.vertexCount)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    static void write(std::ofstream& file, const void* data, size_t size)
+    {
+        file.write(static_cast<const char*>(data),
+                   static_cast<std::streamsize>(size));
+    }
+
+    static void read(std::ifstream& file, void* data, size_t size)
+    {
+        file.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    }
+};
+
+// Splits triangle lists into meshlets. Triangles are taken greedily in index
+// order, so meshes whose index order is already spatially coherent give
+// compact meshlets. The index buffer is cut into fixed chunks built on
+// separate threads and concatenated in order, which only leaves one partly
+// filled meshlet per chunk; bounds are then computed per meshlet in
+// parallel.
+class MeshletBuilder
+{
+public:
+    static constexpr uint32_t MAX_VERTICES = Meshlet::MAX_VERTICES;
+    static constexpr uint32_t MAX_TRIANGLES = Meshlet::MAX_TRIANGLES;
+    static constexpr size_t CHUNK_TRIANGLES = 16384;
+
+    // positions holds x, y, z for every vertex referenced by indices.
+    static MeshletMesh build(std::span<const uint32_t> indices,
+                             std::span<const float> positions,
+                             ThreadPool& pool)
+    {
+        CPU_ZONE("buildMeshlets");
+        const size_t triangleCount = indices.size() / 3;
+        const size_t chunkCount =
+            (triangleCount + CHUNK_TRIANGLES - 1) / CHUNK_TRIANGLES;
+        std::vector<MeshletMesh> chunks(chunkCount);
+        pool.parallelFor(
+            chunkCount,
+            1,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t chunk = begin; chunk < end; chunk++)
+                {
+                    const size_t first = chunk * CHUNK_TRIANGLES;
+                    const size_t last =
+                        std::min(triangleCount, first + CHUNK_TRIANGLES);
+                    chunks[chunk] = buildChunk(
+                        indices.subspan(3 * first, 3 * (last - first)));
+                }
+            });
+
+        MeshletMesh mesh;
+        mesh.sourceHash = hash(indices, positions);
+        size_t meshletCount = 0;
+        size_t vertexCount = 0;
+        size_t packedCount = 0;
+        for (const MeshletMesh& chunk : chunks)
+        {
+            meshletCount += chunk.meshlets.size();
+            vertexCount += chunk.vertices.size();
+            packedCount += chunk.triangles.size();
+        }
+        mesh.meshlets.reserve(meshletCount);
+        mesh.vertices.reserve(vertexCount);
+        mesh.triangles.reserve(packedCount);
+        for (const MeshletMesh& chunk : chunks)
+        {
+            const uint32_t vertexBase =
+                static_cast<uint32_t>(mesh.vertices.size());
+            const uint32_t triangleBase =
+                static_cast<uint32_t>(mesh.triangles.size());
+            for (Meshlet meshlet : chunk.meshlets)
+            {
+                meshlet.vertexOffset += vertexBase;
+                meshlet.triangleOffset += triangleBase;
+                mesh.meshlets.push_back(meshlet);
+            }
+            mesh.vertices.insert(mesh.vertices.end(), chunk.vertices.begin(),
+                                 chunk.vertices.end());
+            mesh.triangles.insert(mesh.triangles.end(),
+                                  chunk.triangles.begin(),
+                                  chunk.triangles.end());
+        }
+
+        pool.parallelFor(mesh.meshlets.size(),
+                         256,
+                         [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; i++)
+                             {
+                                 computeBounds(mesh, positions,
+                                               mesh.meshlets[i]);
+                             }
+                         });
+        return mesh;
+    }
+
+    // 64-bit FNV-1a over the indices and positions, to tell whether saved
+    // meshlets still match their mesh.
+    static uint64_t hash(std::span<const uint32_t> indices,
+                         std::span<const float> positions)
+    {
+        uint64_t value = 0xcbf29ce484222325ull;
+        auto mix = [&value](const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                value = (value ^ bytes[i]) * 0x100000001b3ull;
+            }
+        };
+        const uint64_t sizes[] = { indices.size(), positions.size() };
+        mix(sizes, sizeof(sizes));
+        mix(indices.data(), indices.size_bytes());
+        mix(positions.data(), positions.size_bytes());
+        return value;
+    }
+
+private:
+    static MeshletMesh buildChunk(std::span<const uint32_t> indices)
+    {
+        MeshletMesh mesh;
+        mesh.meshlets.reserve(indices.size() / 3 / MAX_TRIANGLES + 1);
+        mesh.triangles.reserve(indices.size() / 3);
+        Meshlet current {};
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            // a corner repeated within the triangle counts once
+            uint32_t newVertices = 0;
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t vertex = indices[i + corner];
+                const bool repeated =
+                    (corner > 0 && indices[i] == vertex) ||
+                    (corner > 1 && indices[i + 1] == vertex);
+                if (!repeated &&
+                    localIndex(mesh, current, vertex) == MAX_VERTICES)
+                {
+                    newVertices++;
+                }
+            }
+            if (current.vertexCount + newVertices > MAX_VERTICES ||
+                current.triangleCount == MAX_TRIANGLES)
+            {
+                mesh.meshlets.push_back(current);
+                current = Meshlet {
+                    .vertexOffset = static_cast<uint32_t>(mesh.vertices.size()),
+                    .triangleOffset =
+                        static_cast<uint32_t>(mesh.triangles.size()),
+                };
+            }
+
+            uint32_t packed = 0;
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                uint32_t slot = localIndex(mesh, current, indices[i + corner]);
+                if (slot == MAX_VERTICES)
+                {
+                    slot = current.vertexCount++;
+                    mesh.vertices.push_back(indices[i + corner]);
+                }
+                packed |= slot << (8 * corner);
+            }
+            mesh.triangles.push_back(packed);
+            current.triangleCount++;
+        }
+        if (current.triangleCount > 0)
+        {
+            mesh.meshlets.push_back(current);
+        }
+        return mesh;
+    }
+
+    // Slot of vertex in the meshlet being built, MAX_VERTICES if absent.
+    static uint32_t localIndex(const MeshletMesh& mesh, const Meshlet& meshlet,
+                               uint32_t vertex)
+    {
+        const uint32_t* begin = mesh.vertices.data() + meshlet.vertexOffset;
+        const uint32_t* end = begin + meshlet.vertexCount;
+        const uint32_t* found = std::find(begin, end, vertex);
+        return found == end ? MAX_VERTICES
+                            : static_cast<uint32_t>(found - begin);
+    }
+
+    static void computeBounds(const MeshletMesh& mesh,
+                              std::span<const float> positions,
+                              Meshlet& meshlet)
+    {
+        auto position = [&](uint32_t slot, uint32_t axis)
+        {
+            return positions[3 * mesh.vertices[meshlet.vertexOffset + slot] +
+                             axis];
+        };
+
+        // Sphere around the box center: not minimal, but one pass.
+        float low[3] = { INFINITY, INFINITY, INFINITY };
+        float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+        {
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                low[axis] = std::min(low[axis], position(v, axis));
+                high[axis] = std::max(high[axis], position(v, axis));
+            }
+        }
+        float radius2 = 0.0f;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            meshlet.center[axis] = 0.5f * (low[axis] + high[axis]);
+        }
+        for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+        {
+            float distance2 = 0.0f;
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                const float d = position(v, axis) - meshlet.center[axis];
+                distance2 += d * d;
+            }
+            radius2 = std::max(radius2, distance2);
+        }
+        meshlet.radius = std::sqrt(radius2);
+
+        // Cone around the mean normal. Normals follow the winding,
+        // cross(b - a, c - a).
+        std::vector<std::array<float, 3>> normals;
+        normals.reserve(meshlet.triangleCount);
+        float axis[3] = {};
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            const uint32_t packed = mesh.triangles[meshlet.triangleOffset + t];
+            float corners[3][3];
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                for (uint32_t i = 0; i < 3; i++)
+                {
+                    corners[corner][i] =
+                        position((packed >> (8 * corner)) & 0xff, i);
+                }
+            }
+            float e1[3];
+            float e2[3];
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                e1[i] = corners[1][i] - corners[0][i];
+                e2[i] = corners[2][i] - corners[0][i];
+            }
+            std::array<float, 3> normal = { e1[1] * e2[2] - e1[2] * e2[1],
+                                            e1[2] * e2[0] - e1[0] * e2[2],
+                                            e1[0] * e2[1] - e1[1] * e2[0] };
+            const float length = std::hypot(normal[0], normal[1], normal[2]);
+            if (length == 0.0f)
+            {
+                continue; // degenerate triangles face nowhere
+            }
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                normal[i] /= length;
+                axis[i] += normal[i];
+            }
+            normals.push_back(normal);
+        }
+
+        const float axisLength = std::hypot(axis[0], axis[1], axis[2]);
+        float minDot = 1.0f;
+        if (axisLength > 0.0f)
+        {
+            for (float& component : axis)
+            {
+                component /= axisLength;
+            }
+            for (const std::array<float, 3>& normal : normals)
+            {
+                minDot = std::min(minDot, normal[0] * axis[0] +
+                                              normal[1] * axis[1] +
+                                              normal[2] * axis[2]);
+            }
+        }
+        if (axisLength == 0.0f || minDot <= 0.0f)
+        {
+            meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] =
+                0.0f;
+            meshlet.coneCutoff = 1.0f;
+            return;
+        }
+        std::copy(axis, axis + 3, meshlet.coneAxis);
+        // A view direction within 90 degrees minus the cone's half angle of
+        // the axis sees only back faces.
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+};
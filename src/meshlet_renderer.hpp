@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "descriptor_heap.hpp"
+#include "gpu_allocator.hpp"
+#include "meshlet_builder.hpp"
+#include "pipeline_cache.hpp"
+
+// Draws instances of a meshlet mesh with a task and mesh shader pipeline
+// (VK_EXT_mesh_shader). Each task workgroup tests TASK_GROUP_SIZE meshlets
+// of one instance against the view and their normal cone, and launches a
+// mesh workgroup per surviving meshlet. Vertices, instances and meshlets are
+// all read through the descriptor heap, so the pipeline has no vertex input.
+class MeshletRenderer
+{
+public:
+    // Must match TASK_GROUP_SIZE in meshlets.slang.
+    static constexpr uint32_t TASK_GROUP_SIZE = 32;
+
+    // Must match MeshletConstants in meshlets.slang.
+    struct PushConstants
+    {
+        uint32_t meshletCount = 0;
+        uint32_t instanceCount = 0;
+        uint32_t firstInstance = 0;
+        float viewScale = 1.0f;
+        // Storage buffer indices in the descriptor heap.
+        uint32_t meshletIndex = 0;
+        uint32_t meshletVertexIndex = 0;
+        uint32_t meshletTriangleIndex = 0;
+        uint32_t vertexIndex = 0;
+        uint32_t instanceIndex = 0;
+        uint32_t staticIndex = 0;
+    };
+
+    // Whether the device can run the pipeline.
+    static bool supported(const vk::raii::PhysicalDevice& physicalDevice)
+    {
+        const auto features = physicalDevice.getFeatures2<
+            vk::PhysicalDeviceFeatures2,
+            vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+        const auto& meshFeatures =
+            features.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+        return meshFeatures.taskShader && meshFeatures.meshShader;
+    }
+
+    // meshletBuffer, meshletVertexBuffer and meshletTriangleBuffer hold the
+    // arrays of mesh, vertexBuffer the Vertex array. instanceBuffers and
+    // staticBuffer are laid out as for GpuCuller.
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device, DescriptorHeap& heap,
+              PersistentPipelineCache& pipelineCache,
+              const vk::raii::ShaderModule& shaderModule,
+              vk::Format colorFormat, const MeshletMesh& mesh,
+              uint32_t instanceCount, const AllocatedBuffer& meshletBuffer,
+              const AllocatedBuffer& meshletVertexBuffer,
+              const AllocatedBuffer& meshletTriangleBuffer,
+              const AllocatedBuffer& vertexBuffer,
+              const std::vector<AllocatedBuffer>& instanceBuffers,
+              const AllocatedBuffer& staticBuffer)
+    {
+        this->heap = &heap;
+        constants.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+        constants.instanceCount = instanceCount;
+        triangleCount = mesh.triangles.size();
+
+        const auto properties = physicalDevice.getProperties2<
+            vk::PhysicalDeviceProperties2,
+            vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+        const auto& meshProperties =
+            properties.get<vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+        groupCountX =
+            (constants.meshletCount + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE;
+        if (groupCountX > meshProperties.maxTaskWorkGroupCount[0])
+        {
+            throw std::runtime_error("too many meshlets for one task dispatch");
+        }
+        // Instances are spread over y, as many per dispatch as the limits
+        // allow.
+        maxInstancesPerDispatch =
+            std::min(meshProperties.maxTaskWorkGroupCount[1],
+                     meshProperties.maxTaskWorkGroupTotalCount /
+                         std::max(groupCountX, 1u));
+
+        meshletHandle = heap.addStorageBuffer(*meshletBuffer.buffer);
+        meshletVertexHandle = heap.addStorageBuffer(*meshletVertexBuffer.buffer);
+        meshletTriangleHandle =
+            heap.addStorageBuffer(*meshletTriangleBuffer.buffer);
+        vertexHandle = heap.addStorageBuffer(*vertexBuffer.buffer);
+        staticHandle = heap.addStorageBuffer(*staticBuffer.buffer);
+        instanceHandles.clear();
+        for (const AllocatedBuffer& instanceBuffer : instanceBuffers)
+        {
+            instanceHandles.push_back(
+                heap.addStorageBuffer(*instanceBuffer.buffer));
+        }
+        constants.meshletIndex = meshletHandle.get();
+        constants.meshletVertexIndex = meshletVertexHandle.get();
+        constants.meshletTriangleIndex = meshletTriangleHandle.get();
+        constants.vertexIndex = vertexHandle.get();
+        constants.staticIndex = staticHandle.get();
+
+        vk::PushConstantRange pushConstantRange { .stageFlags = STAGES,
+                                                  .offset = 0,
+                                                  .size = sizeof(PushConstants) };
+        pipelineLayout = vk::raii::PipelineLayout(
+            device,
+            vk::PipelineLayoutCreateInfo {
+                .setLayoutCount = 1,
+                .pSetLayouts = &*heap.layout(),
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &pushConstantRange });
+        pipeline = createPipeline(device, pipelineCache, shaderModule,
+                                  colorFormat);
+    }
+
+    uint32_t meshletCount() const { return constants.meshletCount; }
+
+    // Draw instanceCount instances from firstInstance. Must be inside the
+    // rendering pass, with the viewport and scissor set.
+    void recordDraw(const vk::raii::CommandBuffer& commandBuffer,
+                    uint32_t frameIndex, float viewScale,
+                    uint32_t firstInstance, uint32_t instanceCount) const
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        heap->bind(commandBuffer, vk::PipelineBindPoint::eGraphics,
+                   *pipelineLayout);
+        PushConstants drawConstants = constants;
+        drawConstants.viewScale = viewScale;
+        drawConstants.instanceIndex = instanceHandles[frameIndex].get();
+        const uint32_t end = firstInstance + instanceCount;
+        for (uint32_t first = firstInstance; first < end;
+             first += maxInstancesPerDispatch)
+        {
+            drawConstants.firstInstance = first;
+            commandBuffer.pushConstants<PushConstants>(
+                pipelineLayout, STAGES, 0, drawConstants);
+            commandBuffer.drawMeshTasksEXT(
+                groupCountX, std::min(maxInstancesPerDispatch, end - first), 1);
+        }
+    }
+
+    // Meshlets per mesh and their mean triangle count.
+    void report(std::ostream& out) const
+    {
+        out << "meshlets: " << constants.meshletCount << " per mesh, "
+            << static_cast<double>(triangleCount) /
+                   std::max(constants.meshletCount, 1u)
+            << " triangles each" << std::endl;
+    }
+
+private:
+    static constexpr vk::ShaderStageFlags STAGES =
+        vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+
+    const DescriptorHeap* heap = nullptr;
+    PushConstants constants;
+    size_t triangleCount = 0;
+    uint32_t groupCountX = 0;
+    uint32_t maxInstancesPerDispatch = 1;
+
+    DescriptorHeap::Handle meshletHandle;
+    DescriptorHeap::Handle meshletVertexHandle;
+    DescriptorHeap::Handle meshletTriangleHandle;
+    DescriptorHeap::Handle vertexHandle;
+    DescriptorHeap::Handle staticHandle;
+    std::vector<DescriptorHeap::Handle> instanceHandles;
+    vk::raii::PipelineLayout pipelineLayout = nullptr;
+    vk::raii::Pipeline pipeline = nullptr;
+
+    // Same fixed state as the vertex pipeline, minus vertex input and input
+    // assembly, which mesh pipelines do not have.
+    vk::raii::Pipeline createPipeline(const vk::raii::Device& device,
+                                      PersistentPipelineCache& pipelineCache,
+                                      const vk::raii::ShaderModule& shaderModule,
+                                      vk::Format colorFormat) const
+    {
+        const std::array stages = {
+            vk::PipelineShaderStageCreateInfo {
+                .stage = vk::ShaderStageFlagBits::eTaskEXT,
+                .module = shaderModule,
+                .pName = "meshletTaskMain" },
+            vk::PipelineShaderStageCreateInfo {
+                .stage = vk::ShaderStageFlagBits::eMeshEXT,
+                .module = shaderModule,
+                .pName = "meshletMeshMain" },
+            vk::PipelineShaderStageCreateInfo {
+                .stage = vk::ShaderStageFlagBits::eFragment,
+                .module = shaderModule,
+                .pName = "meshletFragMain" },
+        };
+        vk::PipelineViewportStateCreateInfo viewportState { .viewportCount = 1,
+                                                            .scissorCount = 1 };
+        vk::PipelineRasterizationStateCreateInfo rasterizer {
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eBack,
+            .frontFace = vk::FrontFace::eClockwise,
+            .lineWidth = 1.0f
+        };
+        vk::PipelineMultisampleStateCreateInfo multisampling {
+            .rasterizationSamples = vk::SampleCountFlagBits::e1
+        };
+        vk::PipelineDepthStencilStateCreateInfo depthStencil;
+        vk::PipelineColorBlendAttachmentState colorBlendAttachment {
+            .blendEnable = vk::False,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR |
+                              vk::ColorComponentFlagBits::eG |
+                              vk::ColorComponentFlagBits::eB |
+                              vk::ColorComponentFlagBits::eA
+        };
+        vk::PipelineColorBlendStateCreateInfo colorBlending {
+            .attachmentCount = 1,
+            .pAttachments = &colorBlendAttachment
+        };
+        const std::array dynamicStates = { vk::DynamicState::eViewport,
+                                           vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo dynamicState {
+            .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+            .pDynamicStates = dynamicStates.data()
+        };
+
+        vk::PipelineCreationFeedback feedback;
+        vk::PipelineCreationFeedbackCreateInfo feedbackInfo {
+            .pPipelineCreationFeedback = &feedback
+        };
+        vk::PipelineRenderingCreateInfo renderingInfo {
+            .pNext = &feedbackInfo,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &colorFormat
+        };
+        vk::raii::Pipeline result(
+            device,
+            pipelineCache.get(),
+            vk::GraphicsPipelineCreateInfo {
+                .pNext = &renderingInfo,
+                .stageCount = static_cast<uint32_t>(stages.size()),
+                .pStages = stages.data(),
+                .pViewportState = &viewportState,
+                .pRasterizationState = &rasterizer,
+                .pMultisampleState = &multisampling,
+                .pDepthStencilState = &depthStencil,
+                .pColorBlendState = &colorBlending,
+                .pDynamicState = &dynamicState,
+                .layout = pipelineLayout });
+        pipelineCache.recordFeedback("meshlet pipeline", feedback);
+        return result;
+    }
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "cpu_profiler.hpp"
+#include "thread_pool.hpp"
+
+// Records secondary command buffers on a thread pool. Work is split into a
+// fixed number of slots, and each slot owns one command pool per frame in
+// flight. A slot is only recorded by one thread at a time, so its pools need
+// no locking. A frame's pools are reset in bulk when the frame records again,
+// so no buffer is ever reset on its own.
+class ParallelRecorder
+{
+public:
+    using RecordFn =
+        std::function<void(const vk::raii::CommandBuffer&, uint32_t slot)>;
+
+    void init(const vk::raii::Device& device, uint32_t queueFamilyIndex,
+              uint32_t framesInFlight, uint32_t slotCount)
+    {
+        frames.clear();
+        frames.resize(framesInFlight);
+        for (Frame& frame : frames)
+        {
+            for (uint32_t i = 0; i < slotCount; i++)
+            {
+                vk::raii::CommandPool pool(
+                    device,
+                    vk::CommandPoolCreateInfo {
+                        .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                        .queueFamilyIndex = queueFamilyIndex });
+                vk::CommandBufferAllocateInfo allocInfo {
+                    .commandPool = pool,
+                    .level = vk::CommandBufferLevel::eSecondary,
+                    .commandBufferCount = 1
+                };
+                vk::raii::CommandBuffer commandBuffer = std::move(
+                    vk::raii::CommandBuffers(device, allocInfo).front());
+                frame.handles.push_back(*commandBuffer);
+                frame.slots.push_back({ .pool = std::move(pool),
+                                        .commandBuffer =
+                                            std::move(commandBuffer) });
+            }
+        }
+    }
+
+    uint32_t slotCount() const
+    {
+        return frames.empty() ? 0
+                              : static_cast<uint32_t>(frames[0].slots.size());
+    }
+
+    // Reset the frame's pools and record fn into each slot's secondary
+    // buffer, one slot per task. The frame's previous submission must have
+    // completed. inheritance is passed to every begin; the returned handles
+    // are in slot order, ready for executeCommands.
+    const std::vector<vk::CommandBuffer>&
+    record(ThreadPool& threadPool, uint32_t frameIndex,
+           const vk::CommandBufferInheritanceInfo& inheritance,
+           vk::CommandBufferUsageFlags usage, const RecordFn& fn)
+    {
+        Frame& frame = frames[frameIndex];
+        threadPool.parallelFor(
+            frame.slots.size(),
+            1,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    CPU_ZONE("recordSecondary");
+                    Slot& slot = frame.slots[i];
+                    slot.pool.reset();
+                    slot.commandBuffer.begin(vk::CommandBufferBeginInfo {
+                        .flags = usage,
+                        .pInheritanceInfo = &inheritance });
+                    fn(slot.commandBuffer, static_cast<uint32_t>(i));
+                    slot.commandBuffer.end();
+                }
+            });
+        return frame.handles;
+    }
+
+private:
+    struct Slot
+    {
+        vk::raii::CommandPool pool = nullptr;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+    };
+
+    struct Frame
+    {
+        std::vector<Slot> slots;
+        std::vector<vk::CommandBuffer> handles;
+    };
+
+    std::vector<Frame> frames;
+};
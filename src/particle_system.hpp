@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "descriptor_heap.hpp"
+#include "gpu_allocator.hpp"
+#include "gpu_timer.hpp"
+#include "pipeline_cache.hpp"
+
+// Particles simulated by a compute shader and drawn as points in the main
+// rendering pass. The state lives in a ring of storage buffers, one per
+// frame in flight and at least two: each frame's dispatch reads the
+// previous frame's buffer and writes the next, which that frame then draws.
+// The buffer a dispatch overwrites was last drawn by the frame that used the
+// same slot, whose fence the CPU has already waited for.
+//
+// With a compute queue family separate from graphics, the dispatch is
+// submitted there and signals a timeline semaphore the graphics submit waits
+// on at vertex input, so simulating frame n overlaps drawing frame n - 1.
+// Buffers are shared concurrently between the two families instead of
+// transferring ownership every frame. Without one, the dispatch is recorded
+// into the graphics command buffer ahead of rendering.
+class ParticleSystem
+{
+public:
+    // Must match [numthreads] in particles.slang.
+    static constexpr uint32_t WORKGROUP_SIZE = 256;
+    // Fixed step, so runs are repeatable whatever the frame rate.
+    static constexpr float TIME_STEP = 1.0f / 60.0f;
+
+    // Must match Particle in particles.slang.
+    struct Particle
+    {
+        float position[2];
+        float velocity[2];
+    };
+
+    // Must match ParticleConstants in particles.slang.
+    struct PushConstants
+    {
+        uint32_t count = 0;
+        float deltaTime = TIME_STEP;
+        // Storage buffer indices in the descriptor heap.
+        uint32_t srcIndex = 0;
+        uint32_t dstIndex = 0;
+        float viewScale = 1.0f;
+    };
+
+    // Largest count one dispatch and one storage buffer binding cover on a
+    // device with these limits.
+    static uint32_t maxCount(const vk::PhysicalDeviceLimits& limits)
+    {
+        const uint64_t byGroups =
+            uint64_t(limits.maxComputeWorkGroupCount[0]) * WORKGROUP_SIZE;
+        const uint64_t byRange =
+            limits.maxStorageBufferRange / sizeof(Particle);
+        return static_cast<uint32_t>(std::min(byGroups, byRange));
+    }
+
+    // computeQueue is null to simulate on the graphics queue. queueMutex is
+    // held for every submit to computeQueue.
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device, GpuAllocator& allocator,
+              DescriptorHeap& heap, PersistentPipelineCache& pipelineCache,
+              const vk::raii::ShaderModule& shaderModule,
+              vk::Format colorFormat, uint32_t particleCount,
+              uint32_t framesInFlight, GpuTimer& graphicsTimer,
+              const vk::raii::Queue* computeQueue, uint32_t computeFamily,
+              uint32_t graphicsFamily, std::mutex* queueMutex)
+    {
+        this->device = &device;
+        this->heap = &heap;
+        this->computeQueue = computeQueue;
+        this->queueMutex = queueMutex;
+        timer = &graphicsTimer;
+        const uint32_t limit = maxCount(physicalDevice.getProperties().limits);
+        if (particleCount > limit)
+        {
+            throw std::runtime_error(
+                std::to_string(particleCount) +
+                " particles exceed the device limit of " +
+                std::to_string(limit));
+        }
+        constants.count = particleCount;
+
+        const std::array<uint32_t, 2> families = { computeFamily,
+                                                   graphicsFamily };
+        const bool concurrent = async() && computeFamily != graphicsFamily;
+        buffers.clear();
+        handles.clear();
+        for (uint32_t i = 0; i < std::max(2u, framesInFlight); i++)
+        {
+            buffers.push_back(allocator.createBuffer(
+                vk::BufferCreateInfo {
+                    .size = sizeof(Particle) * vk::DeviceSize(particleCount),
+                    .usage = vk::BufferUsageFlagBits::eStorageBuffer |
+                             vk::BufferUsageFlagBits::eVertexBuffer,
+                    .sharingMode = concurrent ? vk::SharingMode::eConcurrent
+                                              : vk::SharingMode::eExclusive,
+                    .queueFamilyIndexCount = concurrent ? 2u : 0u,
+                    .pQueueFamilyIndices = families.data() },
+                vk::MemoryPropertyFlagBits::eDeviceLocal));
+            handles.push_back(heap.addStorageBuffer(*buffers.back().buffer));
+        }
+
+        if (async())
+        {
+            commandPools.clear();
+            commandBuffers.clear();
+            for (uint32_t i = 0; i < framesInFlight; i++)
+            {
+                commandPools.emplace_back(
+                    device,
+                    vk::CommandPoolCreateInfo {
+                        .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                        .queueFamilyIndex = computeFamily });
+                vk::CommandBufferAllocateInfo allocInfo {
+                    .commandPool = commandPools.back(),
+                    .level = vk::CommandBufferLevel::ePrimary,
+                    .commandBufferCount = 1
+                };
+                commandBuffers.push_back(std::move(
+                    vk::raii::CommandBuffers(device, allocInfo).front()));
+            }
+            vk::StructureChain<vk::SemaphoreCreateInfo,
+                               vk::SemaphoreTypeCreateInfo>
+                semaphoreInfo = {
+                    {},
+                    { .semaphoreType = vk::SemaphoreType::eTimeline,
+                      .initialValue = 0 }
+                };
+            timeline = vk::raii::Semaphore(
+                device, semaphoreInfo.get<vk::SemaphoreCreateInfo>());
+            computeTimer.init(
+                physicalDevice, device, computeFamily, framesInFlight);
+            timer = &computeTimer;
+        }
+
+        vk::PushConstantRange pushConstantRange {
+            .stageFlags = STAGES, .offset = 0, .size = sizeof(PushConstants)
+        };
+        pipelineLayout = vk::raii::PipelineLayout(
+            device,
+            vk::PipelineLayoutCreateInfo {
+                .setLayoutCount = 1,
+                .pSetLayouts = &*heap.layout(),
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &pushConstantRange });
+        initPipeline = createComputePipeline(
+            pipelineCache, shaderModule, "initMain", "particle init pipeline");
+        simulatePipeline = createComputePipeline(pipelineCache,
+                                                 shaderModule,
+                                                 "simulateMain",
+                                                 "particle simulate pipeline");
+        drawPipeline = createDrawPipeline(pipelineCache, shaderModule,
+                                          colorFormat);
+    }
+
+    bool async() const { return computeQueue != nullptr; }
+    uint32_t count() const { return constants.count; }
+
+    // Read back the compute timestamps of a frame whose fence has signaled.
+    void collect(uint32_t frameIndex)
+    {
+        if (async())
+        {
+            computeTimer.collect(frameIndex);
+        }
+    }
+
+    // Step the simulation for frameIndex. On the compute queue this submits
+    // right away and graphicsCommandBuffer is untouched; otherwise the
+    // dispatch is recorded into it, outside of rendering, in a render graph
+    // pass that writes the particle buffers. Call once per frame, before
+    // recordDraw.
+    void simulate(const vk::raii::CommandBuffer& graphicsCommandBuffer,
+                  uint32_t frameIndex)
+    {
+        const uint32_t src = step % static_cast<uint32_t>(buffers.size());
+        drawBuffer = (step + 1) % static_cast<uint32_t>(buffers.size());
+        step++;
+
+        const vk::raii::CommandBuffer& commandBuffer =
+            async() ? commandBuffers[frameIndex] : graphicsCommandBuffer;
+        if (async())
+        {
+            commandPools[frameIndex].reset();
+            commandBuffer.begin(vk::CommandBufferBeginInfo {
+                .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+            computeTimer.beginFrame(commandBuffer, frameIndex);
+        }
+        {
+            const GpuScope scope(*timer, commandBuffer, "particles");
+
+            // On the graphics queue the render graph orders the buffers against
+            // the previous dispatch and draw. On the compute queue the previous
+            // dispatch, which wrote src, completes first; draws of the
+            // destination finished with the fence of its frame.
+            if (async())
+            {
+                memoryBarrier(commandBuffer,
+                              vk::PipelineStageFlagBits2::eComputeShader,
+                              vk::AccessFlagBits2::eShaderStorageWrite,
+                              vk::PipelineStageFlagBits2::eComputeShader,
+                              vk::AccessFlagBits2::eShaderStorageRead |
+                                  vk::AccessFlagBits2::eShaderStorageWrite);
+            }
+            heap->bind(commandBuffer, vk::PipelineBindPoint::eCompute,
+                       *pipelineLayout);
+            if (!initialized)
+            {
+                constants.dstIndex = handles[src].get();
+                dispatch(commandBuffer, initPipeline);
+                memoryBarrier(commandBuffer,
+                              vk::PipelineStageFlagBits2::eComputeShader,
+                              vk::AccessFlagBits2::eShaderStorageWrite,
+                              vk::PipelineStageFlagBits2::eComputeShader,
+                              vk::AccessFlagBits2::eShaderStorageRead);
+                initialized = true;
+            }
+            constants.srcIndex = handles[src].get();
+            constants.dstIndex = handles[drawBuffer].get();
+            dispatch(commandBuffer, simulatePipeline);
+        }
+
+        if (!async())
+        {
+            return;
+        }
+        commandBuffer.end();
+
+        const vk::CommandBufferSubmitInfo commandBufferInfo {
+            .commandBuffer = *commandBuffer
+        };
+        const vk::SemaphoreSubmitInfo signalInfo {
+            .semaphore = *timeline,
+            .value = ++submittedValue,
+            .stageMask = vk::PipelineStageFlagBits2::eComputeShader
+        };
+        std::scoped_lock lock(*queueMutex);
+        computeQueue->submit2(vk::SubmitInfo2 {
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signalInfo });
+    }
+
+    // What the graphics submit of the last simulated frame waits on. Only
+    // valid with async().
+    vk::SemaphoreSubmitInfo waitInfo() const
+    {
+        return { .semaphore = *timeline,
+                 .value = submittedValue,
+                 .stageMask = vk::PipelineStageFlagBits2::eVertexAttributeInput };
+    }
+
+    // Draw the particles written by the last simulate(). Must be inside the
+    // rendering pass; the viewport and scissor are set here.
+    void recordDraw(const vk::raii::CommandBuffer& commandBuffer,
+                    vk::Extent2D extent, float viewScale) const
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                   drawPipeline);
+        commandBuffer.setViewport(
+            0,
+            vk::Viewport(0.0f,
+                         0.0f,
+                         static_cast<float>(extent.width),
+                         static_cast<float>(extent.height),
+                         0.0f,
+                         1.0f));
+        commandBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), extent));
+        const vk::DeviceSize offset = 0;
+        commandBuffer.bindVertexBuffers(0, *buffers[drawBuffer].buffer, offset);
+        PushConstants drawConstants = constants;
+        drawConstants.viewScale = viewScale;
+        commandBuffer.pushConstants<PushConstants>(
+            pipelineLayout, STAGES, 0, drawConstants);
+        commandBuffer.draw(constants.count, 1, 0, 0);
+    }
+
+    // Throughput over frames simulated in seconds of wall time, and over the
+    // GPU time of the dispatches.
+    void report(std::ostream& out, uint64_t frames, double seconds) const
+    {
+        const double particles =
+            static_cast<double>(constants.count) * static_cast<double>(frames);
+        out << "particles: " << constants.count << " per frame, "
+            << particles / seconds / 1.0e6 << " M/s at the frame rate";
+        const GpuTimer::ScopeStats stats = timer->stats("particles");
+        if (stats.samples > 0 && stats.meanMs > 0.0)
+        {
+            out << ", " << constants.count / stats.meanMs / 1.0e3
+                << " M/s of GPU time (mean " << stats.meanMs << " ms)";
+        }
+        out << (async() ? " on the async compute queue"
+                        : " on the graphics queue")
+            << std::endl;
+    }
+
+private:
+    static constexpr vk::ShaderStageFlags STAGES =
+        vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex;
+
+    const vk::raii::Device* device = nullptr;
+    const DescriptorHeap* heap = nullptr;
+    const vk::raii::Queue* computeQueue = nullptr;
+    std::mutex* queueMutex = nullptr;
+    PushConstants constants;
+
+    std::vector<AllocatedBuffer> buffers;
+    std::vector<DescriptorHeap::Handle> handles;
+    uint32_t step = 0;
+    uint32_t drawBuffer = 0;
+    bool initialized = false;
+
+    std::vector<vk::raii::CommandPool> commandPools;
+    std::vector<vk::raii::CommandBuffer> commandBuffers;
+    vk::raii::Semaphore timeline = nullptr;
+    uint64_t submittedValue = 0;
+    GpuTimer computeTimer;
+    // computeTimer with async(), the graphics timer otherwise.
+    GpuTimer* timer = nullptr;
+
+    vk::raii::PipelineLayout pipelineLayout = nullptr;
+    vk::raii::Pipeline initPipeline = nullptr;
+    vk::raii::Pipeline simulatePipeline = nullptr;
+    vk::raii::Pipeline drawPipeline = nullptr;
+
+    void dispatch(const vk::raii::CommandBuffer& commandBuffer,
+                  const vk::raii::Pipeline& pipeline) const
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.pushConstants<PushConstants>(
+            pipelineLayout, STAGES, 0, constants);
+        commandBuffer.dispatch(
+            (constants.count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    }
+
+    vk::raii::Pipeline
+    createComputePipeline(PersistentPipelineCache& pipelineCache,
+                          const vk::raii::ShaderModule& shaderModule,
+                          const char* entryPoint, const char* name) const
+    {
+        vk::PipelineCreationFeedback feedback;
+        vk::PipelineCreationFeedbackCreateInfo feedbackInfo {
+            .pPipelineCreationFeedback = &feedback
+        };
+        vk::raii::Pipeline pipeline(
+            *device,
+            pipelineCache.get(),
+            vk::ComputePipelineCreateInfo {
+                .pNext = &feedbackInfo,
+                .stage = { .stage = vk::ShaderStageFlagBits::eCompute,
+                           .module = shaderModule,
+                           .pName = entryPoint },
+                .layout = pipelineLayout });
+        pipelineCache.recordFeedback(name, feedback);
+        return pipeline;
+    }
+
+    vk::raii::Pipeline
+    createDrawPipeline(PersistentPipelineCache& pipelineCache,
+                       const vk::raii::ShaderModule& shaderModule,
+                       vk::Format colorFormat) const
+    {
+        const std::array<vk::PipelineShaderStageCreateInfo, 2> stages = { {
+            { .stage = vk::ShaderStageFlagBits::eVertex,
+              .module = shaderModule,
+              .pName = "particleVertMain" },
+            { .stage = vk::ShaderStageFlagBits::eFragment,
+              .module = shaderModule,
+              .pName = "particleFragMain" },
+        } };
+        const vk::VertexInputBindingDescription binding {
+            .binding = 0,
+            .stride = sizeof(Particle),
+            .inputRate = vk::VertexInputRate::eVertex
+        };
+        const std::array<vk::VertexInputAttributeDescription, 2> attributes = {
+            { { .location = 0,
+                .binding = 0,
+                .format = vk::Format::eR32G32Sfloat,
+                .offset = offsetof(Particle, position) },
+              { .location = 1,
+                .binding = 0,
+                .format = vk::Format::eR32G32Sfloat,
+                .offset = offsetof(Particle, velocity) } }
+        };
+        const vk::PipelineVertexInputStateCreateInfo vertexInput {
+            .vertexBindingDescriptionCount = 1,
+            .pVertexBindingDescriptions = &binding,
+            .vertexAttributeDescriptionCount =
+                static_cast<uint32_t>(attributes.size()),
+            .pVertexAttributeDescriptions = attributes.data()
+        };
+        const vk::PipelineInputAssemblyStateCreateInfo inputAssembly {
+            .topology = vk::PrimitiveTopology::ePointList
+        };
+        const vk::PipelineViewportStateCreateInfo viewportState {
+            .viewportCount = 1, .scissorCount = 1
+        };
+        const vk::PipelineRasterizationStateCreateInfo rasterizer {
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eNone,
+            .lineWidth = 1.0f
+        };
+        const vk::PipelineMultisampleStateCreateInfo multisampling {
+            .rasterizationSamples = vk::SampleCountFlagBits::e1
+        };
+        // Additive, so dense regions glow instead of overdrawing.
+        const vk::PipelineColorBlendAttachmentState blendAttachment {
+            .blendEnable = vk::True,
+            .srcColorBlendFactor = vk::BlendFactor::eOne,
+            .dstColorBlendFactor = vk::BlendFactor::eOne,
+            .colorBlendOp = vk::BlendOp::eAdd,
+            .srcAlphaBlendFactor = vk::BlendFactor::eZero,
+            .dstAlphaBlendFactor = vk::BlendFactor::eOne,
+            .alphaBlendOp = vk::BlendOp::eAdd,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR |
+                              vk::ColorComponentFlagBits::eG |
+                              vk::ColorComponentFlagBits::eB |
+                              vk::ColorComponentFlagBits::eA
+        };
+        const vk::PipelineColorBlendStateCreateInfo colorBlending {
+            .attachmentCount = 1, .pAttachments = &blendAttachment
+        };
+        const std::array dynamicStates = { vk::DynamicState::eViewport,
+                                           vk::DynamicState::eScissor };
+        const vk::PipelineDynamicStateCreateInfo dynamicState {
+            .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+            .pDynamicStates = dynamicStates.data()
+        };
+
+        vk::PipelineCreationFeedback feedback;
+        vk::PipelineCreationFeedbackCreateInfo feedbackInfo {
+            .pPipelineCreationFeedback = &feedback
+        };
+        const vk::PipelineRenderingCreateInfo renderingInfo {
+            .pNext = &feedbackInfo,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &colorFormat
+        };
+        vk::raii::Pipeline pipeline(
+            *device,
+            pipelineCache.get(),
+            vk::GraphicsPipelineCreateInfo {
+                .pNext = &renderingInfo,
+                .stageCount = static_cast<uint32_t>(stages.size()),
+                .pStages = stages.data(),
+                .pVertexInputState = &vertexInput,
+                .pInputAssemblyState = &inputAssembly,
+                .pViewportState = &viewportState,
+                .pRasterizationState = &rasterizer,
+                .pMultisampleState = &multisampling,
+                .pColorBlendState = &colorBlending,
+                .pDynamicState = &dynamicState,
+                .layout = pipelineLayout });
+        pipelineCache.recordFeedback("particle draw pipeline", feedback);
+        return pipeline;
+    }
+
+    static void memoryBarrier(const vk::raii::CommandBuffer& commandBuffer,
+                              vk::PipelineStageFlags2 srcStage,
+                              vk::AccessFlags2 srcAccess,
+                              vk::PipelineStageFlags2 dstStage,
+                              vk::AccessFlags2 dstAccess)
+    {
+        vk::MemoryBarrier2 barrier { .srcStageMask = srcStage,
+                                     .srcAccessMask = srcAccess,
+                                     .dstStageMask = dstStage,
+                                     .dstAccessMask = dstAccess };
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+            .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+    }
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+// vk::PipelineCache persisted between runs. The driver blob on disk is
+// prefixed with the identity of the device and driver that produced it, and
+// anything that does not match is discarded before it reaches the driver.
+//
+// read() needs no device, so the file can be read while the device is
+// created; load() then validates it and creates the cache.
+class PersistentPipelineCache
+{
+public:
+    // Read the cache file at path, empty disables persistence.
+    void read(std::filesystem::path path)
+    {
+        filePath = std::move(path);
+        fileData.clear();
+        fileReason.clear();
+        if (filePath.empty())
+        {
+            return;
+        }
+        std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+        if (!file.is_open())
+        {
+            fileReason = "no cache file";
+            return;
+        }
+        fileData.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(fileData.data()),
+                  static_cast<std::streamsize>(fileData.size()));
+        if (!file)
+        {
+            fileData.clear();
+            fileReason = "read failed";
+        }
+    }
+
+    void load(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device)
+    {
+        identity = deviceIdentity(physicalDevice);
+
+        std::vector<uint8_t> data;
+        if (!filePath.empty())
+        {
+            std::string reason = fileReason;
+            if (reason.empty())
+            {
+                data = validate(reason);
+            }
+            if (data.empty())
+            {
+                std::cout << "pipeline cache: starting empty (" << reason
+                          << ")" << std::endl;
+            }
+            else
+            {
+                std::cout << "pipeline cache: loaded " << data.size()
+                          << " bytes from " << filePath.string() << std::endl;
+            }
+        }
+        fileData = {};
+
+        vk::PipelineCacheCreateInfo createInfo {
+            .initialDataSize = data.size(),
+            .pInitialData = data.data()
+        };
+        cache = vk::raii::PipelineCache(device, createInfo);
+    }
+
+    const vk::raii::PipelineCache& get() const { return cache; }
+
+    // Log whether the driver satisfied a pipeline from the cache, using the
+    // feedback chained into its create info. Safe from any thread.
+    void recordFeedback(const char* name,
+                        const vk::PipelineCreationFeedback& feedback)
+    {
+        std::scoped_lock lock(feedbackMutex);
+        if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid))
+        {
+            std::cout << "pipeline cache: " << name << " (no feedback)"
+                      << std::endl;
+            return;
+        }
+
+        const bool hit =
+            !!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::
+                                    eApplicationPipelineCacheHit);
+        hit ? hits++ : misses++;
+        std::cout << "pipeline cache: " << name << (hit ? " hit" : " miss")
+                  << " (" << static_cast<double>(feedback.duration) / 1.0e6
+                  << " ms)" << std::endl;
+    }
+
+    // Write the cache back through a temporary file and a rename, so an
+    // interrupted run never leaves a truncated cache behind.
+    void save() const
+    {
+        if (filePath.empty() || !*cache)
+        {
+            return;
+        }
+
+        const std::vector<uint8_t> data = cache.getData();
+        FileHeader header = identity;
+        header.dataSize = data.size();
+        header.dataHash = hash(data.data(), data.size());
+
+        std::filesystem::path tmpPath = filePath;
+        tmpPath += ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(data.data()),
+                       static_cast<std::streamsize>(data.size()));
+            if (!file)
+            {
+                std::cerr << "pipeline cache: failed to write "
+                          << tmpPath.string() << std::endl;
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tmpPath, filePath, error);
+        if (error)
+        {
+            std::cerr << "pipeline cache: failed to replace "
+                      << filePath.string() << ": " << error.message()
+                      << std::endl;
+            std::filesystem::remove(tmpPath, error);
+            return;
+        }
+        std::cout << "pipeline cache: saved " << data.size() << " bytes ("
+                  << hits << " hits, " << misses << " misses this run)"
+                  << std::endl;
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x4350564c; // "LVPC"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    struct FileHeader
+    {
+        uint32_t magic = MAGIC;
+        uint32_t fileVersion = FILE_VERSION;
+        uint32_t vendorID = 0;
+        uint32_t deviceID = 0;
+        uint32_t driverVersion = 0;
+        uint32_t padding = 0;
+        uint8_t deviceUUID[VK_UUID_SIZE] = {};
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+        uint64_t dataSize = 0;
+        uint64_t dataHash = 0;
+    };
+
+    std::filesystem::path filePath;
+    // Raw file contents between read() and load(), or why there are none.
+    std::vector<uint8_t> fileData;
+    std::string fileReason;
+    FileHeader identity;
+    vk::raii::PipelineCache cache = nullptr;
+    std::mutex feedbackMutex;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    static FileHeader
+    deviceIdentity(const vk::raii::PhysicalDevice& physicalDevice)
+    {
+        auto properties =
+            physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+                                          vk::PhysicalDeviceIDProperties>();
+        const auto& deviceProperties =
+            properties.get<vk::PhysicalDeviceProperties2>().properties;
+        const auto& idProperties =
+            properties.get<vk::PhysicalDeviceIDProperties>();
+
+        FileHeader header;
+        header.vendorID = deviceProperties.vendorID;
+        header.deviceID = deviceProperties.deviceID;
+        header.driverVersion = deviceProperties.driverVersion;
+        std::memcpy(header.deviceUUID, idProperties.deviceUUID.data(),
+                    VK_UUID_SIZE);
+        std::memcpy(header.pipelineCacheUUID,
+                    deviceProperties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+        return header;
+    }
+
+    // The driver blob of fileData, empty with the reason if it does not
+    // belong to this device and driver.
+    std::vector<uint8_t> validate(std::string& reason) const
+    {
+        const size_t fileSize = fileData.size();
+        FileHeader header;
+        if (fileSize < sizeof(header))
+        {
+            reason = "file too small";
+            return {};
+        }
+        std::memcpy(&header, fileData.data(), sizeof(header));
+
+        if (header.magic != MAGIC || header.fileVersion != FILE_VERSION)
+        {
+            reason = "unrecognized file header";
+            return {};
+        }
+        if (header.vendorID != identity.vendorID ||
+            header.deviceID != identity.deviceID ||
+            std::memcmp(header.deviceUUID, identity.deviceUUID,
+                        VK_UUID_SIZE) != 0)
+        {
+            reason = "written by a different device";
+            return {};
+        }
+        if (header.driverVersion != identity.driverVersion ||
+            std::memcmp(header.pipelineCacheUUID, identity.pipelineCacheUUID,
+                        VK_UUID_SIZE) != 0)
+        {
+            reason = "written by a different driver";
+            return {};
+        }
+        if (header.dataSize != fileSize - sizeof(header))
+        {
+            reason = "truncated";
+            return {};
+        }
+
+        std::vector<uint8_t> data(fileData.begin() + sizeof(header),
+                                  fileData.end());
+        if (hash(data.data(), data.size()) != header.dataHash)
+        {
+            reason = "checksum mismatch";
+            return {};
+        }
+
+        // The driver's own header must agree too, otherwise it would silently
+        // ignore the data and every pipeline would miss.
+        VkPipelineCacheHeaderVersionOne driverHeader {};
+        if (data.size() < sizeof(driverHeader))
+        {
+            reason = "missing driver header";
+            return {};
+        }
+        std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+        if (driverHeader.headerSize < sizeof(driverHeader) ||
+            driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            driverHeader.vendorID != identity.vendorID ||
+            driverHeader.deviceID != identity.deviceID ||
+            std::memcmp(driverHeader.pipelineCacheUUID,
+                        identity.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+        {
+            reason = "driver header mismatch";
+            return {};
+        }
+
+        return data;
+    }
+
+    // 64-bit FNV-1a, enough to catch torn or corrupted files.
+    static uint64_t hash(const uint8_t* data, size_t size)
+    {
+        uint64_t value = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            value = (value ^ data[i]) * 0x100000001b3ull;
+        }
+        return value;
+    }
+};
@@ -0,0 +1,691 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "gpu_allocator.hpp"
+
+// How a pass uses a resource. Each usage implies the image layout, pipeline
+// stages and access the barriers in front of the pass are built from.
+enum class ResourceUsage
+{
+    ColorAttachment,
+    Sampled,
+    StorageRead,
+    StorageWrite,
+    TransferSource,
+    TransferDestination,
+    IndirectRead,
+    // A buffer bound as a vertex buffer.
+    VertexInput,
+    // Read by the host once the frame's fence has signaled, as a final usage.
+    HostRead,
+    // Final usage of a swapchain image, left for the presentation engine.
+    Present,
+};
+
+struct ResourceUsageInfo
+{
+    ResourceUsage usage;
+    // Ignored for buffers.
+    vk::ImageLayout layout;
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 access;
+    bool write;
+};
+
+constexpr std::array<ResourceUsageInfo, 10> RESOURCE_USAGES = { {
+    { ResourceUsage::ColorAttachment,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      vk::AccessFlagBits2::eColorAttachmentRead |
+          vk::AccessFlagBits2::eColorAttachmentWrite,
+      true },
+    { ResourceUsage::Sampled,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::PipelineStageFlagBits2::eFragmentShader |
+          vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      false },
+    { ResourceUsage::StorageRead,
+      vk::ImageLayout::eGeneral,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead,
+      false },
+    { ResourceUsage::StorageWrite,
+      vk::ImageLayout::eGeneral,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead |
+          vk::AccessFlagBits2::eShaderStorageWrite,
+      true },
+    { ResourceUsage::TransferSource,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::PipelineStageFlagBits2::eAllTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      false },
+    { ResourceUsage::TransferDestination,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::PipelineStageFlagBits2::eAllTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      true },
+    { ResourceUsage::IndirectRead,
+      vk::ImageLayout::eUndefined,
+      vk::PipelineStageFlagBits2::eDrawIndirect,
+      vk::AccessFlagBits2::eIndirectCommandRead,
+      false },
+    { ResourceUsage::VertexInput,
+      vk::ImageLayout::eUndefined,
+      vk::PipelineStageFlagBits2::eVertexAttributeInput,
+      vk::AccessFlagBits2::eVertexAttributeRead,
+      false },
+    { ResourceUsage::HostRead,
+      vk::ImageLayout::eUndefined,
+      vk::PipelineStageFlagBits2::eHost,
+      vk::AccessFlagBits2::eHostRead,
+      false },
+    // The submit signals the render-finished semaphore at this stage, so the
+    // transition is ordered before it.
+    { ResourceUsage::Present,
+      vk::ImageLayout::ePresentSrcKHR,
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      {},
+      false },
+} };
+
+// A frame as a list of passes that declare which resources they read and
+// write. compile() derives every barrier once: layouts, stages and access
+// come from the declared usages, a pass's barriers are merged into a single
+// vk::DependencyInfo, and reads that need no layout change or visibility
+// operation get no barrier at all. Transient images are created by the graph
+// and share memory when no pass uses both.
+//
+// Passes run in the order they are added, on one queue. Imported resources
+// are rebound every frame, so the same graph serves every swapchain image.
+class RenderGraph
+{
+public:
+    using Resource = uint32_t;
+    using RecordFn = std::function<void(const vk::raii::CommandBuffer&)>;
+
+    struct Use
+    {
+        Resource resource;
+        ResourceUsage usage;
+    };
+
+    struct ImageDesc
+    {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        vk::ImageUsageFlags usage;
+    };
+
+    // Images, views and memory of the transient resources. Views come last
+    // so they are destroyed before their images, and the images before the
+    // memory they are bound to.
+    struct Transients
+    {
+        std::vector<GpuAllocation> memory;
+        std::vector<vk::raii::Image> images;
+        std::vector<vk::raii::ImageView> views;
+    };
+
+    void init(const vk::raii::Device& device, GpuAllocator& allocator)
+    {
+        this->device = &device;
+        this->allocator = &allocator;
+    }
+
+    // Drop every pass and resource. The transient images are handed back so
+    // they can be retired behind the frames that still use them.
+    [[nodiscard]] Transients reset()
+    {
+        resources.clear();
+        passes.clear();
+        finalBarriers.clear();
+        compiled = false;
+        return std::exchange(transients, {});
+    }
+
+    // An image owned elsewhere, bound with bindImage() before execute().
+    // Each frame it starts undefined after initialStages, and ends in the
+    // layout of finalUsage.
+    Resource importImage(std::string name,
+                         vk::PipelineStageFlags2 initialStages,
+                         ResourceUsage finalUsage)
+    {
+        return addResource({ .name = std::move(name),
+                             .isImage = true,
+                             .initialStages = initialStages,
+                             .finalUsage = finalUsage,
+                             .hasFinalUsage = true });
+    }
+
+    // A buffer owned elsewhere. Passes run on one queue, so each frame it
+    // starts in the state the previous frame left it in. Bound with
+    // bindBuffer() it gets buffer barriers; left unbound it stands for a set
+    // of buffers, e.g. a ring whose slot changes every frame, and gets
+    // global memory barriers. finalUsage, if any, is one more access after
+    // the last pass, like HostRead for a readback.
+    Resource importBuffer(std::string name,
+                          std::optional<ResourceUsage> finalUsage = {})
+    {
+        return addResource({ .name = std::move(name),
+                             .finalUsage = finalUsage.value_or(
+                                 ResourceUsage::HostRead),
+                             .hasFinalUsage = finalUsage.has_value() });
+    }
+
+    // A color image created by compile(), with contents that do not outlive
+    // the frame.
+    Resource createImage(std::string name, const ImageDesc& desc)
+    {
+        return addResource({ .name = std::move(name),
+                             .isImage = true,
+                             .transient = true,
+                             .desc = desc });
+    }
+
+    void addPass(std::string name, std::vector<Use> uses, RecordFn record)
+    {
+        for (size_t i = 0; i < uses.size(); i++)
+        {
+            if (uses[i].resource >= resources.size())
+            {
+                throw std::runtime_error("render graph: pass " + name +
+                                         " uses an unknown resource");
+            }
+            for (size_t j = 0; j < i; j++)
+            {
+                if (uses[j].resource == uses[i].resource)
+                {
+                    throw std::runtime_error(
+                        "render graph: pass " + name + " uses " +
+                        resources[uses[i].resource].name + " twice");
+                }
+            }
+        }
+        passes.push_back({ .name = std::move(name),
+                           .uses = std::move(uses),
+                           .record = std::move(record) });
+    }
+
+    // Derive the barriers and create the transient images. Call once after
+    // the passes are added.
+    void compile()
+    {
+        computeLifetimes();
+        allocateTransients();
+        // The first run finds each resource's state at the end of the frame,
+        // which is where the next frame's first use synchronizes from.
+        std::vector<State> endStates = simulate(nullptr);
+        simulate(&endStates);
+        compiled = true;
+    }
+
+    void bindImage(Resource resource, vk::Image image, vk::ImageView view)
+    {
+        resources[resource].image = image;
+        resources[resource].view = view;
+    }
+
+    void bindBuffer(Resource resource, vk::Buffer buffer)
+    {
+        resources[resource].buffer = buffer;
+    }
+
+    vk::Image image(Resource resource) const
+    {
+        return resources[resource].image;
+    }
+
+    vk::ImageView imageView(Resource resource) const
+    {
+        return resources[resource].view;
+    }
+
+    // Stages the final transition to the present layout runs in. A semaphore
+    // signalled for the presentation engine must include them.
+    static vk::PipelineStageFlags2 presentStages()
+    {
+        return info(ResourceUsage::Present).stages;
+    }
+
+    // Record every pass with its barriers in front of it, then the final
+    // transitions.
+    void execute(const vk::raii::CommandBuffer& commandBuffer)
+    {
+        if (!compiled)
+        {
+            throw std::runtime_error("render graph executed before compile");
+        }
+        barriersLastFrame = 0;
+        for (const Pass& pass : passes)
+        {
+            emit(commandBuffer, pass.barriers);
+            pass.record(commandBuffer);
+        }
+        emit(commandBuffer, finalBarriers);
+        barriersEmitted += barriersLastFrame;
+        frames++;
+    }
+
+    // Barrier structs and vkCmdPipelineBarrier2 calls per frame, the reads
+    // that needed none, and the memory aliasing saved.
+    void report(std::ostream& out) const
+    {
+        const double frameCount =
+            static_cast<double>(std::max<uint64_t>(frames, 1));
+        out << "render graph: " << passes.size() << " passes, "
+            << static_cast<double>(barriersEmitted) / frameCount
+            << " barriers in "
+            << static_cast<double>(dependenciesEmitted) / frameCount
+            << " dependencies per frame, " << elidedBarriers
+            << " redundant barriers removed, transients "
+            << (transientBytes >> 10) << " KiB in "
+            << ((transientBytes - aliasedBytesSaved) >> 10)
+            << " KiB (aliasing saved " << (aliasedBytesSaved >> 10)
+            << " KiB)" << std::endl;
+    }
+
+    uint64_t barriersPerFrame() const { return barriersLastFrame; }
+    vk::DeviceSize aliasingSavings() const { return aliasedBytesSaved; }
+
+private:
+    struct ResourceEntry
+    {
+        std::string name;
+        bool isImage = false;
+        bool transient = false;
+        ImageDesc desc;
+        vk::PipelineStageFlags2 initialStages;
+        ResourceUsage finalUsage = ResourceUsage::Present;
+        bool hasFinalUsage = false;
+
+        vk::Image image;
+        vk::ImageView view;
+        vk::Buffer buffer;
+        // First and last pass using it, UINT32_MAX when unused.
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        // Transient images sharing memory, in pass order; the one before
+        // this in its group, itself when alone.
+        Resource aliasPredecessor = 0;
+    };
+
+    struct Barrier
+    {
+        Resource resource;
+        vk::PipelineStageFlags2 srcStages;
+        vk::AccessFlags2 srcAccess;
+        vk::PipelineStageFlags2 dstStages;
+        vk::AccessFlags2 dstAccess;
+        vk::ImageLayout oldLayout;
+        vk::ImageLayout newLayout;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<Use> uses;
+        RecordFn record;
+        std::vector<Barrier> barriers;
+    };
+
+    // What a barrier in front of the next use has to wait for.
+    struct State
+    {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        // The last write, or layout transition, and its access.
+        vk::PipelineStageFlags2 writeStages;
+        vk::AccessFlags2 writeAccess;
+        // Stages the last write has been made visible to.
+        vk::PipelineStageFlags2 visibleStages;
+        // Stages that have read since the last write.
+        vk::PipelineStageFlags2 readStages;
+    };
+
+    const vk::raii::Device* device = nullptr;
+    GpuAllocator* allocator = nullptr;
+    std::vector<ResourceEntry> resources;
+    std::vector<Pass> passes;
+    std::vector<Barrier> finalBarriers;
+    Transients transients;
+    bool compiled = false;
+
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+    std::vector<vk::MemoryBarrier2> memoryBarriers;
+
+    uint64_t frames = 0;
+    uint64_t barriersEmitted = 0;
+    uint64_t dependenciesEmitted = 0;
+    uint64_t barriersLastFrame = 0;
+    uint64_t elidedBarriers = 0;
+    vk::DeviceSize transientBytes = 0;
+    vk::DeviceSize aliasedBytesSaved = 0;
+
+    static const ResourceUsageInfo& info(ResourceUsage usage)
+    {
+        return *std::ranges::find(
+            RESOURCE_USAGES, usage, &ResourceUsageInfo::usage);
+    }
+
+    Resource addResource(ResourceEntry entry)
+    {
+        if (compiled)
+        {
+            throw std::runtime_error("render graph changed after compile");
+        }
+        resources.push_back(std::move(entry));
+        return static_cast<Resource>(resources.size() - 1);
+    }
+
+    void computeLifetimes()
+    {
+        for (uint32_t p = 0; p < passes.size(); p++)
+        {
+            for (const Use& use : passes[p].uses)
+            {
+                ResourceEntry& resource = resources[use.resource];
+                resource.firstPass = std::min(resource.firstPass, p);
+                resource.lastPass = std::max(resource.lastPass, p);
+            }
+        }
+    }
+
+    // Place the transient images, largest first, into the first memory
+    // group none of whose members is alive at the same time, then allocate
+    // each group once at the size of its largest member.
+    void allocateTransients()
+    {
+        struct Group
+        {
+            vk::MemoryRequirements requirements;
+            std::vector<Resource> members;
+        };
+        std::vector<Group> groups;
+        std::vector<vk::MemoryRequirements> requirements(resources.size());
+        std::vector<Resource> order;
+        transientBytes = 0;
+        std::vector<size_t> imageIndex(resources.size(), SIZE_MAX);
+        for (Resource r = 0; r < resources.size(); r++)
+        {
+            ResourceEntry& resource = resources[r];
+            if (!resource.transient || resource.firstPass == UINT32_MAX)
+            {
+                continue;
+            }
+            imageIndex[r] = transients.images.size();
+            transients.images.emplace_back(
+                *device,
+                vk::ImageCreateInfo {
+                    .imageType = vk::ImageType::e2D,
+                    .format = resource.desc.format,
+                    .extent = { resource.desc.extent.width,
+                                resource.desc.extent.height,
+                                1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = vk::SampleCountFlagBits::e1,
+                    .tiling = vk::ImageTiling::eOptimal,
+                    .usage = resource.desc.usage,
+                    .sharingMode = vk::SharingMode::eExclusive,
+                    .initialLayout = vk::ImageLayout::eUndefined });
+            requirements[r] =
+                transients.images.back().getMemoryRequirements();
+            transientBytes += requirements[r].size;
+            order.push_back(r);
+        }
+        std::ranges::stable_sort(order,
+                                 [&](Resource a, Resource b)
+                                 {
+                                     return requirements[a].size >
+                                            requirements[b].size;
+                                 });
+
+        for (Resource r : order)
+        {
+            auto overlaps = [&](Resource other)
+            {
+                return resources[r].firstPass <= resources[other].lastPass &&
+                       resources[other].firstPass <= resources[r].lastPass;
+            };
+            auto fits = [&](const Group& group)
+            {
+                return (group.requirements.memoryTypeBits &
+                        requirements[r].memoryTypeBits) != 0 &&
+                       std::ranges::none_of(group.members, overlaps);
+            };
+            auto group = std::ranges::find_if(groups, fits);
+            if (group == groups.end())
+            {
+                groups.push_back({ .requirements = requirements[r],
+                                   .members = {} });
+                group = groups.end() - 1;
+            }
+            group->requirements.size =
+                std::max(group->requirements.size, requirements[r].size);
+            group->requirements.alignment = std::max(
+                group->requirements.alignment, requirements[r].alignment);
+            group->requirements.memoryTypeBits &=
+                requirements[r].memoryTypeBits;
+            group->members.push_back(r);
+        }
+
+        vk::DeviceSize allocatedBytes = 0;
+        for (Group& group : groups)
+        {
+            GpuAllocation& memory = transients.memory.emplace_back(
+                allocator->allocate(group.requirements,
+                                    vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                    {},
+                                    ResourceTiling::Optimal,
+                                    AllocationStrategy::Buddy));
+            allocatedBytes += group.requirements.size;
+            std::ranges::sort(group.members,
+                              {},
+                              [this](Resource r)
+                              { return resources[r].firstPass; });
+            for (size_t i = 0; i < group.members.size(); i++)
+            {
+                const Resource r = group.members[i];
+                // The first member follows the last one of the previous
+                // frame.
+                resources[r].aliasPredecessor =
+                    group.members[(i + group.members.size() - 1) %
+                                  group.members.size()];
+                vk::raii::Image& image = transients.images[imageIndex[r]];
+                image.bindMemory(memory.memory(), memory.offset());
+                transients.views.emplace_back(
+                    *device,
+                    vk::ImageViewCreateInfo {
+                        .image = *image,
+                        .viewType = vk::ImageViewType::e2D,
+                        .format = resources[r].desc.format,
+                        .subresourceRange = colorRange() });
+                resources[r].image = *image;
+                resources[r].view = *transients.views.back();
+            }
+        }
+        aliasedBytesSaved = transientBytes - allocatedBytes;
+    }
+
+    static vk::ImageSubresourceRange colorRange()
+    {
+        return { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                 .baseMipLevel = 0,
+                 .levelCount = 1,
+                 .baseArrayLayer = 0,
+                 .layerCount = 1 };
+    }
+
+    // Walk the passes tracking each resource's state and derive the
+    // barriers. Without endStates, only the end states are computed.
+    std::vector<State> simulate(const std::vector<State>* endStates)
+    {
+        std::vector<State> states(resources.size());
+        for (Resource r = 0; r < resources.size(); r++)
+        {
+            const ResourceEntry& resource = resources[r];
+            if (resource.transient && endStates != nullptr)
+            {
+                // Undefined again, after whatever last used the memory.
+                const State& previous =
+                    (*endStates)[resource.aliasPredecessor];
+                states[r].writeStages =
+                    previous.writeStages | previous.readStages;
+                states[r].writeAccess = previous.writeAccess;
+            }
+            else if (!resource.isImage && endStates != nullptr)
+            {
+                // Where the previous frame's submission left it.
+                states[r] = (*endStates)[r];
+            }
+            else if (!resource.transient)
+            {
+                states[r].writeStages = resource.initialStages;
+            }
+        }
+
+        uint64_t elided = 0;
+        for (Pass& pass : passes)
+        {
+            pass.barriers.clear();
+            for (const Use& use : pass.uses)
+            {
+                transition(use.resource, info(use.usage), states[use.resource],
+                           pass.barriers, elided);
+            }
+        }
+        finalBarriers.clear();
+        for (Resource r = 0; r < resources.size(); r++)
+        {
+            if (resources[r].hasFinalUsage)
+            {
+                transition(r, info(resources[r].finalUsage), states[r],
+                           finalBarriers, elided);
+            }
+        }
+        elidedBarriers = elided;
+        return states;
+    }
+
+    void transition(Resource r, const ResourceUsageInfo& usage, State& state,
+                    std::vector<Barrier>& barriers, uint64_t& elided) const
+    {
+        const bool isImage = resources[r].isImage;
+        const vk::ImageLayout layout =
+            isImage ? usage.layout : vk::ImageLayout::eUndefined;
+        const bool layoutChange = isImage && state.layout != layout;
+        Barrier barrier { .resource = r,
+                          .srcStages = state.writeStages,
+                          .srcAccess = state.writeAccess,
+                          .dstStages = usage.stages,
+                          .dstAccess = usage.access,
+                          .oldLayout = state.layout,
+                          .newLayout = layout };
+
+        if (usage.write || layoutChange)
+        {
+            // Writes and transitions wait for every earlier access.
+            barrier.srcStages |= state.readStages;
+            if (barrier.srcStages || layoutChange)
+            {
+                barriers.push_back(barrier);
+            }
+            state.layout = layout;
+            state.writeStages = usage.stages;
+            state.writeAccess = usage.write ? usage.access
+                                            : vk::AccessFlags2 {};
+            state.visibleStages = usage.stages;
+            state.readStages = usage.write ? vk::PipelineStageFlags2 {}
+                                           : usage.stages;
+            return;
+        }
+        // A read in the same layout only waits when the last write is not
+        // visible to its stages yet.
+        if (state.writeStages && (usage.stages & ~state.visibleStages))
+        {
+            barriers.push_back(barrier);
+            state.visibleStages |= usage.stages;
+        }
+        else
+        {
+            elided++;
+        }
+        state.readStages |= usage.stages;
+    }
+
+    void emit(const vk::raii::CommandBuffer& commandBuffer,
+              const std::vector<Barrier>& barriers)
+    {
+        if (barriers.empty())
+        {
+            return;
+        }
+        imageBarriers.clear();
+        bufferBarriers.clear();
+        memoryBarriers.clear();
+        for (const Barrier& barrier : barriers)
+        {
+            const ResourceEntry& resource = resources[barrier.resource];
+            if (resource.isImage)
+            {
+                imageBarriers.push_back(
+                    { .srcStageMask = barrier.srcStages,
+                      .srcAccessMask = barrier.srcAccess,
+                      .dstStageMask = barrier.dstStages,
+                      .dstAccessMask = barrier.dstAccess,
+                      .oldLayout = barrier.oldLayout,
+                      .newLayout = barrier.newLayout,
+                      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                      .image = resource.image,
+                      .subresourceRange = colorRange() });
+            }
+            else if (!resource.buffer)
+            {
+                memoryBarriers.push_back(
+                    { .srcStageMask = barrier.srcStages,
+                      .srcAccessMask = barrier.srcAccess,
+                      .dstStageMask = barrier.dstStages,
+                      .dstAccessMask = barrier.dstAccess });
+            }
+            else
+            {
+                bufferBarriers.push_back(
+                    { .srcStageMask = barrier.srcStages,
+                      .srcAccessMask = barrier.srcAccess,
+                      .dstStageMask = barrier.dstStages,
+                      .dstAccessMask = barrier.dstAccess,
+                      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                      .buffer = resource.buffer,
+                      .offset = 0,
+                      .size = vk::WholeSize });
+            }
+        }
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+            .memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size()),
+            .pMemoryBarriers = memoryBarriers.data(),
+            .bufferMemoryBarrierCount =
+                static_cast<uint32_t>(bufferBarriers.size()),
+            .pBufferMemoryBarriers = bufferBarriers.data(),
+            .imageMemoryBarrierCount =
+                static_cast<uint32_t>(imageBarriers.size()),
+            .pImageMemoryBarriers = imageBarriers.data() });
+        barriersLastFrame += barriers.size();
+        dependenciesEmitted++;
+    }
+};
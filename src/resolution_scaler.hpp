@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+// Picks the fraction of the swapchain extent a frame renders at, so the GPU
+// time of a frame stays within a budget. GPU time is modeled as proportional
+// to the pixel count: each measured frame gives a cost per full-resolution
+// frame, which is smoothed and solved for the scale that fits the budget.
+// Measurements arrive frames in flight late, so each frame slot remembers the
+// scale it was recorded at. The scale drops quickly and recovers slowly, and
+// small corrections are ignored so the resolution does not flicker.
+class ResolutionScaler
+{
+public:
+    // Fraction of the budget the controller aims for, leaving room for noise.
+    static constexpr double HEADROOM = 0.9;
+    // Weight of a new cost sample in the running estimate.
+    static constexpr double SMOOTHING = 0.25;
+    static constexpr float MAX_STEP_DOWN = 0.1f;
+    static constexpr float MAX_STEP_UP = 0.02f;
+    static constexpr float DEADBAND = 0.01f;
+
+    // A budget of 0 disables scaling.
+    void init(double budgetMs, float minScale, uint32_t framesInFlight)
+    {
+        this->budgetMs = budgetMs;
+        this->minScale = minScale;
+        frameScales.assign(framesInFlight, 0.0f);
+    }
+
+    bool enabled() const { return budgetMs > 0.0; }
+
+    float scale() const { return current; }
+
+    // Extent to render the frame in frameIndex's slot at.
+    vk::Extent2D begin(uint32_t frameIndex, vk::Extent2D full)
+    {
+        if (!enabled())
+        {
+            return full;
+        }
+        frameScales[frameIndex] = current;
+        frames++;
+        scaleSum += current;
+        lowestScale = std::min(lowestScale, current);
+        return extent(full);
+    }
+
+    vk::Extent2D extent(vk::Extent2D full) const
+    {
+        auto scaled = [this](uint32_t size)
+        {
+            return std::clamp(
+                static_cast<uint32_t>(std::lround(current * size)), 1u, size);
+        };
+        return { scaled(full.width), scaled(full.height) };
+    }
+
+    // Feed the GPU time of the completed frame in frameIndex's slot;
+    // negative when it was not measured.
+    void collect(uint32_t frameIndex, double gpuMs)
+    {
+        if (!enabled() || gpuMs < 0.0 || frameScales[frameIndex] == 0.0f)
+        {
+            return;
+        }
+        const double used = frameScales[frameIndex];
+        frameScales[frameIndex] = 0.0f;
+        samples++;
+        if (gpuMs > budgetMs)
+        {
+            overBudget++;
+        }
+        const double cost = gpuMs / (used * used);
+        fullFrameMs = fullFrameMs == 0.0
+                          ? cost
+                          : fullFrameMs + SMOOTHING * (cost - fullFrameMs);
+        if (fullFrameMs <= 0.0)
+        {
+            return;
+        }
+        const float fit =
+            static_cast<float>(std::sqrt(budgetMs * HEADROOM / fullFrameMs));
+        const float target = std::clamp(fit, minScale, 1.0f);
+        if (std::abs(target - current) < DEADBAND &&
+            target != minScale && target != 1.0f)
+        {
+            return;
+        }
+        current = std::clamp(
+            target, current - MAX_STEP_DOWN, current + MAX_STEP_UP);
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (!enabled() || frames == 0)
+        {
+            return;
+        }
+        out << "resolution: budget " << budgetMs << " ms, scale mean "
+            << scaleSum / static_cast<double>(frames) << ", min "
+            << lowestScale << ", " << overBudget << " of " << samples
+            << " measured frames over budget" << std::endl;
+    }
+
+private:
+    double budgetMs = 0.0;
+    float minScale = 1.0f;
+    float current = 1.0f;
+    // Estimated GPU time of a frame at full resolution.
+    double fullFrameMs = 0.0;
+    // Scale each frame in flight was recorded at, 0 once collected.
+    std::vector<float> frameScales;
+
+    uint64_t frames = 0;
+    uint64_t samples = 0;
+    uint64_t overBudget = 0;
+    double scaleSum = 0.0;
+    float lowestScale = 1.0f;
+};
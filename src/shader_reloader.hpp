@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "cpu_profiler.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+// Rebuilds a pipeline when its shader source changes. poll() checks the
+// source's modification time from the render thread; a change starts a job on
+// the thread pool that runs the shader compiler and builds the pipeline. The
+// render thread picks the result up with takePipeline() at a frame boundary.
+// A failed compile or build is logged and the current pipeline stays.
+class ShaderReloader
+{
+public:
+    using BuildFn =
+        std::function<vk::raii::Pipeline(std::span<const uint32_t> spirv)>;
+
+    static constexpr std::chrono::milliseconds POLL_INTERVAL { 250 };
+
+    ~ShaderReloader() { wait(); }
+
+    // compileCommand is run through the shell with `-o <scratch>` appended.
+    // scratch only holds the SPIR-V until its pipeline is built; nothing
+    // reads it back, so it is deleted afterwards.
+    void init(std::filesystem::path source, std::filesystem::path scratch,
+              std::string compileCommand, BuildFn build)
+    {
+        this->source = std::move(source);
+        this->scratch = std::move(scratch);
+        this->compileCommand = std::move(compileCommand);
+        this->build = std::move(build);
+        std::error_code error;
+        lastWrite = std::filesystem::last_write_time(this->source, error);
+        lastPoll = std::chrono::steady_clock::now();
+    }
+
+    // Start a rebuild if the source changed. Cheap enough to call every frame.
+    void poll(ThreadPool& threadPool)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll < POLL_INTERVAL ||
+            busy.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        lastPoll = now;
+
+        std::error_code error;
+        const auto writeTime = std::filesystem::last_write_time(source, error);
+        if (error || writeTime == lastWrite)
+        {
+            return;
+        }
+        lastWrite = writeTime;
+
+        busy.store(true, std::memory_order_release);
+        threadPool.submit(
+            [this]
+            {
+                rebuild();
+                busy.store(false, std::memory_order_release);
+                busy.notify_all();
+            });
+    }
+
+    // The pipeline of the latest successful rebuild, if one finished since
+    // the last call.
+    std::optional<vk::raii::Pipeline> takePipeline()
+    {
+        std::scoped_lock lock(mutex);
+        return std::exchange(ready, std::nullopt);
+    }
+
+    // Block until a running rebuild has finished.
+    void wait()
+    {
+        busy.wait(true, std::memory_order_acquire);
+    }
+
+private:
+    std::filesystem::path source;
+    std::filesystem::path scratch;
+    std::string compileCommand;
+    BuildFn build;
+
+    std::filesystem::file_time_type lastWrite;
+    std::chrono::steady_clock::time_point lastPoll;
+    std::atomic<bool> busy = false;
+
+    std::mutex mutex;
+    std::optional<vk::raii::Pipeline> ready;
+
+    void rebuild()
+    {
+        CPU_ZONE("shaderReload");
+        const auto start = std::chrono::steady_clock::now();
+        const std::string command =
+            compileCommand + " -o \"" + scratch.string() + "\"";
+        const bool compiledOk = std::system(command.c_str()) == 0;
+        const auto compiled = std::chrono::steady_clock::now();
+
+        bool built = false;
+        if (!compiledOk)
+        {
+            std::cerr << "shader reload: compiling " << source.string()
+                      << " failed" << std::endl;
+        }
+        else
+        {
+            try
+            {
+                // unmapped before the file is removed below, Windows
+                // refuses to delete a mapped file
+                const MappedFile spirv(scratch);
+                vk::raii::Pipeline pipeline = build(spirv.words());
+                std::scoped_lock lock(mutex);
+                ready = std::move(pipeline);
+                built = true;
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "shader reload: " << e.what() << std::endl;
+            }
+        }
+        std::error_code error;
+        std::filesystem::remove(scratch, error);
+        if (!built)
+        {
+            return;
+        }
+
+        const auto finished = std::chrono::steady_clock::now();
+        std::cout << "shader reload: compiled in "
+                  << std::chrono::duration<double, std::milli>(compiled - start)
+                         .count()
+                  << " ms, built in "
+                  << std::chrono::duration<double, std::milli>(finished -
+                                                               compiled)
+                         .count()
+                  << " ms" << std::endl;
+    }
+};
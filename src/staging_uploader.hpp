@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "gpu_allocator.hpp"
+
+// One mip level for StagingUploader::uploadImage, tightly packed rows of
+// texel blocks.
+struct ImageLevelUpload
+{
+    uint32_t mipLevel = 0;
+    vk::Extent2D extent;
+    vk::Extent2D blockExtent { 1, 1 };
+    vk::DeviceSize rowBytes = 0;
+    const std::byte* data = nullptr;
+};
+
+// Uploads buffer and image data through a persistently mapped staging ring.
+// Copies are queued on the CPU and submitted in batches on the transfer queue,
+// each batch signaling the next value of a timeline semaphore; ring space is
+// reclaimed as batches retire. When the transfer queue is in a different
+// family than the graphics queue, each batch releases the destination buffers
+// and images and the graphics side acquires them with recordAcquireBarriers.
+//
+// Not thread safe: queue, flush and record from one thread. When another
+// thread submits to the same vk::Queue, pass a queueMutex both sides lock.
+class StagingUploader
+{
+public:
+    static constexpr vk::DeviceSize DEFAULT_RING_SIZE = 16ull << 20;
+
+    void init(const vk::raii::Device& device, GpuAllocator& allocator,
+              const vk::raii::Queue& transferQueue, uint32_t transferFamily,
+              uint32_t graphicsFamily,
+              vk::DeviceSize ringSize = DEFAULT_RING_SIZE,
+              std::mutex* queueMutex = nullptr)
+    {
+        this->device = &device;
+        this->queueMutex = queueMutex;
+        this->allocator = &allocator;
+        this->transferQueue = &transferQueue;
+        this->transferFamily = transferFamily;
+        this->graphicsFamily = graphicsFamily;
+
+        ring = allocator.createBuffer(
+            vk::BufferCreateInfo {
+                .size = ringSize,
+                .usage = vk::BufferUsageFlagBits::eTransferSrc,
+                .sharingMode = vk::SharingMode::eExclusive },
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            vk::MemoryPropertyFlagBits::eHostCoherent);
+        ringData = static_cast<std::byte*>(ring.allocation.mapped());
+        this->ringSize = ringSize;
+
+        commandPool = vk::raii::CommandPool(
+            device,
+            vk::CommandPoolCreateInfo {
+                .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                .queueFamilyIndex = transferFamily });
+
+        vk::StructureChain<vk::SemaphoreCreateInfo,
+                           vk::SemaphoreTypeCreateInfo>
+            semaphoreInfo = { {},
+                              { .semaphoreType = vk::SemaphoreType::eTimeline,
+                                .initialValue = 0 } };
+        timeline = vk::raii::Semaphore(
+            device, semaphoreInfo.get<vk::SemaphoreCreateInfo>());
+    }
+
+    bool crossesQueueFamilies() const
+    {
+        return transferFamily != graphicsFamily;
+    }
+
+    // Copy size bytes of data into the ring now and queue their transfer to
+    // dst. dstStage and dstAccess describe the first graphics use of the
+    // range. Data larger than the ring is split across batches.
+    void uploadBuffer(vk::Buffer dst, vk::DeviceSize dstOffset,
+                      const void* data, vk::DeviceSize size,
+                      vk::PipelineStageFlags2 dstStage,
+                      vk::AccessFlags2 dstAccess)
+    {
+        const auto* bytes = static_cast<const std::byte*>(data);
+        while (size > 0)
+        {
+            const vk::DeviceSize chunk = std::min(size, ringSize / 2);
+            const vk::DeviceSize srcOffset = reserve(chunk);
+            std::memcpy(ringData + srcOffset, bytes, chunk);
+            pending.push_back({ .dst = dst,
+                                .region = { .srcOffset = srcOffset,
+                                            .dstOffset = dstOffset,
+                                            .size = chunk },
+                                .dstStage = dstStage,
+                                .dstAccess = dstAccess });
+            bytes += chunk;
+            dstOffset += chunk;
+            size -= chunk;
+        }
+    }
+
+    // Copy every level of a freshly created image into the ring and queue
+    // its transfer. The image goes from undefined to shader read-only layout;
+    // dstStage and dstAccess describe its first graphics use. Levels larger
+    // than the ring are split into bands of block rows.
+    void uploadImage(vk::Image image, uint32_t levelCount,
+                     std::span<const ImageLevelUpload> levels,
+                     vk::PipelineStageFlags2 dstStage,
+                     vk::AccessFlags2 dstAccess)
+    {
+        bool first = true;
+        for (const ImageLevelUpload& level : levels)
+        {
+            const uint32_t blockRows =
+                (level.extent.height + level.blockExtent.height - 1) /
+                level.blockExtent.height;
+            const uint32_t bandRows = static_cast<uint32_t>(
+                std::min<vk::DeviceSize>(blockRows,
+                                         ringSize / 2 / level.rowBytes));
+            if (bandRows == 0)
+            {
+                throw std::runtime_error("staging ring too small for upload!");
+            }
+            for (uint32_t row = 0; row < blockRows; row += bandRows)
+            {
+                const uint32_t rows = std::min(bandRows, blockRows - row);
+                const vk::DeviceSize size = rows * level.rowBytes;
+                const vk::DeviceSize srcOffset = reserve(size);
+                std::memcpy(ringData + srcOffset,
+                            level.data + row * level.rowBytes,
+                            size);
+                const uint32_t y = row * level.blockExtent.height;
+                const vk::BufferImageCopy region {
+                    .bufferOffset = srcOffset,
+                    .imageSubresource = { .aspectMask =
+                                              vk::ImageAspectFlagBits::eColor,
+                                          .mipLevel = level.mipLevel,
+                                          .layerCount = 1 },
+                    .imageOffset = { 0, static_cast<int32_t>(y), 0 },
+                    .imageExtent = { level.extent.width,
+                                     std::min(rows * level.blockExtent.height,
+                                              level.extent.height - y),
+                                     1 }
+                };
+                pendingImages.push_back({ .image = image,
+                                          .levelCount = levelCount,
+                                          .region = region,
+                                          .dstStage = dstStage,
+                                          .dstAccess = dstAccess,
+                                          .first = std::exchange(first, false) });
+            }
+        }
+        // A full ring flushes earlier bands, but the last one is always
+        // still pending here.
+        if (!first)
+        {
+            pendingImages.back().last = true;
+        }
+    }
+
+    // Submit every queued copy as one batch. Returns the timeline value that
+    // signals its completion, the last submitted value if nothing was queued.
+    uint64_t flush()
+    {
+        reclaim();
+        if (pending.empty() && pendingImages.empty())
+        {
+            return lastSubmittedValue;
+        }
+
+        allocator->flush(ring.allocation);
+
+        vk::CommandBufferAllocateInfo allocInfo {
+            .commandPool = commandPool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1
+        };
+        vk::raii::CommandBuffer commandBuffer =
+            std::move(vk::raii::CommandBuffers(*device, allocInfo).front());
+        commandBuffer.begin(vk::CommandBufferBeginInfo {
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+        std::vector<vk::BufferMemoryBarrier2> releases;
+        for (const PendingCopy& copy : pending)
+        {
+            commandBuffer.copyBuffer(*ring.buffer, copy.dst, copy.region);
+            if (crossesQueueFamilies())
+            {
+                // Release half of the ownership transfer, the graphics queue
+                // records the matching acquire.
+                vk::BufferMemoryBarrier2 release {
+                    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+                    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                    .srcQueueFamilyIndex = transferFamily,
+                    .dstQueueFamilyIndex = graphicsFamily,
+                    .buffer = copy.dst,
+                    .offset = copy.region.dstOffset,
+                    .size = copy.region.size
+                };
+                releases.push_back(release);
+
+                vk::BufferMemoryBarrier2 acquire = release;
+                acquire.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+                acquire.srcAccessMask = vk::AccessFlagBits2::eNone;
+                acquire.dstStageMask = copy.dstStage;
+                acquire.dstAccessMask = copy.dstAccess;
+                pendingAcquires.push_back(acquire);
+            }
+        }
+
+        // Images start undefined, then move to shader read-only once their
+        // last band is copied, releasing them in the same barrier.
+        std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+        for (const PendingImageCopy& copy : pendingImages)
+        {
+            if (copy.first)
+            {
+                imageBarriers.push_back(
+                    { .srcStageMask = vk::PipelineStageFlagBits2::eNone,
+                      .srcAccessMask = vk::AccessFlagBits2::eNone,
+                      .dstStageMask = vk::PipelineStageFlagBits2::eCopy,
+                      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                      .oldLayout = vk::ImageLayout::eUndefined,
+                      .newLayout = vk::ImageLayout::eTransferDstOptimal,
+                      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+                      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+                      .image = copy.image,
+                      .subresourceRange = colorLevels(copy.levelCount) });
+            }
+        }
+        if (!imageBarriers.empty())
+        {
+            commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+                .imageMemoryBarrierCount =
+                    static_cast<uint32_t>(imageBarriers.size()),
+                .pImageMemoryBarriers = imageBarriers.data() });
+        }
+        imageBarriers.clear();
+        for (const PendingImageCopy& copy : pendingImages)
+        {
+            commandBuffer.copyBufferToImage(*ring.buffer,
+                                            copy.image,
+                                            vk::ImageLayout::eTransferDstOptimal,
+                                            copy.region);
+            if (!copy.last)
+            {
+                continue;
+            }
+            vk::ImageMemoryBarrier2 release {
+                .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+                .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+                .dstAccessMask = vk::AccessFlagBits2::eNone,
+                .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+                .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+                .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+                .image = copy.image,
+                .subresourceRange = colorLevels(copy.levelCount)
+            };
+            if (crossesQueueFamilies())
+            {
+                release.srcQueueFamilyIndex = transferFamily;
+                release.dstQueueFamilyIndex = graphicsFamily;
+
+                vk::ImageMemoryBarrier2 acquire = release;
+                acquire.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+                acquire.srcAccessMask = vk::AccessFlagBits2::eNone;
+                acquire.dstStageMask = copy.dstStage;
+                acquire.dstAccessMask = copy.dstAccess;
+                pendingImageAcquires.push_back(acquire);
+            }
+            imageBarriers.push_back(release);
+        }
+
+        if (!releases.empty() || !imageBarriers.empty())
+        {
+            commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+                .bufferMemoryBarrierCount =
+                    static_cast<uint32_t>(releases.size()),
+                .pBufferMemoryBarriers = releases.data(),
+                .imageMemoryBarrierCount =
+                    static_cast<uint32_t>(imageBarriers.size()),
+                .pImageMemoryBarriers = imageBarriers.data() });
+        }
+        commandBuffer.end();
+
+        const uint64_t value = ++lastSubmittedValue;
+        vk::CommandBufferSubmitInfo commandBufferInfo { .commandBuffer =
+                                                            *commandBuffer };
+        vk::SemaphoreSubmitInfo signalInfo {
+            .semaphore = *timeline,
+            .value = value,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+        };
+        {
+            std::unique_lock<std::mutex> lock;
+            if (queueMutex != nullptr)
+            {
+                lock = std::unique_lock(*queueMutex);
+            }
+            transferQueue->submit2(vk::SubmitInfo2 {
+                .commandBufferInfoCount = 1,
+                .pCommandBufferInfos = &commandBufferInfo,
+                .signalSemaphoreInfoCount = 1,
+                .pSignalSemaphoreInfos = &signalInfo });
+        }
+
+        inFlight.push_back({ .value = value,
+                             .ringEnd = head,
+                             .commandBuffer = std::move(commandBuffer) });
+        pending.clear();
+        pendingImages.clear();
+        return value;
+    }
+
+    // Record the acquire half of every ownership transfer flushed so far.
+    // The submit of commandBuffer must wait for submittedValue() on
+    // timelineSemaphore().
+    void recordAcquireBarriers(const vk::raii::CommandBuffer& commandBuffer)
+    {
+        if (pendingAcquires.empty() && pendingImageAcquires.empty())
+        {
+            return;
+        }
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+            .bufferMemoryBarrierCount =
+                static_cast<uint32_t>(pendingAcquires.size()),
+            .pBufferMemoryBarriers = pendingAcquires.data(),
+            .imageMemoryBarrierCount =
+                static_cast<uint32_t>(pendingImageAcquires.size()),
+            .pImageMemoryBarriers = pendingImageAcquires.data() });
+        pendingAcquires.clear();
+        pendingImageAcquires.clear();
+    }
+
+    // Hand the image acquires flushed so far to a caller that records them
+    // itself, for images published later than the next frame.
+    std::vector<vk::ImageMemoryBarrier2> takeImageAcquires()
+    {
+        return std::exchange(pendingImageAcquires, {});
+    }
+
+    // Block until the batch that signals value has completed.
+    void wait(uint64_t value) { waitForBatch(value); }
+
+    const vk::raii::Semaphore& timelineSemaphore() const { return timeline; }
+    uint64_t submittedValue() const { return lastSubmittedValue; }
+    // Last value the transfer queue has signaled. Safe from any thread.
+    uint64_t completedValue() const { return timeline.getCounterValue(); }
+
+private:
+    struct PendingCopy
+    {
+        vk::Buffer dst;
+        vk::BufferCopy region;
+        vk::PipelineStageFlags2 dstStage;
+        vk::AccessFlags2 dstAccess;
+    };
+
+    struct PendingImageCopy
+    {
+        vk::Image image;
+        uint32_t levelCount = 1;
+        vk::BufferImageCopy region;
+        vk::PipelineStageFlags2 dstStage;
+        vk::AccessFlags2 dstAccess;
+        // The image's first and last band, which change its layout.
+        bool first = false;
+        bool last = false;
+    };
+
+    struct Batch
+    {
+        uint64_t value = 0;
+        uint64_t ringEnd = 0;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+    };
+
+    // Copy source offsets stay 16-byte aligned, which also satisfies texel
+    // block sizes up to BC7.
+    static constexpr vk::DeviceSize RING_ALIGNMENT = 16;
+
+    const vk::raii::Device* device = nullptr;
+    std::mutex* queueMutex = nullptr;
+    GpuAllocator* allocator = nullptr;
+    const vk::raii::Queue* transferQueue = nullptr;
+    uint32_t transferFamily = 0;
+    uint32_t graphicsFamily = 0;
+
+    AllocatedBuffer ring;
+    std::byte* ringData = nullptr;
+    vk::DeviceSize ringSize = 0;
+    // Monotonic byte positions, the ring offset is position % ringSize.
+    uint64_t head = 0;
+    uint64_t tail = 0;
+
+    vk::raii::CommandPool commandPool = nullptr;
+    vk::raii::Semaphore timeline = nullptr;
+    uint64_t lastSubmittedValue = 0;
+
+    std::vector<PendingCopy> pending;
+    std::vector<PendingImageCopy> pendingImages;
+    std::vector<vk::BufferMemoryBarrier2> pendingAcquires;
+    std::vector<vk::ImageMemoryBarrier2> pendingImageAcquires;
+    std::deque<Batch> inFlight;
+
+    static vk::ImageSubresourceRange colorLevels(uint32_t levelCount)
+    {
+        return { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                 .baseMipLevel = 0,
+                 .levelCount = levelCount,
+                 .baseArrayLayer = 0,
+                 .layerCount = 1 };
+    }
+
+    // Returns the ring offset of size free bytes, flushing queued copies and
+    // waiting for old batches when the ring is full.
+    vk::DeviceSize reserve(vk::DeviceSize size)
+    {
+        for (;;)
+        {
+            uint64_t start = (head + RING_ALIGNMENT - 1) / RING_ALIGNMENT *
+                             RING_ALIGNMENT;
+            // A range never wraps, skip to the start of the ring instead.
+            if (start % ringSize + size > ringSize)
+            {
+                start += ringSize - start % ringSize;
+            }
+            if (start + size - tail <= ringSize)
+            {
+                head = start + size;
+                return start % ringSize;
+            }
+
+            if (!pending.empty() || !pendingImages.empty())
+            {
+                flush();
+            }
+            if (inFlight.empty())
+            {
+                throw std::runtime_error("staging ring too small for upload!");
+            }
+            waitForBatch(inFlight.front().value);
+        }
+    }
+
+    void waitForBatch(uint64_t value)
+    {
+        const vk::Semaphore semaphore = *timeline;
+        while (vk::Result::eTimeout ==
+               device->waitSemaphores(
+                   vk::SemaphoreWaitInfo { .semaphoreCount = 1,
+                                           .pSemaphores = &semaphore,
+                                           .pValues = &value },
+                   UINT64_MAX))
+            ;
+        reclaim();
+    }
+
+    void reclaim()
+    {
+        if (inFlight.empty())
+        {
+            return;
+        }
+        const uint64_t completed = timeline.getCounterValue();
+        while (!inFlight.empty() && inFlight.front().value <= completed)
+        {
+            tail = inFlight.front().ringEnd;
+            inFlight.pop_front();
+        }
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "thread_pool.hpp"
+
+// Wall-clock time of every startup step and the time to the first frame.
+// Steps run on the calling thread with run(), or on a thread pool with
+// async() beside the caller's own steps; report() lists them by start time
+// so the overlap shows.
+class StartupTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StartupTimer() : start(Clock::now()), owner(std::this_thread::get_id()) {}
+
+    // Run fn on this thread as step name. name must outlive the timer.
+    void run(const char* name, const std::function<void()>& fn)
+    {
+        CpuZone zone(name);
+        const Clock::time_point begin = Clock::now();
+        fn();
+        const Clock::time_point end = Clock::now();
+        std::scoped_lock lock(mutex);
+        steps.push_back({ name, begin, end,
+                          std::this_thread::get_id() == owner });
+    }
+
+    // Run fn as step name on pool, or right away when pool is null or has no
+    // workers. The future rethrows whatever fn throws.
+    std::shared_future<void> async(ThreadPool* pool, const char* name,
+                                   std::function<void()> fn)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(
+            [this, name, fn = std::move(fn)] { run(name, fn); });
+        std::shared_future<void> future = task->get_future().share();
+        pending.push_back(future);
+        if (pool == nullptr || pool->threadCount() == 1)
+        {
+            (*task)();
+        }
+        else
+        {
+            pool->submit([task] { (*task)(); });
+        }
+        return future;
+    }
+
+    // Block until every async step has finished, for unwinding past steps
+    // that still reference the caller.
+    void waitAll() const
+    {
+        for (const std::shared_future<void>& future : pending)
+        {
+            future.wait();
+        }
+    }
+
+    // Mark the first frame done and print the report, once.
+    void firstFrame(std::ostream& out)
+    {
+        if (firstFrameTime)
+        {
+            return;
+        }
+        firstFrameTime = Clock::now();
+        report(out);
+    }
+
+    double firstFrameMs() const
+    {
+        return firstFrameTime ? milliseconds(*firstFrameTime - start) : 0.0;
+    }
+
+    void report(std::ostream& out)
+    {
+        std::scoped_lock lock(mutex);
+        std::ranges::sort(steps, {}, &Step::begin);
+        const Clock::time_point end =
+            firstFrameTime ? *firstFrameTime : Clock::now();
+        out << "startup: " << milliseconds(end - start)
+            << " ms to first frame" << std::endl;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        for (const Step& step : steps)
+        {
+            out << "  " << std::left << std::setw(24) << step.name
+                << std::right << " at " << std::setw(7)
+                << milliseconds(step.begin - start) << " ms, took "
+                << std::setw(7) << milliseconds(step.end - step.begin)
+                << " ms" << (step.onOwner ? "" : " (worker)") << std::endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct Step
+    {
+        const char* name;
+        Clock::time_point begin;
+        Clock::time_point end;
+        bool onOwner;
+    };
+
+    Clock::time_point start;
+    std::thread::id owner;
+    std::optional<Clock::time_point> firstFrameTime;
+    std::mutex mutex;
+    std::vector<Step> steps;
+    std::vector<std::shared_future<void>> pending;
+
+    static double milliseconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+};
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "mapped_file.hpp"
+
+// One mip level of a TextureFile, level 0 being the largest.
+struct TextureLevel
+{
+    vk::Extent2D extent;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// A mapped KTX2 or DDS file holding a 2D texture with its mip chain in a
+// format the GPU samples directly: BC1 to BC7 or RGBA8. Only headers are read
+// when opening; level data stays in the page cache until it is uploaded.
+// Supercompressed KTX2, arrays, cube maps and 3D textures are rejected.
+class TextureFile
+{
+public:
+    explicit TextureFile(const std::filesystem::path& path) : file(path)
+    {
+        const std::span<const std::byte> data = file.bytes();
+        if (data.size() >= sizeof(KTX2_IDENTIFIER) &&
+            std::memcmp(data.data(), KTX2_IDENTIFIER,
+                        sizeof(KTX2_IDENTIFIER)) == 0)
+        {
+            parseKtx2(data);
+        }
+        else if (data.size() >= 4 && std::memcmp(data.data(), "DDS ", 4) == 0)
+        {
+            parseDds(data);
+        }
+        else
+        {
+            throw std::runtime_error("unknown texture container: " +
+                                     path.string());
+        }
+        // Uploads copy whole rows of blocks out of each level, so a level
+        // must hold at least what its extent needs.
+        for (const TextureLevel& level : levels)
+        {
+            if (level.offset > data.size() ||
+                level.size > data.size() - level.offset ||
+                level.size < blocks(level.extent.width) *
+                                 blocks(level.extent.height) * info.blockBytes)
+            {
+                throw std::runtime_error("truncated texture: " +
+                                         path.string());
+            }
+        }
+    }
+
+    vk::Format format() const { return info.format; }
+    vk::Extent2D extent() const { return levels.front().extent; }
+    uint32_t levelCount() const { return static_cast<uint32_t>(levels.size()); }
+    const TextureLevel& level(uint32_t index) const { return levels[index]; }
+
+    std::span<const std::byte> levelData(uint32_t index) const
+    {
+        return file.bytes().subspan(levels[index].offset, levels[index].size);
+    }
+
+    // BC1 to BC7, which need the textureCompressionBC feature.
+    bool blockCompressed() const { return info.blockSize > 1; }
+
+    // Texels covered by one block, 4x4 for block-compressed formats.
+    vk::Extent2D blockExtent() const
+    {
+        return { info.blockSize, info.blockSize };
+    }
+
+    // Bytes of one row of blocks in level index.
+    size_t rowBytes(uint32_t index) const
+    {
+        return blocks(levels[index].extent.width) * info.blockBytes;
+    }
+
+    // Bytes of levels first to the smallest.
+    size_t bytesFrom(uint32_t first) const
+    {
+        size_t total = 0;
+        for (uint32_t i = first; i < levels.size(); i++)
+        {
+            total += levels[i].size;
+        }
+        return total;
+    }
+
+private:
+    struct FormatInfo
+    {
+        vk::Format format = vk::Format::eUndefined;
+        uint32_t blockSize = 1;
+        uint32_t blockBytes = 4;
+    };
+
+    static constexpr unsigned char KTX2_IDENTIFIER[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+    };
+
+    static constexpr std::array<FormatInfo, 16> FORMATS = { {
+        { vk::Format::eR8G8B8A8Unorm, 1, 4 },
+        { vk::Format::eR8G8B8A8Srgb, 1, 4 },
+        { vk::Format::eBc1RgbUnormBlock, 4, 8 },
+        { vk::Format::eBc1RgbSrgbBlock, 4, 8 },
+        { vk::Format::eBc1RgbaUnormBlock, 4, 8 },
+        { vk::Format::eBc1RgbaSrgbBlock, 4, 8 },
+        { vk::Format::eBc2UnormBlock, 4, 16 },
+        { vk::Format::eBc2SrgbBlock, 4, 16 },
+        { vk::Format::eBc3UnormBlock, 4, 16 },
+        { vk::Format::eBc3SrgbBlock, 4, 16 },
+        { vk::Format::eBc4UnormBlock, 4, 8 },
+        { vk::Format::eBc5UnormBlock, 4, 16 },
+        { vk::Format::eBc6HUfloatBlock, 4, 16 },
+        { vk::Format::eBc6HSfloatBlock, 4, 16 },
+        { vk::Format::eBc7UnormBlock, 4, 16 },
+        { vk::Format::eBc7SrgbBlock, 4, 16 },
+    } };
+
+    MappedFile file;
+    FormatInfo info;
+    std::vector<TextureLevel> levels;
+
+    static FormatInfo formatInfo(vk::Format format)
+    {
+        const auto it = std::ranges::find(FORMATS, format, &FormatInfo::format);
+        if (it == FORMATS.end())
+        {
+            throw std::runtime_error("unsupported texture format " +
+                                     vk::to_string(format));
+        }
+        return *it;
+    }
+
+    template <typename T>
+    static T read(std::span<const std::byte> data, size_t offset)
+    {
+        if (offset + sizeof(T) > data.size())
+        {
+            throw std::runtime_error("truncated texture header");
+        }
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        return value;
+    }
+
+    size_t blocks(uint32_t texels) const
+    {
+        return (static_cast<size_t>(texels) + info.blockSize - 1) /
+               info.blockSize;
+    }
+
+    // A full mip chain ends at 1x1, and an image has no more levels than
+    // that.
+    static void checkLevelCount(vk::Extent2D extent, uint32_t levelCount)
+    {
+        const uint32_t largest = std::max(extent.width, extent.height);
+        if (levelCount > static_cast<uint32_t>(std::bit_width(largest)))
+        {
+            throw std::runtime_error("too many mip levels for the extent");
+        }
+    }
+
+    static vk::Extent2D levelExtent(vk::Extent2D extent, uint32_t level)
+    {
+        return { std::max(1u, extent.width >> level),
+                 std::max(1u, extent.height >> level) };
+    }
+
+    void parseKtx2(std::span<const std::byte> data)
+    {
+        info = formatInfo(static_cast<vk::Format>(read<uint32_t>(data, 12)));
+        const vk::Extent2D extent { read<uint32_t>(data, 20),
+                                    read<uint32_t>(data, 24) };
+        const uint32_t depth = read<uint32_t>(data, 28);
+        const uint32_t layers = read<uint32_t>(data, 32);
+        const uint32_t faces = read<uint32_t>(data, 36);
+        const uint32_t levelCount = std::max(1u, read<uint32_t>(data, 40));
+        const uint32_t supercompression = read<uint32_t>(data, 44);
+        if (extent.width == 0 || extent.height == 0 || depth > 1 ||
+            layers > 1 || faces != 1)
+        {
+            throw std::runtime_error("only 2D KTX2 textures are supported");
+        }
+        if (supercompression != 0)
+        {
+            throw std::runtime_error("supercompressed KTX2 is not supported");
+        }
+        checkLevelCount(extent, levelCount);
+
+        // The level index follows the 80 byte header, largest level first.
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            const size_t entry = 80 + i * 24;
+            levels.push_back(
+                { .extent = levelExtent(extent, i),
+                  .offset = static_cast<size_t>(read<uint64_t>(data, entry)),
+                  .size =
+                      static_cast<size_t>(read<uint64_t>(data, entry + 8)) });
+        }
+    }
+
+    void parseDds(std::span<const std::byte> data)
+    {
+        constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+        constexpr uint32_t DDPF_FOURCC = 0x4;
+        constexpr uint32_t DDPF_RGB = 0x40;
+        constexpr size_t HEADER_SIZE = 4 + 124;
+
+        const uint32_t flags = read<uint32_t>(data, 8);
+        const vk::Extent2D extent { read<uint32_t>(data, 16),
+                                    read<uint32_t>(data, 12) };
+        const uint32_t levelCount =
+            flags & DDSD_MIPMAPCOUNT ? std::max(1u, read<uint32_t>(data, 28))
+                                     : 1u;
+        const uint32_t pixelFlags = read<uint32_t>(data, 80);
+        const auto fourCC = read<std::array<char, 4>>(data, 84);
+        auto is = [&fourCC](const char* code)
+        { return std::memcmp(fourCC.data(), code, 4) == 0; };
+
+        size_t offset = HEADER_SIZE;
+        vk::Format format = vk::Format::eUndefined;
+        if ((pixelFlags & DDPF_FOURCC) && is("DX10"))
+        {
+            format = dxgiFormat(read<uint32_t>(data, HEADER_SIZE));
+            if (read<uint32_t>(data, HEADER_SIZE + 4) != 3 ||
+                read<uint32_t>(data, HEADER_SIZE + 12) > 1)
+            {
+                throw std::runtime_error("only 2D DDS textures are supported");
+            }
+            offset += 20;
+        }
+        else if (pixelFlags & DDPF_FOURCC)
+        {
+            format = is("DXT1")   ? vk::Format::eBc1RgbaUnormBlock
+                     : is("DXT3") ? vk::Format::eBc2UnormBlock
+                     : is("DXT5") ? vk::Format::eBc3UnormBlock
+                     : is("ATI1") || is("BC4U") ? vk::Format::eBc4UnormBlock
+                     : is("ATI2") || is("BC5U") ? vk::Format::eBc5UnormBlock
+                                                : vk::Format::eUndefined;
+        }
+        else if ((pixelFlags & DDPF_RGB) && read<uint32_t>(data, 88) == 32 &&
+                 read<uint32_t>(data, 92) == 0x000000ff)
+        {
+            format = vk::Format::eR8G8B8A8Unorm;
+        }
+        info = formatInfo(format);
+        if (extent.width == 0 || extent.height == 0)
+        {
+            throw std::runtime_error("empty DDS texture");
+        }
+        checkLevelCount(extent, levelCount);
+
+        // Levels are stored back to back, largest first.
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            const vk::Extent2D size = levelExtent(extent, i);
+            levels.push_back({ .extent = size, .offset = offset });
+            levels.back().size =
+                blocks(size.width) * blocks(size.height) * info.blockBytes;
+            offset += levels.back().size;
+        }
+    }
+
+    static vk::Format dxgiFormat(uint32_t dxgi)
+    {
+        static constexpr std::array<std::pair<uint32_t, vk::Format>, 14>
+            DXGI_FORMATS = { {
+                { 28, vk::Format::eR8G8B8A8Unorm },
+                { 29, vk::Format::eR8G8B8A8Srgb },
+                { 71, vk::Format::eBc1RgbaUnormBlock },
+                { 72, vk::Format::eBc1RgbaSrgbBlock },
+                { 74, vk::Format::eBc2UnormBlock },
+                { 75, vk::Format::eBc2SrgbBlock },
+                { 77, vk::Format::eBc3UnormBlock },
+                { 78, vk::Format::eBc3SrgbBlock },
+                { 80, vk::Format::eBc4UnormBlock },
+                { 83, vk::Format::eBc5UnormBlock },
+                { 95, vk::Format::eBc6HUfloatBlock },
+                { 96, vk::Format::eBc6HSfloatBlock },
+                { 98, vk::Format::eBc7UnormBlock },
+                { 99, vk::Format::eBc7SrgbBlock },
+            } };
+        const auto it = std::ranges::find(
+            DXGI_FORMATS, dxgi, &std::pair<uint32_t, vk::Format>::first);
+        return it == DXGI_FORMATS.end() ? vk::Format::eUndefined : it->second;
+    }
+};
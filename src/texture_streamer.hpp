@@ -0,0 +1,677 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "cpu_profiler.hpp"
+#include "deletion_queue.hpp"
+#include "descriptor_heap.hpp"
+#include "gpu_allocator.hpp"
+#include "staging_uploader.hpp"
+#include "texture_file.hpp"
+#include "thread_pool.hpp"
+
+// Streams block-compressed textures from KTX2 and DDS files. Each texture is
+// one image holding its levels from a resident level down to the smallest.
+// Opening a texture loads only its small mip tail; requests then raise the
+// resident level to match the texture's on-screen size. Changing residency
+// builds a new image from the mapped file on the thread pool and uploads it
+// through a dedicated staging ring and timeline. The render thread publishes
+// it once the upload has completed, so frames never wait for streaming, and
+// retires the old image behind the current frame.
+//
+// Resident levels are kept under a byte budget, further capped by the
+// device's VK_EXT_memory_budget figures when available. When a request does
+// not fit, textures not used for EVICT_AFTER_FRAMES frames fall back to their
+// tail, least recently used first.
+//
+// Shaders read texture i through a table of descriptor heap indices, one per
+// frame in flight; textures that are not loaded yet map to a white fallback.
+class TextureStreamer
+{
+public:
+    static constexpr vk::DeviceSize DEFAULT_BUDGET = 256ull << 20;
+    static constexpr vk::DeviceSize RING_SIZE = 64ull << 20;
+    // Levels up to this many texels across form the tail loaded up front.
+    static constexpr uint32_t TAIL_SIZE = 64;
+    static constexpr uint64_t EVICT_AFTER_FRAMES = 120;
+    // Bytes one background job uploads, bounding how long a request can sit
+    // behind others.
+    static constexpr vk::DeviceSize MAX_JOB_BYTES = 64ull << 20;
+    static constexpr uint64_t BUDGET_QUERY_FRAMES = 30;
+
+    ~TextureStreamer() { wait(); }
+
+    void init(const vk::raii::PhysicalDevice& physicalDevice,
+              const vk::raii::Device& device, GpuAllocator& allocator,
+              DescriptorHeap& heap, const vk::raii::Queue& transferQueue,
+              uint32_t transferFamily, uint32_t graphicsFamily,
+              std::mutex& queueMutex, uint32_t framesInFlight,
+              uint32_t capacity, bool memoryBudgetSupported,
+              vk::DeviceSize budget = DEFAULT_BUDGET)
+    {
+        this->physicalDevice = &physicalDevice;
+        this->device = &device;
+        this->allocator = &allocator;
+        this->heap = &heap;
+        this->capacity = capacity;
+        this->memoryBudgetSupported = memoryBudgetSupported;
+        this->budget = budget;
+        // The device enables textureCompressionBC whenever it is supported.
+        bcSupported = physicalDevice.getFeatures().textureCompressionBC;
+        uploader.init(device,
+                      allocator,
+                      transferQueue,
+                      transferFamily,
+                      graphicsFamily,
+                      RING_SIZE,
+                      &queueMutex);
+
+        sampler = vk::raii::Sampler(
+            device,
+            vk::SamplerCreateInfo {
+                .magFilter = vk::Filter::eLinear,
+                .minFilter = vk::Filter::eLinear,
+                .mipmapMode = vk::SamplerMipmapMode::eLinear,
+                .addressModeU = vk::SamplerAddressMode::eRepeat,
+                .addressModeV = vk::SamplerAddressMode::eRepeat,
+                .addressModeW = vk::SamplerAddressMode::eRepeat,
+                .maxLod = vk::LodClampNone });
+        samplerHandle = heap.addSampler(*sampler);
+
+        tables.clear();
+        tableHandles.clear();
+        for (uint32_t i = 0; i < framesInFlight; i++)
+        {
+            tables.push_back(allocator.createBuffer(
+                vk::BufferCreateInfo {
+                    .size = sizeof(uint32_t) * std::max(capacity, 1u),
+                    .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+                    .sharingMode = vk::SharingMode::eExclusive },
+                vk::MemoryPropertyFlagBits::eHostVisible,
+                vk::MemoryPropertyFlagBits::eDeviceLocal));
+            tableHandles.push_back(heap.addStorageBuffer(*tables.back().buffer));
+        }
+
+        // A white texel stands in for textures that are not loaded yet. It
+        // is uploaded before the first frame so the table never points at
+        // an empty descriptor.
+        const uint32_t white = 0xffffffffu;
+        fallback = createResident(
+            vk::Format::eR8G8B8A8Unorm,
+            vk::Extent2D { 1, 1 },
+            1,
+            std::array { ImageLevelUpload {
+                .extent = { 1, 1 },
+                .rowBytes = sizeof(white),
+                .data = reinterpret_cast<const std::byte*>(&white) } });
+        fallback.handle = heap.addSampledImage(
+            *fallback.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        lastPublished = uploader.flush();
+        uploader.wait(lastPublished);
+        acquires = uploader.takeImageAcquires();
+        queryBudget();
+    }
+
+    // Register a file; its tail starts loading on the next update(). Returns
+    // the texture's index in the shader table.
+    uint32_t add(std::filesystem::path path)
+    {
+        if (textures.size() == capacity)
+        {
+            throw std::runtime_error("texture streamer is full!");
+        }
+        textures.push_back(std::make_unique<Texture>());
+        textures.back()->path = std::move(path);
+        return static_cast<uint32_t>(textures.size() - 1);
+    }
+
+    // Mark texture id as used this frame, covering about pixels texels of
+    // the screen across.
+    void request(uint32_t id, float pixels)
+    {
+        Texture& texture = *textures[id];
+        texture.pixels = std::max(texture.pixels, pixels);
+    }
+
+    // Publish finished loads and start the next job. Call once per frame
+    // after the frame's fence has signaled, before writeTable(). Replaced
+    // images are retired into deletionQueue at frameNumber.
+    void update(ThreadPool& threadPool, uint64_t frameNumber,
+                DeletionQueue& deletionQueue)
+    {
+        CPU_ZONE("updateTextures");
+        this->frameNumber = frameNumber;
+        for (const auto& texture : textures)
+        {
+            if (texture->pixels > 0.0f)
+            {
+                texture->lastUsed = frameNumber;
+            }
+        }
+        publish(deletionQueue);
+        if (frameNumber % BUDGET_QUERY_FRAMES == 0)
+        {
+            queryBudget();
+        }
+        if (!busy.load(std::memory_order_acquire))
+        {
+            schedule(threadPool);
+        }
+        for (const auto& texture : textures)
+        {
+            texture->pixels = 0.0f;
+        }
+    }
+
+    // Write the heap index of every texture into the frame's table.
+    void writeTable(uint32_t frameIndex)
+    {
+        auto* table = static_cast<uint32_t*>(
+            tables[frameIndex].allocation.mapped());
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            const Resident& resident =
+                textures[i]->resident ? textures[i]->resident : fallback;
+            table[i] = resident.handle.get();
+        }
+        allocator->flush(tables[frameIndex].allocation);
+    }
+
+    // Record the queue family acquires of images published since the last
+    // call. The submit must wait for publishedValue() on timelineSemaphore(),
+    // which has always been reached already.
+    void recordAcquireBarriers(const vk::raii::CommandBuffer& commandBuffer)
+    {
+        if (acquires.empty())
+        {
+            return;
+        }
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo {
+            .imageMemoryBarrierCount = static_cast<uint32_t>(acquires.size()),
+            .pImageMemoryBarriers = acquires.data() });
+        acquires.clear();
+    }
+
+    const vk::raii::Semaphore& timelineSemaphore() const
+    {
+        return uploader.timelineSemaphore();
+    }
+    uint64_t publishedValue() const { return lastPublished; }
+
+    // Storage buffer and sampler indices for the shader.
+    uint32_t tableIndex(uint32_t frameIndex) const
+    {
+        return tableHandles[frameIndex].get();
+    }
+    uint32_t samplerIndex() const { return samplerHandle.get(); }
+    uint32_t size() const { return static_cast<uint32_t>(textures.size()); }
+
+    // Block until a running job has finished.
+    void wait() { busy.wait(true, std::memory_order_acquire); }
+
+    void report(std::ostream& out) const
+    {
+        constexpr double MiB = 1024.0 * 1024.0;
+        uint32_t full = 0;
+        for (const auto& texture : textures)
+        {
+            full += texture->resident && texture->residentLevel == 0 ? 1 : 0;
+        }
+        out << "textures: " << full << " of " << textures.size()
+            << " at full detail, "
+            << static_cast<double>(residentBytes) / MiB << " MiB resident of "
+            << static_cast<double>(limit()) / MiB << " MiB budget, "
+            << static_cast<double>(streamedBytes) / MiB << " MiB streamed in "
+            << loadCount << " loads, " << evictionCount << " evictions"
+            << std::endl;
+    }
+
+private:
+    static constexpr uint32_t NOT_LOADED = std::numeric_limits<uint32_t>::max();
+
+    // An image with its view and heap slot, retired as one.
+    struct Resident
+    {
+        AllocatedImage image;
+        vk::raii::ImageView view = nullptr;
+        DescriptorHeap::Handle handle;
+
+        explicit operator bool() const { return static_cast<bool>(handle); }
+    };
+
+    struct Texture
+    {
+        std::filesystem::path path;
+        // Opened by the first job, read-only afterwards.
+        std::unique_ptr<TextureFile> file;
+        Resident resident;
+        // Most detailed level in resident, and in the job loading it.
+        uint32_t residentLevel = NOT_LOADED;
+        uint32_t targetLevel = NOT_LOADED;
+        uint32_t tailLevel = 0;
+        bool loading = false;
+        bool failed = false;
+        uint64_t lastUsed = 0;
+        // Largest on-screen size requested this frame.
+        float pixels = 0.0f;
+    };
+
+    struct Load
+    {
+        Texture* texture = nullptr;
+        // NOT_LOADED loads the tail of a texture not opened yet.
+        uint32_t firstLevel = NOT_LOADED;
+        Resident resident;
+        bool failed = false;
+    };
+
+    // Loads uploaded together, complete once the timeline reaches value.
+    struct Batch
+    {
+        uint64_t value = 0;
+        std::vector<Load> loads;
+        std::vector<vk::ImageMemoryBarrier2> acquires;
+    };
+
+    const vk::raii::PhysicalDevice* physicalDevice = nullptr;
+    const vk::raii::Device* device = nullptr;
+    GpuAllocator* allocator = nullptr;
+    DescriptorHeap* heap = nullptr;
+    // Used by one job at a time, and by init().
+    StagingUploader uploader;
+
+    vk::raii::Sampler sampler = nullptr;
+    DescriptorHeap::Handle samplerHandle;
+    std::vector<AllocatedBuffer> tables;
+    std::vector<DescriptorHeap::Handle> tableHandles;
+    Resident fallback;
+
+    uint32_t capacity = 0;
+    std::vector<std::unique_ptr<Texture>> textures;
+    uint64_t frameNumber = 0;
+
+    bool memoryBudgetSupported = false;
+    bool bcSupported = false;
+    vk::DeviceSize budget = DEFAULT_BUDGET;
+    vk::DeviceSize deviceLimit = std::numeric_limits<vk::DeviceSize>::max();
+    // Bytes of every texture's target residency, which the budget applies
+    // to. The images themselves follow once their loads are published.
+    vk::DeviceSize committedBytes = 0;
+    vk::DeviceSize residentBytes = 0;
+
+    std::atomic<bool> busy = false;
+    std::mutex mutex;
+    std::vector<Batch> finished;
+
+    std::vector<vk::ImageMemoryBarrier2> acquires;
+    uint64_t lastPublished = 0;
+
+    uint64_t loadCount = 0;
+    uint64_t evictionCount = 0;
+    vk::DeviceSize streamedBytes = 0;
+
+    vk::DeviceSize limit() const { return std::min(budget, deviceLimit); }
+
+    // Create an image holding levels and queue their upload. Thread safe
+    // apart from the uploader; the heap slot is added when it is published.
+    Resident createResident(vk::Format format, vk::Extent2D extent,
+                            uint32_t levelCount,
+                            std::span<const ImageLevelUpload> levels)
+    {
+        Resident resident;
+        resident.image = allocator->createImage(
+            vk::ImageCreateInfo {
+                .imageType = vk::ImageType::e2D,
+                .format = format,
+                .extent = { extent.width, extent.height, 1 },
+                .mipLevels = levelCount,
+                .arrayLayers = 1,
+                .samples = vk::SampleCountFlagBits::e1,
+                .tiling = vk::ImageTiling::eOptimal,
+                .usage = vk::ImageUsageFlagBits::eSampled |
+                         vk::ImageUsageFlagBits::eTransferDst,
+                .sharingMode = vk::SharingMode::eExclusive,
+                .initialLayout = vk::ImageLayout::eUndefined },
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        resident.view = vk::raii::ImageView(
+            *device,
+            vk::ImageViewCreateInfo {
+                .image = *resident.image.image,
+                .viewType = vk::ImageViewType::e2D,
+                .format = format,
+                .subresourceRange = { .aspectMask =
+                                          vk::ImageAspectFlagBits::eColor,
+                                      .baseMipLevel = 0,
+                                      .levelCount = levelCount,
+                                      .baseArrayLayer = 0,
+                                      .layerCount = 1 } });
+        uploader.uploadImage(*resident.image.image,
+                             levelCount,
+                             levels,
+                             vk::PipelineStageFlagBits2::eFragmentShader,
+                             vk::AccessFlagBits2::eShaderSampledRead);
+        return resident;
+    }
+
+    // Runs on the thread pool. Opens files on their first load, builds and
+    // uploads the images, then hands the batch to publish().
+    void runJob(std::vector<Load> loads)
+    {
+        CPU_ZONE("streamTextures");
+        Batch batch;
+        for (Load& load : loads)
+        {
+            Texture& texture = *load.texture;
+            try
+            {
+                if (!texture.file)
+                {
+                    texture.file = std::make_unique<TextureFile>(texture.path);
+                }
+                const TextureFile& file = *texture.file;
+                if (file.blockCompressed() && !bcSupported)
+                {
+                    throw std::runtime_error(
+                        "BC textures are not supported by this device");
+                }
+                if (load.firstLevel == NOT_LOADED)
+                {
+                    load.firstLevel = tailLevel(file);
+                }
+                std::vector<ImageLevelUpload> levels;
+                for (uint32_t i = load.firstLevel; i < file.levelCount(); i++)
+                {
+                    levels.push_back({ .mipLevel = i - load.firstLevel,
+                                       .extent = file.level(i).extent,
+                                       .blockExtent = file.blockExtent(),
+                                       .rowBytes = file.rowBytes(i),
+                                       .data = file.levelData(i).data() });
+                }
+                load.resident =
+                    createResident(file.format(),
+                                   file.level(load.firstLevel).extent,
+                                   file.levelCount() - load.firstLevel,
+                                   levels);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "texture " << texture.path.string() << ": "
+                          << e.what() << std::endl;
+                load.failed = true;
+            }
+            batch.loads.push_back(std::move(load));
+        }
+        batch.value = uploader.flush();
+        batch.acquires = uploader.takeImageAcquires();
+
+        std::scoped_lock lock(mutex);
+        finished.push_back(std::move(batch));
+    }
+
+    // Swap in every load whose upload has completed.
+    void publish(DeletionQueue& deletionQueue)
+    {
+        // Batches complete in submission order.
+        const uint64_t completed = uploader.completedValue();
+        std::vector<Batch> batches;
+        {
+            std::scoped_lock lock(mutex);
+            const auto done = std::ranges::find_if(
+                finished,
+                [completed](const Batch& batch)
+                { return batch.value > completed; });
+            batches.assign(std::make_move_iterator(finished.begin()),
+                           std::make_move_iterator(done));
+            finished.erase(finished.begin(), done);
+        }
+
+        for (Batch& batch : batches)
+        {
+            for (Load& load : batch.loads)
+            {
+                Texture& texture = *load.texture;
+                texture.loading = false;
+                if (load.failed)
+                {
+                    // Keep what is resident and stop asking for more.
+                    texture.failed = true;
+                    if (texture.residentLevel != NOT_LOADED)
+                    {
+                        committedBytes += levelBytes(texture,
+                                                     texture.residentLevel);
+                        committedBytes -= levelBytes(texture,
+                                                     texture.targetLevel);
+                    }
+                    texture.targetLevel = texture.residentLevel;
+                    continue;
+                }
+                if (texture.residentLevel == NOT_LOADED)
+                {
+                    texture.tailLevel = load.firstLevel;
+                    committedBytes += levelBytes(texture, load.firstLevel);
+                }
+                load.resident.handle = heap->addSampledImage(
+                    *load.resident.view,
+                    vk::ImageLayout::eShaderReadOnlyOptimal);
+                residentBytes += load.resident.image.allocation.size();
+                streamedBytes += load.resident.image.allocation.size();
+                if (texture.resident)
+                {
+                    residentBytes -= texture.resident.image.allocation.size();
+                    deletionQueue.retire(frameNumber,
+                                         std::move(texture.resident));
+                }
+                texture.resident = std::move(load.resident);
+                texture.residentLevel = load.firstLevel;
+                texture.targetLevel = load.firstLevel;
+                loadCount++;
+            }
+            acquires.insert(acquires.end(),
+                            batch.acquires.begin(),
+                            batch.acquires.end());
+            lastPublished = std::max(lastPublished, batch.value);
+        }
+    }
+
+    // Queue tails of new textures, then promotions for requested textures,
+    // evicting unused ones to make room, and start a job for them.
+    void schedule(ThreadPool& threadPool)
+    {
+        std::vector<Load> loads;
+        vk::DeviceSize jobBytes = 0;
+        for (const auto& texture : textures)
+        {
+            if (texture->residentLevel == NOT_LOADED && !texture->loading &&
+                !texture->failed)
+            {
+                texture->loading = true;
+                loads.push_back({ .texture = texture.get() });
+            }
+        }
+
+        std::vector<Texture*> requested;
+        for (const auto& texture : textures)
+        {
+            if (texture->pixels > 0.0f && idle(*texture) &&
+                wantedLevel(*texture) < texture->residentLevel)
+            {
+                requested.push_back(texture.get());
+            }
+        }
+        // Biggest on screen first, they show a blurry texture the most.
+        std::ranges::sort(requested,
+                          [](const Texture* a, const Texture* b)
+                          { return a->pixels > b->pixels; });
+
+        std::vector<Texture*> evictable = leastRecentlyUsed();
+        auto nextVictim = evictable.begin();
+        auto evict = [&]
+        {
+            Texture& victim = **nextVictim++;
+            committedBytes -= levelBytes(victim, victim.residentLevel) -
+                              levelBytes(victim, victim.tailLevel);
+            victim.loading = true;
+            victim.targetLevel = victim.tailLevel;
+            loads.push_back({ .texture = &victim,
+                              .firstLevel = victim.tailLevel });
+            evictionCount++;
+        };
+
+        for (Texture* texture : requested)
+        {
+            if (jobBytes >= MAX_JOB_BYTES)
+            {
+                break;
+            }
+            const vk::DeviceSize current =
+                levelBytes(*texture, texture->residentLevel);
+            uint32_t level = wantedLevel(*texture);
+            while (committedBytes + levelBytes(*texture, level) - current >
+                       limit() &&
+                   nextVictim != evictable.end())
+            {
+                evict();
+            }
+            // Settle for the most detail that fits.
+            while (level < texture->residentLevel &&
+                   committedBytes + levelBytes(*texture, level) - current >
+                       limit())
+            {
+                level++;
+            }
+            if (level >= texture->residentLevel)
+            {
+                continue;
+            }
+            committedBytes += levelBytes(*texture, level) - current;
+            jobBytes += levelBytes(*texture, level);
+            texture->loading = true;
+            texture->targetLevel = level;
+            loads.push_back({ .texture = texture, .firstLevel = level });
+        }
+        // The budget may have shrunk under what is already committed.
+        while (committedBytes > limit() && nextVictim != evictable.end())
+        {
+            evict();
+        }
+
+        if (loads.empty())
+        {
+            return;
+        }
+        busy.store(true, std::memory_order_release);
+        threadPool.submit(
+            [this, loads = std::move(loads)]() mutable
+            {
+                runJob(std::move(loads));
+                busy.store(false, std::memory_order_release);
+                busy.notify_all();
+            });
+    }
+
+    // Textures holding more than their tail that have not been used
+    // recently, oldest first.
+    std::vector<Texture*> leastRecentlyUsed() const
+    {
+        std::vector<Texture*> result;
+        for (const auto& texture : textures)
+        {
+            if (idle(*texture) &&
+                texture->residentLevel < texture->tailLevel &&
+                texture->lastUsed + EVICT_AFTER_FRAMES < frameNumber)
+            {
+                result.push_back(texture.get());
+            }
+        }
+        std::ranges::sort(result, {}, &Texture::lastUsed);
+        return result;
+    }
+
+    // Loaded, not failed and with no job in flight.
+    static bool idle(const Texture& texture)
+    {
+        return texture.residentLevel != NOT_LOADED && !texture.loading &&
+               !texture.failed;
+    }
+
+    // The level whose texels map about one to one onto texture.pixels.
+    static uint32_t wantedLevel(const Texture& texture)
+    {
+        const vk::Extent2D extent = texture.file->extent();
+        const float ratio =
+            static_cast<float>(std::max(extent.width, extent.height)) /
+            std::max(texture.pixels, 1.0f);
+        const uint32_t level =
+            ratio <= 1.0f ? 0u
+                          : std::bit_width(static_cast<uint32_t>(ratio)) - 1;
+        return std::min(level, texture.tailLevel);
+    }
+
+    static uint32_t tailLevel(const TextureFile& file)
+    {
+        uint32_t level = 0;
+        while (level + 1 < file.levelCount() &&
+               std::max(file.level(level).extent.width,
+                        file.level(level).extent.height) > TAIL_SIZE)
+        {
+            level++;
+        }
+        return level;
+    }
+
+    static vk::DeviceSize levelBytes(const Texture& texture, uint32_t level)
+    {
+        return texture.file->bytesFrom(level);
+    }
+
+    // Cap the budget to what the device reports as free plus what the
+    // streamer already holds, on the largest device-local heap.
+    void queryBudget()
+    {
+        if (!memoryBudgetSupported)
+        {
+            return;
+        }
+        const auto properties = physicalDevice->getMemoryProperties2<
+            vk::PhysicalDeviceMemoryProperties2,
+            vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        const vk::PhysicalDeviceMemoryProperties& memory =
+            properties.get<vk::PhysicalDeviceMemoryProperties2>()
+                .memoryProperties;
+        const auto& heapBudget =
+            properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        uint32_t largest = 0;
+        for (uint32_t i = 0; i < memory.memoryHeapCount; i++)
+        {
+            if ((memory.memoryHeaps[i].flags &
+                 vk::MemoryHeapFlagBits::eDeviceLocal) &&
+                memory.memoryHeaps[i].size > memory.memoryHeaps[largest].size)
+            {
+                largest = i;
+            }
+        }
+        const vk::DeviceSize usage = heapBudget.heapUsage[largest];
+        const vk::DeviceSize available =
+            heapBudget.heapBudget[largest] > usage
+                ? heapBudget.heapBudget[largest] - usage
+                : 0;
+        deviceLimit = residentBytes + available;
+    }
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// Fixed set of worker threads for fire-and-forget tasks and data-parallel
+// loops. parallelFor runs chunks on the calling thread too, so it finishes
+// even while every worker is busy with long tasks.
+class ThreadPool
+{
+public:
+    // threadCount counts the calling thread, so 1 creates no workers.
+    explicit ThreadPool(uint32_t threadCount = defaultThreadCount())
+    {
+        for (uint32_t i = 1; i < std::max(threadCount, 1u); i++)
+        {
+            workers.emplace_back(
+                [this, i]
+                {
+                    CpuProfiler::setThreadName("worker " + std::to_string(i));
+                    workerLoop();
+                });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::scoped_lock lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static uint32_t defaultThreadCount()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Workers plus the calling thread.
+    uint32_t threadCount() const
+    {
+        return static_cast<uint32_t>(workers.size()) + 1;
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::scoped_lock lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Call fn(begin, end) over [0, count) in chunks of at least minChunk
+    // items and return once every chunk has run. Also usable from a worker.
+    // If fn throws, the remaining chunks are skipped and the first exception
+    // is rethrown on the calling thread once no chunk is running.
+    void parallelFor(size_t count, size_t minChunk,
+                     const std::function<void(size_t, size_t)>& fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        // A few chunks per thread balance uneven chunks without making the
+        // shared counter hot.
+        const size_t chunkSize = std::max(
+            minChunk, (count + threadCount() * 4 - 1) / (threadCount() * 4));
+        const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        if (chunkCount == 1 || workers.empty())
+        {
+            fn(0, count);
+            return;
+        }
+
+        auto job = std::make_shared<ParallelJob>();
+        job->fn = &fn;
+        job->count = count;
+        job->chunkSize = chunkSize;
+        job->chunkCount = chunkCount;
+
+        const size_t helpers =
+            std::min(workers.size(), static_cast<size_t>(chunkCount - 1));
+        for (size_t i = 0; i < helpers; i++)
+        {
+            submit([job] { job->run(); });
+        }
+        job->run();
+
+        // Helpers that start late find no chunk left and return without
+        // touching fn, so only chunks already taken are waited for.
+        size_t done = job->done.load(std::memory_order_acquire);
+        while (done != chunkCount)
+        {
+            job->done.wait(done, std::memory_order_acquire);
+            done = job->done.load(std::memory_order_acquire);
+        }
+        if (job->error)
+        {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+private:
+    struct ParallelJob
+    {
+        const std::function<void(size_t, size_t)>* fn = nullptr;
+        size_t count = 0;
+        size_t chunkSize = 0;
+        size_t chunkCount = 0;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> done = 0;
+        std::atomic<bool> failed = false;
+        // Written once by the chunk that sets failed, read after done has
+        // reached chunkCount.
+        std::exception_ptr error;
+
+        void run()
+        {
+            for (;;)
+            {
+                const size_t chunk =
+                    next.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= chunkCount)
+                {
+                    return;
+                }
+                // A skipped chunk still counts as done so the caller's wait
+                // ends.
+                if (!failed.load(std::memory_order_relaxed))
+                {
+                    const size_t begin = chunk * chunkSize;
+                    try
+                    {
+                        (*fn)(begin, std::min(begin + chunkSize, count));
+                    }
+                    catch (...)
+                    {
+                        if (!failed.exchange(true, std::memory_order_relaxed))
+                        {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+                if (done.fetch_add(1, std::memory_order_release) + 1 ==
+                    chunkCount)
+                {
+                    done.notify_all();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// Index and vertex reordering for the post-transform vertex cache and for
+// vertex fetch locality.
+class VertexOptimizer
+{
+public:
+    // FIFO cache size the reordering targets and the statistics model.
+    static constexpr uint32_t CACHE_SIZE = 16;
+
+    // Average cache miss ratio: vertices transformed per triangle with a FIFO
+    // cache of cacheSize entries. 3 is the worst case, about 0.5 the best for
+    // large regular meshes.
+    static double acmr(std::span<const uint32_t> indices, size_t vertexCount,
+                       uint32_t cacheSize = CACHE_SIZE)
+    {
+        if (indices.size() < 3)
+        {
+            return 0.0;
+        }
+        // Each vertex remembers when it entered the cache; it is still cached
+        // while fewer than cacheSize misses have happened since.
+        std::vector<uint64_t> entered(vertexCount, 0);
+        uint64_t misses = 0;
+        for (uint32_t index : indices)
+        {
+            if (entered[index] == 0 || misses - entered[index] >= cacheSize)
+            {
+                misses++;
+                entered[index] = misses;
+            }
+        }
+        return static_cast<double>(misses) /
+               static_cast<double>(indices.size() / 3);
+    }
+
+    // Reorder triangles for the vertex cache with Tipsify (Sander, Nehab and
+    // Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+    // Overdraw", 2007): fan out around one vertex at a time, moving on to a
+    // neighbor that is still in the cache and has few triangles left. Linear in
+    // the mesh size.
+    static void optimizeVertexCache(std::span<uint32_t> indices,
+                                    size_t vertexCount,
+                                    uint32_t cacheSize = CACHE_SIZE)
+    {
+        CPU_ZONE("optimizeVertexCache");
+        const size_t triangleCount = indices.size() / 3;
+
+        // Triangles around each vertex, as offsets into one array.
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (size_t i = 0; i < 3 * triangleCount; i++)
+        {
+            live[indices[i]]++;
+        }
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            offsets[v + 1] = offsets[v] + live[v];
+        }
+        std::vector<uint32_t> adjacency(offsets.back());
+        {
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < 3 * triangleCount; i++)
+            {
+                adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<uint32_t> output;
+        output.reserve(3 * triangleCount);
+        std::vector<uint64_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        uint64_t time = cacheSize + 1;
+        size_t scan = 0;
+        int64_t fanning = triangleCount > 0 ? indices[0] : -1;
+
+        while (fanning >= 0)
+        {
+            candidates.clear();
+            for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+            {
+                const uint32_t triangle = adjacency[a];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                emitted[triangle] = true;
+                for (uint32_t corner = 0; corner < 3; corner++)
+                {
+                    const uint32_t v = indices[3 * triangle + corner];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cacheTime[v] > cacheSize)
+                    {
+                        cacheTime[v] = time++;
+                    }
+                }
+            }
+
+            // The candidate that stays cached while its remaining triangles are
+            // emitted and entered the cache earliest.
+            fanning = -1;
+            uint64_t best = 0;
+            for (uint32_t v : candidates)
+            {
+                if (live[v] == 0)
+                {
+                    continue;
+                }
+                uint64_t priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                {
+                    priority = time - cacheTime[v];
+                }
+                if (fanning < 0 || priority > best)
+                {
+                    best = priority;
+                    fanning = v;
+                }
+            }
+            // Otherwise the most recent vertex with work left, then any.
+            while (fanning < 0 && !deadEnd.empty())
+            {
+                const uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                {
+                    fanning = v;
+                }
+            }
+            while (fanning < 0 && scan < vertexCount)
+            {
+                if (live[scan] > 0)
+                {
+                    fanning = static_cast<int64_t>(scan);
+                }
+                scan++;
+            }
+        }
+        std::copy(output.begin(), output.end(), indices.begin());
+    }
+
+    // Renumber vertices in the order the indices first use them, so the vertex
+    // fetch walks memory forward. Returns the new index of each old vertex;
+    // unused vertices are dropped and map to UINT32_MAX.
+    static std::vector<uint32_t>
+    optimizeVertexFetch(std::span<uint32_t> indices, size_t vertexCount,
+                        uint32_t& usedCount)
+    {
+        CPU_ZONE("optimizeVertexFetch");
+        std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+        usedCount = 0;
+        for (uint32_t& index : indices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = usedCount++;
+            }
+            index = remap[index];
+        }
+        return remap;
+    }
+
+    // Apply optimizeVertexFetch's remap to a stream of components per vertex.
+    template <typename T>
+    static std::vector<T> remapStream(std::span<const T> stream,
+                                      uint32_t components,
+                                      std::span<const uint32_t> remap,
+                                      uint32_t usedCount)
+    {
+        std::vector<T> result(static_cast<size_t>(usedCount) * components);
+        for (size_t v = 0; v < remap.size(); v++)
+        {
+            if (remap[v] == UINT32_MAX)
+            {
+                continue;
+            }
+            for (uint32_t c = 0; c < components; c++)
+            {
+                result[static_cast<size_t>(remap[v]) * components + c] =
+                    stream[v * components + c];
+            }
+        }
+        return result;
+    }
+};
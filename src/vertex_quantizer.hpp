@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "mesh_loader.hpp"
+#include "thread_pool.hpp"
+
+// Position encoding of a quantized vertex stream. Normals and UVs are packed
+// the same way for Half and Snorm16.
+enum class VertexFormat
+{
+    Float,
+    Half,
+    Snorm16,
+};
+
+// Byte offsets of the attributes in an interleaved vertex; the position is
+// at 0.
+struct VertexLayout
+{
+    uint32_t stride = 0;
+    uint32_t normalOffset = 0;
+    uint32_t uvOffset = 0;
+};
+
+// Interleaved vertices ready for the vertex buffer.
+struct QuantizedMesh
+{
+    std::vector<std::byte> vertices;
+    VertexLayout layout;
+    // Radius around the origin containing every position in the xy plane.
+    float radius = 0.0f;
+};
+
+// Packs the float streams of a MeshData into one interleaved vertex buffer.
+// Positions are centered on their bounds and scaled into [-1, 1] for every
+// format, so snorm16 keeps 15 bits across the largest extent. The layout
+// depends only on the format, so pipelines can be built before the mesh is
+// loaded:
+//   Float    position float3, normal float3, uv float2       32 bytes
+//   Half     position half4, octahedral normal snorm16x2,
+//            uv half2                                         16 bytes
+//   Snorm16  position snorm16x4, normal and uv as for Half    16 bytes
+class VertexQuantizer
+{
+public:
+    static VertexLayout layout(VertexFormat format)
+    {
+        if (format == VertexFormat::Float)
+        {
+            return { .stride = 32, .normalOffset = 12, .uvOffset = 24 };
+        }
+        return { .stride = 16, .normalOffset = 8, .uvOffset = 12 };
+    }
+
+    static QuantizedMesh quantize(const MeshData& mesh, VertexFormat format,
+                                  ThreadPool& pool)
+    {
+        CPU_ZONE("quantizeVertices");
+        const size_t count = mesh.vertexCount();
+        QuantizedMesh result;
+        const bool packed = format != VertexFormat::Float;
+        result.layout = layout(format);
+        const uint32_t stride = result.layout.stride;
+        result.vertices.resize(count * stride);
+
+        float low[3] = { INFINITY, INFINITY, INFINITY };
+        float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (size_t v = 0; v < count; v++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                low[c] = std::min(low[c], mesh.positions[3 * v + c]);
+                high[c] = std::max(high[c], mesh.positions[3 * v + c]);
+            }
+        }
+        float center[3] = {};
+        float extent = 0.0f;
+        for (uint32_t c = 0; c < 3 && count > 0; c++)
+        {
+            center[c] = 0.5f * (low[c] + high[c]);
+            extent = std::max(extent, 0.5f * (high[c] - low[c]));
+        }
+        const float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+        // The corner of the xy bounds, which contains every vertex.
+        if (count > 0)
+        {
+            result.radius = std::hypot(0.5f * (high[0] - low[0]) * scale,
+                                       0.5f * (high[1] - low[1]) * scale);
+        }
+
+        pool.parallelFor(
+            count,
+            VERTICES_PER_TASK,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t v = begin; v < end; v++)
+                {
+                    float position[3];
+                    for (uint32_t c = 0; c < 3; c++)
+                    {
+                        position[c] =
+                            (mesh.positions[3 * v + c] - center[c]) * scale;
+                    }
+                    std::byte* out = result.vertices.data() + v * stride;
+                    const float* normal = &mesh.normals[3 * v];
+                    const float* uv = &mesh.uvs[2 * v];
+                    if (!packed)
+                    {
+                        std::memcpy(out, position, 12);
+                        std::memcpy(out + 12, normal, 12);
+                        std::memcpy(out + 24, uv, 8);
+                        continue;
+                    }
+                    uint16_t words[8];
+                    for (uint32_t c = 0; c < 3; c++)
+                    {
+                        words[c] = format == VertexFormat::Half
+                                       ? toHalf(position[c])
+                                       : toSnorm16(position[c]);
+                    }
+                    words[3] = 0;
+                    const auto [octX, octY] = octahedral(normal);
+                    words[4] = toSnorm16(octX);
+                    words[5] = toSnorm16(octY);
+                    words[6] = toHalf(uv[0]);
+                    words[7] = toHalf(uv[1]);
+                    std::memcpy(out, words, sizeof(words));
+                }
+            });
+        return result;
+    }
+
+    // IEEE half with round to nearest even; overflow saturates to infinity.
+    static uint16_t toHalf(float value)
+    {
+        const uint32_t bits = std::bit_cast<uint32_t>(value);
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        const uint32_t magnitude = bits & 0x7fffffff;
+        if (magnitude >= 0x7f800000)
+        {
+            // infinity stays infinity, NaN stays a quiet NaN
+            return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+        }
+        if (magnitude >= 0x477ff000)
+        {
+            return sign | 0x7c00;
+        }
+        if (magnitude < 0x38800000)
+        {
+            // subnormal: shift the implicit bit in, then round
+            if (magnitude < 0x33000000)
+            {
+                return sign;
+            }
+            const uint32_t exponent = magnitude >> 23;
+            const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+            const uint32_t shift = 126 - exponent;
+            uint32_t half = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+            {
+                half++;
+            }
+            return sign | static_cast<uint16_t>(half);
+        }
+        // rebias the exponent and round the 13 dropped mantissa bits
+        uint32_t half = (magnitude - 0x38000000) >> 13;
+        const uint32_t remainder = magnitude & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        {
+            half++;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    static uint16_t toSnorm16(float value)
+    {
+        const float clamped = std::clamp(value, -1.0f, 1.0f);
+        return static_cast<uint16_t>(
+            static_cast<int16_t>(std::lround(clamped * 32767.0f)));
+    }
+
+    // Octahedral map of a unit vector to [-1, 1]^2 (Cigolle et al., "A
+    // Survey of Efficient Representations for Independent Unit Vectors",
+    // 2014): project onto the octahedron and fold the lower half out.
+    static std::array<float, 2> octahedral(const float* normal)
+    {
+        const float sum = std::abs(normal[0]) + std::abs(normal[1]) +
+                          std::abs(normal[2]);
+        if (sum == 0.0f)
+        {
+            return { 0.0f, 0.0f };
+        }
+        float x = normal[0] / sum;
+        float y = normal[1] / sum;
+        if (normal[2] < 0.0f)
+        {
+            const float foldedX =
+                (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const float foldedY =
+                (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        return { x, y };
+    }
+
+private:
+    static constexpr size_t VERTICES_PER_TASK = 16384;
+};